@@ -101,6 +101,21 @@ intrinsic void wait_for_interrupt( void ) {
   __asm volatile( "wfi" );
 }
 
+/** @brief DWT cycle count register */
+#define DWT_CYCCNT ((volatile uint32_t *) 0xE0001004)
+
+/**
+ * @brief      Reads the free running DWT cycle counter. Only meaningful
+ *             after enable_cycle_counter() has been called.
+ *
+ * @return     The current CPU cycle count.
+ */
+intrinsic uint32_t read_cycle_counter( void ) {
+  return *DWT_CYCCNT;
+}
+
+void enable_cycle_counter( void );
+
 void pend_pendsv( void );
 
 void clear_pendsv( void );
@@ -15,4 +15,9 @@
  */
 extern void enter_user_mode( void );
 
+/**
+ * @brief      Prints the allocation latency benchmark, PROFILE=1 only.
+ */
+void kmalloc_bench( void );
+
 #endif /* _KERNEL_H_ */
@@ -6,6 +6,9 @@
  *             To use, allocate a struct for kmalloc_t, then initialise
  *             with heap end and top.
  *
+ *             Kernel objects of several sizes come from a kslab_t instead,
+ *             which keeps one free list per size class.
+ *
  * @date       Febuary 12, 2019
  *
  * @author     Ronit Banerjee <ronitb@andrew.cmu.edu>
@@ -50,4 +53,53 @@ void* k_malloc_aligned( kmalloc_t* internals );
 
 void k_free( kmalloc_t* internals, void* buffer );
 
+/** @brief      log2 of the bytes in a slab page, the unit taken from the heap */
+#define KSLAB_PAGE_LOG2 8
+/** @brief      Bytes in a slab page */
+#define KSLAB_PAGE_SIZE (1 << KSLAB_PAGE_LOG2)
+/** @brief      Most pages one slab allocator manages, 32kB of heap */
+#define KSLAB_MAX_PAGES 128
+/** @brief      Most size classes of one slab allocator */
+#define KSLAB_MAX_CLASSES 8
+/** @brief      Word a freed block is filled with when poisoning is on */
+#define KSLAB_POISON 0xDEADBEEF
+
+/**
+ * @brief      One size class. Small blocks are cut from a page of their
+ *             own class as they are needed, a block larger than a page
+ *             takes whole pages.
+ */
+typedef struct kslab_class_t {
+   list_node* free_node; /**< freed blocks, the last freed first */
+   char* next;           /**< next block never handed out in the current page */
+   char* end;            /**< end of the current page */
+   uint32_t size;        /**< block size, a multiple of 8 */
+   uint32_t in_use;      /**< blocks allocated and not freed */
+}kslab_class_t;
+
+/**
+ * @brief      Slab allocator over one kernel heap. Every page handed out
+ *             is tagged with its class, so a free finds the class of a
+ *             block from its address alone.
+ */
+typedef struct kslab_t {
+   kmalloc_t pages;                          /**< hands out pages, unaligned mode */
+   kslab_class_t classes[KSLAB_MAX_CLASSES]; /**< size classes, smallest first */
+   uint32_t num_classes;                     /**< size classes in use */
+   uint32_t poison;                          /**< whether freed blocks are poisoned */
+   uint8_t page_class[KSLAB_MAX_PAGES];      /**< class + 1 of each page, 0 if not handed out */
+}kslab_t;
+
+int k_slab_init( kslab_t* slab,
+                 char* heap_low,
+                 char* heap_top,
+                 const uint32_t* sizes,
+                 uint32_t num_classes,
+                 uint32_t poison );
+
+void* k_slab_alloc( kslab_t* slab,
+                    uint32_t size );
+
+void k_slab_free( kslab_t* slab, void* buffer );
+
 #endif /* _KMALLOC_H_ */
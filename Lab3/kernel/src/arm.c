@@ -23,6 +23,17 @@
 
 #define SHPR2 ((volatile uint32_t *) 0xE000ED1C)
 
+/* @brief Debug exception and monitor control register and flags */
+//@{
+#define DEMCR ((volatile uint32_t *) 0xE000EDFC)
+#define DEMCR_TRCENA (1 << 24)
+//@}
+/* @brief DWT control register and flags */
+//@{
+#define DWT_CTRL ((volatile uint32_t *) 0xE0001000)
+#define DWT_CTRL_CYCCNTENA 1
+//@}
+
 /**
  * @brief      Disables stack alignement.
  */
@@ -47,6 +58,15 @@ void enable_fpu( void ){
   instruction_sync_barrier();
 }
 
+/**
+ * @brief      Starts the DWT cycle counter from 0.
+ */
+void enable_cycle_counter( void ){
+  *DEMCR |= DEMCR_TRCENA;
+  *DWT_CYCCNT = 0;
+  *DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
 /**
  * @brief      Pends a pendsv.
  */
@@ -33,6 +33,9 @@ int kernel_main( void ) {
 	timer_start(SERVO_FREQ);
     uart_init(0);
     servo_init();
+#ifdef PROFILE
+    kmalloc_bench();
+#endif
     enter_user_mode();
     return 0;
 }
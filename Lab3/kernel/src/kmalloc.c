@@ -17,6 +17,12 @@
  *             In unaligned allocations, the caller may specify the size they
  *             want. You do not need to support frees on unaligned regions.
  *
+ *             The slab allocator serves several block sizes from one heap.
+ *             The heap is handed out in pages by an unaligned kmalloc, each
+ *             page to one size class, and each class keeps its own free
+ *             list. Allocations and frees push and pop that list, so both
+ *             take the same time however many blocks are free.
+ *
  * @date       Febuary 12, 2019
  *
  * @author     Ronit Banerjee <ronitb@andrew.cmu.edu>
@@ -27,7 +33,11 @@
 #include <debug.h>
 #include <unistd.h>
 
-list_node *findLast(list_node *free_node);
+/** @brief page_class of the pages of a large block after its first */
+#define KSLAB_PAGE_TAIL 0xFF
+
+/** @brief for the poison checks, which compile away without DEBUG */
+#define UNUSED __attribute__((unused))
 
 /**
  * @brief      Initiliazes the kmalloc structure.
@@ -67,15 +77,14 @@ void k_malloc_init( kmalloc_t* internals,
  * @param[in]  internals  The kmalloc internal kernel structure
  * @param[in]  size       The allocation size.
  *
- * @return     Returns the pointer to the allocated buffer.
+ * @return     Returns the pointer to the allocated buffer, or NULL if it
+ *             would not fit below heap_top.
  */
 void* k_malloc_unaligned( kmalloc_t* internals,
                           uint32_t size ){
     ASSERT(internals->unaligned);
-    if(!size){
-        internals->curr_low= (char*)(internals->curr_low + size);
-        return (void*)internals->curr_low;
-    }
+    if(size > (uint32_t)(internals->heap_top - internals->curr_low))
+        return NULL;
 
     internals->prev_low= internals->curr_low;
     internals->curr_low= (char*)(internals->curr_low + size);
@@ -101,11 +110,12 @@ void* k_malloc_aligned( kmalloc_t* internals ){
         return (void*)tmp;
     }
 
+    if(internals->stack_size > (uint32_t)(internals->heap_top - internals->curr_low))
+        return NULL;
+
     internals->prev_low= internals->curr_low;
     internals->curr_low= (char*)((internals->curr_low) +
                             (internals->stack_size));
-    if(internals->curr_low > internals->heap_top)
-        return NULL;
     return (void*)internals->prev_low;
 }
 
@@ -120,41 +130,201 @@ void* k_malloc_aligned( kmalloc_t* internals ){
  *             the buffer as a stack it must be the orignial pointer you
  *             obtained and not the current stack position.
  */
-
-
 void k_free( kmalloc_t* internals, void* buffer ){
     list_node *new_node;
-    list_node *last_node;
 
+    ASSERT((char*)buffer >= internals->heap_low &&
+           (char*)buffer < internals->curr_low);
+
+    /* push the node, k_malloc_aligned pops the same end */
     new_node= (list_node*)buffer;
-    new_node->next= NULL;
-    last_node= findLast(internals->free_node);
+    new_node->next= internals->free_node;
+    internals->free_node= new_node;
+}
+
+/**
+ * @brief      Initializes a slab allocator over a heap.
+ *
+ * @param[in]  slab         The slab allocator structure.
+ * @param[in]  heap_low     The heap low, 8 byte aligned.
+ * @param[in]  heap_top     The heap top. Only the first KSLAB_MAX_PAGES
+ *                          pages of a larger heap are used.
+ * @param[in]  sizes        Block size of each class, smallest first. Each
+ *                          is rounded up to a multiple of 8.
+ * @param[in]  num_classes  The number of classes, at most KSLAB_MAX_CLASSES.
+ * @param[in]  poison       If set, freed blocks are filled with KSLAB_POISON
+ *                          and checked when they are handed out again, to
+ *                          catch writes after a free and double frees.
+ *
+ * @return     Returns 0 if initialization was successful, or -1 otherwise.
+ */
+int k_slab_init( kslab_t* slab,
+                 char* heap_low,
+                 char* heap_top,
+                 const uint32_t* sizes,
+                 uint32_t num_classes,
+                 uint32_t poison ){
+    if(!num_classes || num_classes > KSLAB_MAX_CLASSES)
+        return -1;
+    if(((uint32_t)heap_low & 0x7) || heap_top < heap_low)
+        return -1;
+    if((uint32_t)(heap_top - heap_low) > KSLAB_MAX_PAGES * KSLAB_PAGE_SIZE)
+        heap_top= heap_low + KSLAB_MAX_PAGES * KSLAB_PAGE_SIZE;
+
+    for(uint32_t i= 0; i < num_classes; i++){
+        kslab_class_t *class= &slab->classes[i];
+
+        class->size= (sizes[i] + 7) & ~0x7;
+        if(!class->size || (i && class->size <= slab->classes[i - 1].size))
+            return -1;
+        class->free_node= NULL;
+        class->next= NULL;
+        class->end= NULL;
+        class->in_use= 0;
+    }
+
+    k_malloc_init(&slab->pages, heap_low, heap_top, 0, 1);
+    slab->num_classes= num_classes;
+    slab->poison= poison;
+    for(uint32_t i= 0; i < KSLAB_MAX_PAGES; i++)
+        slab->page_class[i]= 0;
+    return 0;
+}
+
+/**
+ * @brief      Takes pages from the heap and tags them with their class.
+ *
+ * @param[in]  slab   The slab allocator structure.
+ * @param[in]  class  Index of the class the pages are for.
+ * @param[in]  bytes  Bytes wanted, rounded up to whole pages.
+ *
+ * @return     Pointer to the first page, NULL if the heap is used up.
+ */
+static char* slab_take_pages( kslab_t* slab, uint32_t class, uint32_t bytes ){
+    uint32_t num_pages= (bytes + KSLAB_PAGE_SIZE - 1) >> KSLAB_PAGE_LOG2;
+    char *pages= k_malloc_unaligned(&slab->pages, num_pages << KSLAB_PAGE_LOG2);
+    if(pages == NULL)
+        return NULL;
+
+    uint32_t first= (pages - slab->pages.heap_low) >> KSLAB_PAGE_LOG2;
+    slab->page_class[first]= class + 1;
+    for(uint32_t i= 1; i < num_pages; i++)
+        slab->page_class[first + i]= KSLAB_PAGE_TAIL;
+    return pages;
+}
+
+/**
+ * @brief      Finds the class a block was allocated from.
+ *
+ * @param[in]  slab    The slab allocator structure.
+ * @param[in]  buffer  Pointer to the block.
+ *
+ * @return     The class, or NULL if buffer is not the start of a block
+ *             handed out by this allocator.
+ */
+static kslab_class_t* slab_class_of( kslab_t* slab, void* buffer ){
+    char *block= (char*)buffer;
+    if(block < slab->pages.heap_low || block >= slab->pages.curr_low)
+        return NULL;
+
+    uint32_t offset= block - slab->pages.heap_low;
+    uint32_t tag= slab->page_class[offset >> KSLAB_PAGE_LOG2];
+    if(!tag || tag == KSLAB_PAGE_TAIL)
+        return NULL;
 
-    if(last_node == NULL)
-        internals->free_node= new_node;
-    else
-        last_node->next= new_node;
+    kslab_class_t *class= &slab->classes[tag - 1];
+    if(((offset & (KSLAB_PAGE_SIZE - 1)) % class->size) != 0)
+        return NULL;
+    return class;
 }
-/** @brief - returns the last node in a linked-list of heap nodes
+
+/**
+ * @brief      Whether a block still holds the poison it was filled with
+ *             when freed, after the free list link.
+ *
+ * @param[in]  class  The class of the block.
+ * @param[in]  block  Pointer to the block.
+ *
+ * @return     1 if every word after the link is KSLAB_POISON, 0 otherwise.
  */
-list_node *findLast(list_node *free_node){
-    list_node *last_node;
+UNUSED static int slab_poisoned( const kslab_class_t* class, void* block ){
+    uint32_t *word= (uint32_t*)block;
+    for(uint32_t w= sizeof(list_node) / 4; w < class->size / 4; w++){
+        if(word[w] != KSLAB_POISON)
+            return 0;
+    }
+    return 1;
+}
 
-    /* free_node -> NULL*/
-    if(free_node == NULL){
-        last_node= NULL;
+/**
+ * @brief      Allocates a block from the smallest class that holds size
+ *             bytes: the block freed last, or else a new one.
+ *
+ * @param[in]  slab  The slab allocator structure.
+ * @param[in]  size  The allocation size.
+ *
+ * @return     Pointer to the allocated block, 8 byte aligned, or NULL if
+ *             size is larger than every class or the heap is used up.
+ */
+void* k_slab_alloc( kslab_t* slab,
+                    uint32_t size ){
+    uint32_t i= 0;
+    while(i < slab->num_classes && slab->classes[i].size < size)
+        i++;
+    if(i == slab->num_classes)
+        return NULL;
 
-    /* free_node -> node -> NULL*/
-    }else if((free_node != NULL) &&
-            (free_node->next == NULL)){
-        last_node= free_node;
+    kslab_class_t *class= &slab->classes[i];
+    char *block;
 
-    /* free_node -> node -> ... -> node -> NULL*/
+    if(class->free_node != NULL){
+        /* pop the node */
+        block= (char*)class->free_node;
+        class->free_node= class->free_node->next;
+        if(slab->poison)
+            WARN(slab_poisoned(class, block), "block %p written after it was freed\n", block);
+    }else if(class->size > KSLAB_PAGE_SIZE){
+        block= slab_take_pages(slab, i, class->size);
     }else{
-        last_node= free_node;
-        while(last_node->next != NULL){
-            last_node= last_node->next;
+        if(class->next == NULL || class->next + class->size > class->end){
+            class->next= slab_take_pages(slab, i, KSLAB_PAGE_SIZE);
+            class->end= class->next + KSLAB_PAGE_SIZE;
         }
+        block= class->next;
+        if(block != NULL)
+            class->next= block + class->size;
     }
-    return last_node;
+
+    if(block != NULL)
+        class->in_use++;
+    return (void*)block;
+}
+
+/**
+ * @brief      Returns a block to the free list of its class.
+ *
+ * @param[in]  slab    The slab allocator structure.
+ * @param[in]  buffer  Pointer to a block obtained from k_slab_alloc.
+ *
+ * @warning    A pointer that is not the start of a block of this allocator
+ *             asserts and is otherwise ignored.
+ */
+void k_slab_free( kslab_t* slab, void* buffer ){
+    kslab_class_t *class= slab_class_of(slab, buffer);
+    ASSERT(class != NULL);
+    if(class == NULL)
+        return;
+
+    uint32_t *word= (uint32_t*)buffer;
+    if(slab->poison){
+        /* still poisoned throughout, it was freed already */
+        ASSERT(!slab_poisoned(class, buffer));
+        for(uint32_t w= sizeof(list_node) / 4; w < class->size / 4; w++)
+            word[w]= KSLAB_POISON;
+    }
+
+    /* push the node */
+    ((list_node*)word)->next= class->free_node;
+    class->free_node= (list_node*)word;
+    class->in_use--;
 }
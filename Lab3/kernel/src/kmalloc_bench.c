@@ -0,0 +1,200 @@
+/**
+ * @file   kmalloc_bench.c
+ *
+ * @brief  Allocation latency benchmark, run at boot when the kernel is built
+ *         with PROFILE=1. Times k_slab_alloc and k_slab_free with free lists
+ *         of growing length, next to the tail-appending free k_free used to
+ *         do, and the first and reused allocation of every size class.
+ *         Everything here compiles to nothing otherwise.
+ *
+ * @date   10/17/26
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <arm.h>
+#include <kernel.h>
+#include <kmalloc.h>
+#include <printk.h>
+#include <unistd.h>
+
+#ifdef PROFILE
+
+/** @brief heaps the benchmark may overwrite, nothing else allocates from them */
+//@{
+extern char __kheap_low_1, __kheap_top_1;
+extern char __kheap_low_2, __kheap_top_2;
+//@}
+
+/** @brief longest free list the frees and allocations are timed at */
+#define BENCH_DEPTH_MAX 96
+/** @brief free list lengths the frees and allocations are timed at */
+static const uint32_t bench_depths[]= { 1, 8, 32, BENCH_DEPTH_MAX };
+/** @brief block sizes of the benchmark slab: mutexes, TCBs, message buffers and stacks */
+static const uint32_t bench_sizes[]= { 16, 32, 64, 128, 256, 1024 };
+/** @brief timed repetitions of each operation */
+#define BENCH_REPS 16
+/** @brief size of the blocks the free lists are built from */
+#define BENCH_BLOCK 32
+/** @brief number of entries of an array */
+#define ARRAY_LEN( a ) ( sizeof( a ) / sizeof( ( a )[0] ) )
+
+/**
+ * @brief      Fewest and most cycles of the repetitions of one operation.
+ */
+typedef struct {
+    uint32_t min; /**< fewest cycles */
+    uint32_t max; /**< most cycles */
+} bench_range_t;
+
+/** @brief blocks handed out while a free list is built, one more for the timed free */
+static void* bench_blocks[BENCH_DEPTH_MAX + 1];
+
+/**
+ * @brief      Reference: the free k_free did before, which walks the whole
+ *             free list to append at its tail.
+ *
+ * @param[in]  internals  The internals structure.
+ * @param[in]  buffer     Pointer to a buffer that was obtained.
+ */
+static void free_tail( kmalloc_t* internals, void* buffer ){
+    list_node *new_node= (list_node*)buffer;
+    new_node->next= NULL;
+
+    if(internals->free_node == NULL){
+        internals->free_node= new_node;
+        return;
+    }
+    list_node *last_node= internals->free_node;
+    while(last_node->next != NULL)
+        last_node= last_node->next;
+    last_node->next= new_node;
+}
+
+/**
+ * @brief      Empties a range, so the first cycle count added sets both ends.
+ *
+ * @param[out] range  The range.
+ */
+static void range_init( bench_range_t* range ){
+    range->min= UINT32_MAX;
+    range->max= 0;
+}
+
+/**
+ * @brief      Widens a range to cover one more cycle count.
+ *
+ * @param[in,out] range   The range.
+ * @param[in]     cycles  The cycle count.
+ */
+static void range_add( bench_range_t* range, uint32_t cycles ){
+    if(cycles < range->min) range->min= cycles;
+    if(cycles > range->max) range->max= cycles;
+}
+
+/**
+ * @brief      Times the slab free and allocation of one block with depth
+ *             blocks already on the free list.
+ *
+ * @param[in]  depth        Blocks on the free list, at most BENCH_DEPTH_MAX.
+ * @param[out] free_range   Widened by the cycles of each free.
+ * @param[out] alloc_range  Widened by the cycles of each allocation.
+ */
+static void bench_slab( uint32_t depth, bench_range_t* free_range, bench_range_t* alloc_range ){
+    kslab_t slab;
+    k_slab_init(&slab, &__kheap_low_1, &__kheap_top_1, bench_sizes, ARRAY_LEN(bench_sizes), 0);
+
+    for(uint32_t i= 0; i <= depth; i++)
+        bench_blocks[i]= k_slab_alloc(&slab, BENCH_BLOCK);
+    for(uint32_t i= 0; i < depth; i++)
+        k_slab_free(&slab, bench_blocks[i]);
+
+    void *block= bench_blocks[depth];
+    for(uint32_t rep= 0; rep < BENCH_REPS; rep++){
+        disable_interrupts();
+        uint32_t start= read_cycle_counter();
+        k_slab_free(&slab, block);
+        uint32_t mid= read_cycle_counter();
+        block= k_slab_alloc(&slab, BENCH_BLOCK);
+        uint32_t end= read_cycle_counter();
+        enable_interrupts();
+
+        range_add(free_range, mid - start);
+        range_add(alloc_range, end - mid);
+    }
+}
+
+/**
+ * @brief      Times the old tail-appending free of one block with depth
+ *             blocks already on the free list. The allocation pops the head,
+ *             so the list keeps its length.
+ *
+ * @param[in]  depth       Blocks on the free list, at most BENCH_DEPTH_MAX.
+ * @param[out] free_range  Widened by the cycles of each free.
+ */
+static void bench_tail( uint32_t depth, bench_range_t* free_range ){
+    kmalloc_t heap;
+    k_malloc_init(&heap, &__kheap_low_2, &__kheap_top_2, BENCH_BLOCK, 0);
+
+    for(uint32_t i= 0; i <= depth; i++)
+        bench_blocks[i]= k_malloc_aligned(&heap);
+    for(uint32_t i= 0; i < depth; i++)
+        free_tail(&heap, bench_blocks[i]);
+
+    void *block= bench_blocks[depth];
+    for(uint32_t rep= 0; rep < BENCH_REPS; rep++){
+        disable_interrupts();
+        uint32_t start= read_cycle_counter();
+        free_tail(&heap, block);
+        uint32_t end= read_cycle_counter();
+        enable_interrupts();
+
+        range_add(free_range, end - start);
+        block= k_malloc_aligned(&heap);
+    }
+}
+
+/**
+ * @brief      Prints the allocation latencies in cycles over UART.
+ */
+void kmalloc_bench( void ){
+    enable_cycle_counter();
+
+    uint32_t start= read_cycle_counter();
+    uint32_t overhead= read_cycle_counter() - start;
+
+    printk("---- k_malloc latency in cycles, min-max of %u ----\n", BENCH_REPS);
+    printk("cycle counter read: %u\n", overhead);
+    printk("free list\tslab free\tslab alloc\ttail free\n");
+    for(uint32_t d= 0; d < ARRAY_LEN(bench_depths); d++){
+        bench_range_t slab_free, slab_alloc, tail_free;
+        range_init(&slab_free);
+        range_init(&slab_alloc);
+        range_init(&tail_free);
+
+        bench_slab(bench_depths[d], &slab_free, &slab_alloc);
+        bench_tail(bench_depths[d], &tail_free);
+        printk("%u\t\t%u-%u\t\t%u-%u\t\t%u-%u\n", bench_depths[d], slab_free.min, slab_free.max,
+               slab_alloc.min, slab_alloc.max, tail_free.min, tail_free.max);
+    }
+
+    /* a new block may take a page, a reused one is popped off the free list */
+    kslab_t slab;
+    k_slab_init(&slab, &__kheap_low_1, &__kheap_top_1, bench_sizes, ARRAY_LEN(bench_sizes), 0);
+    printk("class\tnew\treused\n");
+    for(uint32_t c= 0; c < ARRAY_LEN(bench_sizes); c++){
+        disable_interrupts();
+        uint32_t t0= read_cycle_counter();
+        void *block= k_slab_alloc(&slab, bench_sizes[c]);
+        uint32_t t1= read_cycle_counter();
+        k_slab_free(&slab, block);
+        uint32_t t2= read_cycle_counter();
+        k_slab_alloc(&slab, bench_sizes[c]);
+        uint32_t t3= read_cycle_counter();
+        enable_interrupts();
+
+        printk("%u\t%u\t%u\n", bench_sizes[c], t1 - t0, t3 - t2);
+    }
+}
+
+#endif /* PROFILE */
@@ -17,6 +17,8 @@ void init_349( void );
 
 void enable_fpu( void );
 
+void fpu_discard_lazy_state( void );
+
 /**
  * @brief      Asm wrapper for strex.
  *
@@ -68,7 +70,7 @@ intrinsic int save_interrupt_state_and_disable( void ) {
   int result;
   int disable_constant = 1;
   __asm volatile( "mrs %0, PRIMASK"  : "=r" ( result ));
-  __asm volatile( "msr PRIMASK, %0" : "=r" (disable_constant));
+  __asm volatile( "msr PRIMASK, %0" : : "r" ( disable_constant ) : "memory" );
   return result;
 }
 
@@ -77,7 +79,7 @@ intrinsic int save_interrupt_state_and_disable( void ) {
  *             disables interrupts.
  */
 intrinsic void restore_interrupt_state( int state ) {
-  __asm volatile( "msr PRIMASK, %0" : "=r" ( state ) );
+  __asm volatile( "msr PRIMASK, %0" : : "r" ( state ) : "memory" );
 }
 
 /**
@@ -121,10 +123,48 @@ intrinsic void wait_for_interrupt( void ) {
   __asm volatile( "wfi" );
 }
 
+/**
+ * @brief      Counts the leading zero bits of a word.
+ *
+ * @param[in]  val   The word to inspect.
+ *
+ * @return     Number of leading zeros, 32 if val is 0.
+ */
+intrinsic uint32_t count_leading_zeros( uint32_t val ) {
+  uint32_t result;
+
+  __asm volatile ( "clz %0, %1" : "=r" ( result ) : "r" ( val ) );
+  return( result );
+}
+
+/** @brief DWT cycle count register */
+#define DWT_CYCCNT ((volatile uint32_t *) 0xE0001004)
+
+/**
+ * @brief      Reads the free running DWT cycle counter. Only meaningful
+ *             after enable_cycle_counter() has been called.
+ *
+ * @return     The current CPU cycle count.
+ */
+intrinsic uint32_t read_cycle_counter( void ) {
+  return *DWT_CYCCNT;
+}
+
+void enable_cycle_counter( void );
+
+/** @brief cycles spent in accounted handlers, nested handlers counted once */
+extern volatile uint64_t irq_cycles;
+
+void irq_enter( void );
+
+void irq_exit( void );
+
 void pend_pendsv( void );
 
 void clear_pendsv( void );
 
+int systick_pending( void );
+
 int get_svc_status( void );
 
 void set_svc_status( int status );
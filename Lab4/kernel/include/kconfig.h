@@ -0,0 +1,68 @@
+/**
+ * @file   kconfig.h
+ *
+ * @brief  Compile-time capacity of the kernel's thread, mutex, semaphore,
+ *         event and message queue tables. Threads and mutexes can be overridden from
+ *         make, e.g. THREAD_CAPACITY=32. The tables are placed after
+ *         .bss, and the link fails if they push the thread stacks past the
+ *         end of SRAM.
+ *
+ * @date   10/17/26
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#ifndef _KCONFIG_H_
+#define _KCONFIG_H_
+
+/** @brief most user threads thread_init may be asked for */
+#ifndef THREAD_CAPACITY
+#define THREAD_CAPACITY 64
+#endif
+
+/** @brief most mutexes thread_init may be asked for */
+#ifndef MUTEX_CAPACITY
+#define MUTEX_CAPACITY 32
+#endif
+
+/** @brief most semaphores that may be initialized */
+#ifndef SEM_CAPACITY
+#define SEM_CAPACITY 16
+#endif
+
+/** @brief most event flag groups that may be initialized */
+#ifndef EVENT_CAPACITY
+#define EVENT_CAPACITY 16
+#endif
+
+/** @brief most message queues that may be initialized */
+#ifndef MQUEUE_CAPACITY
+#define MQUEUE_CAPACITY 8
+#endif
+
+/** @brief most user mutexes, one bit each in a thread's held map */
+#define UMUTEX_CAPACITY 32
+
+/** @brief most buffers of one message queue, one bit each in its free map */
+#define MQUEUE_DEPTH_MAX 32
+
+/** @brief thread control blocks, the user threads plus main and idle */
+#define TCB_CAPACITY (THREAD_CAPACITY + 2)
+
+/** @brief words in a bit set with one bit per thread id */
+#define THREAD_SET_WORDS ((TCB_CAPACITY + 31) / 32)
+
+/** @brief words in the ready map, one bit per priority */
+#define PRIO_WORDS ((THREAD_CAPACITY + 31) / 32)
+
+/** @brief number of distinct thread priorities */
+#define NUM_PRIOS (PRIO_WORDS * 32)
+
+/** @brief places a kernel table in the .kheap section, after .bss */
+#define KHEAP_TABLE __attribute__((section(".kheap")))
+
+#if TCB_CAPACITY > 255
+#error "thread ids are 8 bits, THREAD_CAPACITY must be at most 253"
+#endif
+
+#endif /* _KCONFIG_H_ */
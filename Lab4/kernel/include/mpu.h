@@ -11,6 +11,25 @@
 
 #include <unistd.h>
 
+/** @brief first region reprogrammed on every context switch */
+#define MM_THREAD_REGION_FIRST 5
+/** @brief regions reprogrammed per thread, at most the 4 register pairs of one burst */
+#define MM_THREAD_REGIONS 2
+
+/** @brief log[2] of the smallest region that can be split into 8 subregions */
+#define MM_SUBREGION_MIN_LOG2 8
+/** @brief log[2] of the number of subregions of a region */
+#define MM_SUBREGIONS_LOG2 3
+
+/**
+ * @brief  A region as written to the MPU, encoded once by mm_region_encode()
+ *         so a context switch only stores it.
+ */
+typedef struct {
+  uint32_t rbar; /**< base address, VALID and the region number */
+  uint32_t rasr; /**< size, permissions and enable */
+} mm_region_t;
+
 /**
  * @brief  Returns ceiling (log_2 n).
  */
@@ -22,6 +41,51 @@ uint32_t mm_log2ceil_size(uint32_t n);
 int mm_region_enable( uint32_t region_number, void *base_address, 
         uint8_t size_log2, int execute, int user_write_access);
 
+/**
+ * @brief Encodes a region for mm_region_load, same arguments as mm_region_enable
+ */
+int mm_region_encode( mm_region_t *region, uint32_t region_number, void *base_address,
+        uint8_t size_log2, int execute, int user_write_access);
+
+/**
+ * @brief Encodes a stack guard, one subregion made inaccessible
+ */
+int mm_guard_encode( mm_region_t *region, uint32_t region_number, void *guard_address,
+        uint8_t size_log2 );
+
+/**
+ * @brief Returns log[2] of the size of an encoded region
+ */
+uint8_t mm_region_size_log2( const mm_region_t *region );
+
+/**
+ * @brief Encodes a region number left disabled, so a load clears it
+ */
+void mm_region_encode_off( mm_region_t *region, uint32_t region_number );
+
+/**
+ * @brief Disables subregions of an encoded region, one mask bit per eighth
+ */
+int mm_region_disable_subregions( mm_region_t *region, uint8_t srd );
+
+/**
+ * @brief Programs up to 4 encoded regions through the RBAR/RASR aliases
+ */
+void mm_region_load( const mm_region_t *regions, uint32_t count );
+
+/**
+ * @brief Whether user code may access a buffer, under the running thread's regions
+ */
+int mm_user_range( const void *ptr, uint32_t len, int write );
+
+/** @brief whether user code may write an object at ptr, aligned for its type */
+#define MM_USER_WRITABLE( ptr ) \
+  ( !( (uint32_t)( ptr ) & ( __alignof__( *( ptr ) ) - 1 ) ) && mm_user_range( ( ptr ), sizeof( *( ptr ) ), 1 ) )
+
+/** @brief whether user code may read an object at ptr, aligned for its type */
+#define MM_USER_READABLE( ptr ) \
+  ( !( (uint32_t)( ptr ) & ( __alignof__( *( ptr ) ) - 1 ) ) && mm_user_range( ( ptr ), sizeof( *( ptr ) ), 0 ) )
+
 /**
  * @brief Enables a region for memory protection
  */
@@ -0,0 +1,68 @@
+/**
+ * @file   pqueue.h
+ *
+ * @brief  Intrusive binary min-heap used for the kernel's time ordered
+ *         queues. Keys are tick counts and compare with wraparound.
+ *
+ * @date   10/17/26
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#ifndef _PQUEUE_H_
+#define _PQUEUE_H_
+
+#include <stddef.h>
+#include <unistd.h>
+
+/** @brief position of a node that is not on any queue */
+#define PQ_NONE 0xFFFFFFFF
+
+/**
+ * @brief  heap linkage embedded in the queued object
+ */
+typedef struct {
+  uint32_t key; /**< primary ordering key, smallest first */
+  uint32_t tie; /**< secondary ordering key for equal primary keys */
+  uint32_t pos; /**< index in the heap array, PQ_NONE if not queued */
+} pq_node_t;
+
+/**
+ * @brief  heap of node pointers over caller provided storage
+ */
+typedef struct {
+  pq_node_t **nodes; /**< heap ordered array of queued nodes */
+  uint32_t size;     /**< number of queued nodes */
+  uint32_t capacity; /**< length of the nodes array */
+} pq_t;
+
+/**
+ * @brief      Gets the structure a pq_node_t is embedded in.
+ *
+ * @param      node    Pointer to the embedded pq_node_t.
+ * @param      type    Type of the containing structure.
+ * @param      member  Name of the pq_node_t member.
+ */
+#define pq_entry( node, type, member ) \
+  ( ( type * )( ( char * )( node ) - offsetof( type, member ) ) )
+
+/**
+ * @brief      Whether tick a is strictly before tick b, modulo wraparound.
+ */
+#define TICK_BEFORE( a, b ) ( ( int32_t )( ( a ) - ( b ) ) < 0 )
+
+void pq_init( pq_t *pq, pq_node_t **storage, uint32_t capacity );
+
+void pq_node_init( pq_node_t *node );
+
+int pq_insert( pq_t *pq, pq_node_t *node );
+
+void pq_remove( pq_t *pq, pq_node_t *node );
+
+void pq_update( pq_t *pq, pq_node_t *node, uint32_t key );
+
+pq_node_t *pq_peek( pq_t *pq );
+
+pq_node_t *pq_pop( pq_t *pq );
+
+#endif /* _PQUEUE_H_ */
@@ -0,0 +1,102 @@
+/**
+ * @file   profile.h
+ *
+ * @brief  Cycle-count instrumentation of kernel hot paths. Only compiled in
+ *         when the kernel is built with PROFILE=1.
+ *
+ * @date   10/17/26
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <unistd.h>
+#include <arm.h>
+
+/** @brief log2 histogram buckets, the last one also holds everything larger */
+#define PROF_HIST_BUCKETS 16
+
+/**
+ * @enum prof_id
+ * @brief Instrumented kernel code paths
+ */
+typedef enum {
+  PROF_SCHED_PICK = 0,   /**< O(1) ready bitmap lookup in pendsv */
+  PROF_SCHED_PICK_SCAN,  /**< reference linear scan over all TCBs */
+  PROF_SYSTICK,          /**< whole SysTick handler */
+  PROF_PENDSV,           /**< pendsv context switch, C part */
+  PROF_PENDSV_SKIP,      /**< pendsv that kept the running thread */
+  PROF_MPU_LOAD,         /**< stack region load from the TCB on a switch */
+  PROF_MPU_ENCODE,       /**< reference encoding of the same region on the switch */
+  PROF_NUM               /**< number of instrumented paths */
+} prof_id;
+
+/**
+ * @brief  cycle statistics for one instrumented code path
+ */
+typedef struct {
+  uint32_t count; /**< number of samples */
+  uint32_t min;   /**< fewest cycles observed */
+  uint32_t max;   /**< most cycles observed */
+  uint64_t total; /**< sum of all samples */
+  uint32_t hist[PROF_HIST_BUCKETS]; /**< bucket i counts samples in [2^i, 2^(i+1)) */
+} prof_stat_t;
+
+#ifdef PROFILE
+
+/** @brief per-path statistics, indexed by prof_id */
+extern prof_stat_t prof_stats[PROF_NUM];
+
+/** @brief number of times the bitmap and the scan picked different threads */
+extern uint32_t prof_pick_mismatch;
+
+/**
+ * @brief      Samples the cycle counter into a new local variable.
+ *
+ * @param      start  Name of the local to declare.
+ */
+#define PROF_START( start ) uint32_t start = read_cycle_counter()
+
+/**
+ * @brief      Records the cycles elapsed since PROF_START.
+ *
+ * @param      id     The prof_id to charge.
+ * @param      start  The local declared by PROF_START.
+ */
+#define PROF_END( id, start ) prof_record( ( id ), read_cycle_counter() - ( start ) )
+
+#else
+
+/**
+ * @brief      Stubs for when PROFILE is not defined.
+ *
+ * @param      ...   Variadic unused
+ */
+//{@
+#define PROF_START( ... ) do {} while( 0 )
+#define PROF_END( ... ) do {} while( 0 )
+//@}
+
+#endif /* PROFILE */
+
+/**
+ * @brief      Clears all statistics.
+ */
+void prof_reset( void );
+
+/**
+ * @brief      Adds one sample to a code path's statistics.
+ *
+ * @param[in]  id      The instrumented path.
+ * @param[in]  cycles  Cycles spent in the path.
+ */
+void prof_record( prof_id id, uint32_t cycles );
+
+/**
+ * @brief      Prints every path that has samples over printk.
+ */
+void prof_dump( void );
+
+#endif /* _PROFILE_H_ */
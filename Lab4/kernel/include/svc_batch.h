@@ -0,0 +1,51 @@
+/**
+ * @file   svc_batch.h
+ *
+ * @brief  Layout of the submission and completion rings SVC_BATCH runs,
+ *         shared by the kernel and user_common/include/svc_ring.h. The
+ *         user owns sq_tail and cq_head, the kernel sq_head and cq_tail.
+ *
+ * @date   10/17/26
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#ifndef _SVC_BATCH_H_
+#define _SVC_BATCH_H_
+
+#include <stdint.h>
+
+/** @brief most entries of each ring, so the kernel checks a bounded span */
+#define SVC_RING_ENTRIES_MAX 256
+
+/**
+ * @brief      One queued system call.
+ */
+typedef struct {
+  uint32_t num;     /**< SVC number */
+  uint32_t args[5]; /**< arguments, r0-r3 and r12 */
+  uint32_t tag;     /**< caller's value, copied to the completion */
+} svc_sqe_t;
+
+/**
+ * @brief      One finished system call.
+ */
+typedef struct {
+  uint32_t tag;    /**< tag of the call */
+  uint32_t result; /**< what the call returned, the low word for 64 bits */
+} svc_cqe_t;
+
+/**
+ * @brief      Submission and completion rings, both mask + 1 entries.
+ */
+typedef struct {
+  volatile uint32_t sq_head; /**< calls run, written by the kernel */
+  volatile uint32_t sq_tail; /**< calls queued */
+  volatile uint32_t cq_head; /**< completions read */
+  volatile uint32_t cq_tail; /**< completions written, by the kernel */
+  uint32_t mask;             /**< entries - 1, entries a power of 2 up to SVC_RING_ENTRIES_MAX */
+  svc_sqe_t *sq;             /**< entries submissions */
+  svc_cqe_t *cq;             /**< entries completions */
+} svc_ring_t;
+
+#endif /* _SVC_BATCH_H_ */
@@ -48,6 +48,56 @@
 #define SVC_PRIORITY    19
 /** @brief SVC number for thread_time() */
 #define SVC_THR_TIME    20
+/** @brief SVC number for thread_stats() */
+#define SVC_THR_STATS   24
+/** @brief SVC number for cpu_cycles() */
+#define SVC_CPU_CYCLES  25
+/** @brief SVC number for mutex_stats() */
+#define SVC_MUT_STATS   26
+/** @brief SVC number for sem_init() */
+#define SVC_SEM_INIT    27
+/** @brief SVC number for sem_wait() */
+#define SVC_SEM_WAIT    28
+/** @brief SVC number for sem_post() */
+#define SVC_SEM_POST    29
+/** @brief SVC number for event_init() */
+#define SVC_EVT_INIT    30
+/** @brief SVC number for event_wait() */
+#define SVC_EVT_WAIT    31
+/** @brief SVC number for event_set() */
+#define SVC_EVT_SET     32
+/** @brief SVC number for event_clear() */
+#define SVC_EVT_CLEAR   33
+/** @brief SVC number for mq_init() */
+#define SVC_MQ_INIT     34
+/** @brief SVC number for mq_send() */
+#define SVC_MQ_SEND     35
+/** @brief SVC number for mq_receive() */
+#define SVC_MQ_RECEIVE  36
+/** @brief SVC number for mq_alloc() */
+#define SVC_MQ_ALLOC    37
+/** @brief SVC number for mq_send_buf() */
+#define SVC_MQ_SEND_BUF 38
+/** @brief SVC number for mq_receive_buf() */
+#define SVC_MQ_RECV_BUF 39
+/** @brief SVC number for mq_free() */
+#define SVC_MQ_FREE     40
+/** @brief SVC number for umutex_init() */
+#define SVC_UMUT_INIT   41
+/** @brief SVC number for the umutex_lock() slow path */
+#define SVC_UMUT_LOK    42
+/** @brief SVC number for the umutex_unlock() slow path */
+#define SVC_UMUT_ULK    43
+/** @brief SVC number for sleep_ticks() */
+#define SVC_SLEEP       44
+/** @brief SVC number for sleep_until() */
+#define SVC_SLEEP_UNTIL 45
+/** @brief SVC number for svc_ring_submit() */
+#define SVC_BATCH       46
+/** @brief SVC number for thread_stack_usage() */
+#define SVC_THR_STACK   47
+/** @brief SVC number for idle_work() */
+#define SVC_IDLE_WORK   48
 
 /** @brief SVC number for servo_enable() */
 #define SVC_SERVO_ENABLE   22
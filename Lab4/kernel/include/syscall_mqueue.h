@@ -0,0 +1,132 @@
+/**
+ * @file   syscall_mqueue.h
+ *
+ * @brief  Message queues of fixed-size messages. Each queue owns depth
+ *         buffers the kernel carves from the space thread_init leaves
+ *         above the kernel stacks, so user code cannot scribble over
+ *         messages it does not own. Under KERNEL_ONLY user code reaches
+ *         them to build and read messages in place; under PER_THREAD only
+ *         the copying calls work. A buffer is always either free, queued, or
+ *         owned by one thread; mq_alloc and mq_receive_buf hand ownership to
+ *         the caller and mq_send_buf and mq_free take it back, so zero-copy
+ *         users move pointers instead of data. mq_send and mq_receive copy
+ *         through the same buffers for callers with data on their stacks.
+ *
+ * @date   10/17/26
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#ifndef _SYSCALL_MQUEUE_H_
+#define _SYSCALL_MQUEUE_H_
+
+#include <unistd.h>
+#include "kconfig.h"
+#include "syscall_mutex.h"
+
+/** @brief owner of a buffer that is free or queued */
+#define MQ_NO_OWNER 0xFF
+
+/** @brief bit of buffer i in a queue's free map */
+#define MQ_BIT(i) ((1U << 31) >> (i))
+
+/**
+ * @brief      The struct for a message queue.
+ */
+typedef struct {
+  uint8_t id;
+  uint8_t depth; /**< buffers, at most MQUEUE_DEPTH_MAX */
+  uint8_t head; /**< ring position of the oldest queued message */
+  uint8_t count; /**< messages queued */
+  uint32_t msg_size; /**< bytes per message */
+  uint32_t stride; /**< bytes per buffer, msg_size rounded up to a word */
+  uint8_t *buffers; /**< depth word-aligned buffers in the kernel stack arena */
+  uint32_t free_map; /**< buffer i is free if bit 31 - i is set */
+  uint8_t ring[MQUEUE_DEPTH_MAX]; /**< buffer of each queued message, from head */
+  uint8_t owner[MQUEUE_DEPTH_MAX]; /**< thread id holding each buffer, MQ_NO_OWNER */
+  wait_queue_t senders; /**< threads waiting for a free buffer */
+  wait_queue_t receivers; /**< threads waiting for a message */
+} kmqueue_t;
+
+/**
+ * @brief      Creates a message queue and its buffers.
+ *
+ * @param[in]  msg_size  Bytes per message, at most 64K.
+ * @param[in]  depth     Buffers, 1 to MQUEUE_DEPTH_MAX.
+ *
+ * @return     The queue, NULL if MQUEUE_CAPACITY would be exceeded, the
+ *             sizes are invalid or the buffers do not fit
+ */
+kmqueue_t *sys_mq_init( uint32_t msg_size, uint32_t depth );
+
+/**
+ * @brief      Copies a message into the queue, waiting for a free buffer if
+ *             every one is in use.
+ *
+ * @param[in]  mq       The queue.
+ * @param[in]  msg      msg_size bytes to send.
+ * @param[in]  timeout  Ticks to wait at most, 0 to not wait, WAIT_FOREVER.
+ *
+ * @return     0 once queued, -1 on timeout, a bad queue or a msg the
+ *             caller cannot read
+ */
+int sys_mq_send( kmqueue_t *mq, const void *msg, uint32_t timeout );
+
+/**
+ * @brief      Copies the oldest message out of the queue, waiting for one if
+ *             it is empty.
+ *
+ * @param[in]  mq       The queue.
+ * @param[out] msg      Where to store msg_size bytes.
+ * @param[in]  timeout  Ticks to wait at most, 0 to not wait, WAIT_FOREVER.
+ *
+ * @return     0 once received, -1 on timeout, a bad queue or a msg the
+ *             caller cannot write
+ */
+int sys_mq_receive( kmqueue_t *mq, void *msg, uint32_t timeout );
+
+/**
+ * @brief      Takes a free buffer for the caller to fill, waiting for one if
+ *             every one is in use.
+ *
+ * @param[in]  mq       The queue.
+ * @param[in]  timeout  Ticks to wait at most, 0 to not wait, WAIT_FOREVER.
+ *
+ * @return     The buffer, NULL on timeout, a bad queue or under PER_THREAD
+ */
+void *sys_mq_alloc( kmqueue_t *mq, uint32_t timeout );
+
+/**
+ * @brief      Queues a buffer owned by the caller, handing it to the highest
+ *             priority receiver if one waits. Never blocks.
+ *
+ * @param[in]  mq   The queue.
+ * @param[in]  buf  A buffer from mq_alloc or mq_receive_buf.
+ *
+ * @return     0 on success, -1 if the caller does not own buf
+ */
+int sys_mq_send_buf( kmqueue_t *mq, void *buf );
+
+/**
+ * @brief      Takes the oldest queued buffer, waiting for one if the queue
+ *             is empty. The caller owns it until mq_free or mq_send_buf.
+ *
+ * @param[in]  mq       The queue.
+ * @param[in]  timeout  Ticks to wait at most, 0 to not wait, WAIT_FOREVER.
+ *
+ * @return     The buffer, NULL on timeout, a bad queue or under PER_THREAD
+ */
+void *sys_mq_receive_buf( kmqueue_t *mq, uint32_t timeout );
+
+/**
+ * @brief      Returns a buffer owned by the caller, handing it to the
+ *             highest priority thread waiting for one.
+ *
+ * @param[in]  mq   The queue.
+ * @param[in]  buf  A buffer from mq_alloc or mq_receive_buf.
+ *
+ * @return     0 on success, -1 if the caller does not own buf
+ */
+int sys_mq_free( kmqueue_t *mq, void *buf );
+
+#endif /* _SYSCALL_MQUEUE_H_ */
@@ -11,15 +11,61 @@
 #define _SYSCALL_MUTEX_H_
 
 #include <unistd.h>
+#include "kconfig.h"
+
+struct tcb_t;
 
 /**
- * @brief      The struct for a mutex.
+ * @brief      Threads blocked on a kernel object, linked through their TCBs
+ *             in priority order, first come first among equals. The next
+ *             owner is the head and any waiter leaves in constant time.
+ */
+typedef struct {
+  struct tcb_t *head; /**< highest priority waiter, NULL if none */
+  struct tcb_t *tail; /**< lowest priority waiter, the last queued among equals */
+} wait_queue_t;
+
+/** @brief lock word of a user mutex: 0 if free, otherwise the holder's id + 1 */
+//@{
+#define UMUTEX_OWNER  0xFF      /**< the holder's id + 1 */
+#define UMUTEX_KERNEL (1U << 31) /**< the kernel mutex is locked too, unlocking must trap */
+//@}
+
+/** @brief bit of user mutex i in a thread's held map */
+#define UMUTEX_BIT(i) ((1U << 31) >> (i))
+
+/** @brief blocking time histogram buckets: 0, 1, 2-3, 4-7, ... ticks, the last one open ended */
+#define MUTEX_HIST_BUCKETS 8
+
+/**
+ * @brief      Lock statistics of a mutex, kept since it was initialized.
+ *             A lock's blocking time runs from the lock call to the grant.
  */
 typedef struct {
+  uint32_t locks;     /**< lock calls that got the mutex */
+  uint32_t blocked;   /**< the part of locks that had to wait */
+  uint32_t max_block; /**< longest blocking time, in ticks */
+  uint32_t hist[MUTEX_HIST_BUCKETS]; /**< locks by blocking time, bucket b > 0 holding 2^(b-1) to 2^b - 1 ticks */
+} mutex_stats_t;
+
+/**
+ * @brief      The struct for a mutex.
+ */
+typedef struct kmutex {
   volatile uint8_t id;
   volatile int locked_by;
   volatile uint32_t prio_ceil;
-  volatile uint32_t pending; /** @brief vector of threads pending to use mutex */
+  wait_queue_t waiters; /** @brief threads blocked until this mutex is unlocked */
+  struct kmutex *held_next; /** @brief mutex the holder locked before this one, NULL at the bottom */
+  struct kmutex *held_prev; /** @brief mutex the holder locked after this one, NULL at the top */
+  uint32_t held_ceil; /** @brief lowest ceiling of this and every mutex below it on the holder's stack */
+  struct kmutex *ceil_next; /** @brief next locked mutex with the same ceiling */
+  struct kmutex *ceil_prev; /** @brief previous locked mutex with the same ceiling */
+  volatile uint32_t locked_at; /** @brief tick the current holder got the lock */
+  volatile uint32_t max_hold; /** @brief longest hold seen, in ticks */
+  volatile uint32_t low_holder; /** @brief lowest static priority that has held it */
+  mutex_stats_t stats; /** @brief lock counts and blocking times */
+  volatile uint32_t *uword; /** @brief lock word in user memory of a user mutex, NULL otherwise */
 } kmutex_t;
 
 /**
@@ -41,15 +87,75 @@ kmutex_t *sys_mutex_init( uint32_t max_prio );
  *             This function will not return until the current thread has
  *             obtained the mutex.
  *
- * @param[in]  mutex  The mutex to act on.
+ * @param[in]  mutex  The mutex to act on. A thread passing anything but a
+ *                    mutex from sys_mutex_init is killed.
  */
 void sys_mutex_lock( kmutex_t *mutex );
 
 /**
  * @brief      Unlock a mutex
  *
- * @param[in]  mutex  The mutex to act on.
+ * @param[in]  mutex  The mutex to act on. Anything but a mutex from
+ *                    sys_mutex_init is ignored.
  */
 void sys_mutex_unlock( kmutex_t *mutex );
 
+/**
+ * @brief      Copies out the lock statistics of a mutex.
+ *
+ * @param[in]  mutex  The mutex to report on.
+ * @param[out] stats  Where to store the statistics.
+ *
+ * @return     0 on success or -1 if mutex is not an initialized mutex or
+ *             stats is not writable user memory
+ */
+int sys_mutex_stats( kmutex_t *mutex, mutex_stats_t *stats );
+
+/**
+ * @brief      Creates a user mutex, a mutex whose lock word lives in user
+ *             memory. A thread takes a free one and gives it back with an
+ *             exclusive store on the word, and only traps into
+ *             sys_umutex_lock or sys_umutex_unlock if the word is not as
+ *             expected. The kernel mutex backing it counts toward
+ *             max_mutexes.
+ *
+ *             The priority ceiling is applied lazily. A thread that locked
+ *             a user mutex without trapping runs at its own priority until
+ *             it is about to lose the CPU. At that point the kernel locks the
+ *             mutex for it, which raises it to the ceiling and sets
+ *             UMUTEX_KERNEL so the unlock traps. To find the mutexes without
+ *             a search, each thread keeps a held map on the user heap,
+ *             published in the time page: it sets the mutex's bit before
+ *             it locks and clears it after it unlocks.
+ *
+ * @param      word      The lock word.
+ * @param      max_prio  The priority ceiling.
+ * @param[out] bit       Where to store the mutex's bit in the held maps.
+ *
+ * @return     The kernel mutex. NULL if max_mutexes or UMUTEX_CAPACITY
+ *             would be exceeded, the heap has no room for the held maps, or
+ *             word or bit is not writable user memory.
+ */
+kmutex_t *sys_umutex_init( volatile uint32_t *word, uint32_t max_prio, uint32_t *bit );
+
+/**
+ * @brief      Locks a user mutex whose word was not free, waiting like
+ *             sys_mutex_lock.
+ *
+ * @param[in]  mutex  The kernel mutex of the user mutex.
+ *
+ * @return     0 once locked, -1 if mutex is not a user mutex
+ */
+int sys_umutex_lock( kmutex_t *mutex );
+
+/**
+ * @brief      Unlocks a user mutex the kernel has locked too, handing it to
+ *             the highest priority waiter.
+ *
+ * @param[in]  mutex  The kernel mutex of the user mutex.
+ *
+ * @return     0 on success, -1 if mutex is not a user mutex
+ */
+int sys_umutex_unlock( kmutex_t *mutex );
+
 #endif /* _SYSCALL_MUTEX_H_ */
@@ -0,0 +1,132 @@
+/**
+ * @file   syscall_sync.h
+ *
+ * @brief  Counting semaphores and event flag groups. Waits block the
+ *         calling thread, highest priority first, with an optional timeout.
+ *         Posting never blocks and only touches the scheduler with
+ *         interrupts disabled, so kernel interrupt handlers may call
+ *         sys_sem_post and sys_event_set to wake threads directly, as the
+ *         UART receive interrupt does for a thread sleeping in read().
+ *
+ * @date   10/17/26
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#ifndef _SYSCALL_SYNC_H_
+#define _SYSCALL_SYNC_H_
+
+#include <unistd.h>
+#include "kconfig.h"
+#include "syscall_mutex.h"
+
+/** @brief timeout that never expires */
+#define WAIT_FOREVER 0xFFFFFFFF
+
+/** @brief event_wait modes, ANY or ALL optionally with CLEAR */
+//@{
+#define EVENT_ANY   0        /**< wake when any flag of the mask is set */
+#define EVENT_ALL   (1 << 0) /**< wake when every flag of the mask is set */
+#define EVENT_CLEAR (1 << 1) /**< clear the flags that woke the thread */
+//@}
+
+/**
+ * @brief      The struct for a counting semaphore.
+ */
+typedef struct {
+  uint8_t id;
+  volatile uint32_t count; /**< units available to sem_wait */
+  wait_queue_t waiters; /**< threads waiting for a unit */
+} ksem_t;
+
+/**
+ * @brief      The struct for a group of 32 event flags.
+ */
+typedef struct {
+  uint8_t id;
+  volatile uint32_t flags; /**< flags currently set */
+  wait_queue_t waiters; /**< threads waiting for flags */
+} kevent_t;
+
+/**
+ * @brief      Creates a semaphore.
+ *
+ * @param[in]  count  Units initially available.
+ *
+ * @return     The semaphore, NULL if SEM_CAPACITY would be exceeded
+ */
+ksem_t *sys_sem_init( uint32_t count );
+
+/**
+ * @brief      Takes a unit from a semaphore, waiting for one if none is
+ *             available.
+ *
+ * @param[in]  sem      The semaphore.
+ * @param[in]  timeout  Ticks to wait at most, 0 to not wait, WAIT_FOREVER.
+ *
+ * @return     0 once a unit was taken, -1 on timeout or a bad semaphore
+ */
+int sys_sem_wait( ksem_t *sem, uint32_t timeout );
+
+/**
+ * @brief      Returns a unit to a semaphore, handing it to the highest
+ *             priority waiter if there is one. Safe in interrupt handlers.
+ *
+ * @param[in]  sem  The semaphore.
+ *
+ * @return     0 on success, -1 on a bad semaphore
+ */
+int sys_sem_post( ksem_t *sem );
+
+/**
+ * @brief      Creates an event flag group with every flag clear.
+ *
+ * @return     The group, NULL if EVENT_CAPACITY would be exceeded
+ */
+kevent_t *sys_event_init( void );
+
+/**
+ * @brief      Waits for flags of a group to be set.
+ *
+ * @param[in]  event    The group.
+ * @param[in]  mask     Flags to wait for.
+ * @param[in]  mode     EVENT_ANY or EVENT_ALL, optionally | EVENT_CLEAR.
+ * @param[in]  timeout  Ticks to wait at most, 0 to not wait, WAIT_FOREVER.
+ *
+ * @return     The flags of mask that were set, 0 on timeout or a bad group
+ */
+uint32_t sys_event_wait( kevent_t *event, uint32_t mask, uint32_t mode, uint32_t timeout );
+
+/**
+ * @brief      Sets flags of a group, waking every waiter they satisfy in
+ *             priority order. Safe in interrupt handlers.
+ *
+ * @param[in]  event  The group.
+ * @param[in]  flags  Flags to set.
+ *
+ * @return     0 on success, -1 on a bad group
+ */
+int sys_event_set( kevent_t *event, uint32_t flags );
+
+/**
+ * @brief      Clears flags of a group.
+ *
+ * @param[in]  event  The group.
+ * @param[in]  flags  Flags to clear.
+ *
+ * @return     0 on success, -1 on a bad group
+ */
+int sys_event_clear( kevent_t *event, uint32_t flags );
+
+/**
+ * @brief      Wakes a thread sleeping in sys_read, once a received byte is
+ *             waiting. Safe in interrupt handlers.
+ */
+void uart_rx_post( void );
+
+/**
+ * @brief      Sleeps until uart_rx_post. Main and idle return at once.
+ */
+void uart_rx_wait( void );
+
+#endif /* _SYSCALL_SYNC_H_ */
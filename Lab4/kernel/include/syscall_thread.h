@@ -15,9 +15,11 @@
 /**
  * @enum protection_mode
  *
- * @brief      Enums for protection mode, PER_THREAD and KERNEL_ONLY.
+ * @brief      Enums for protection mode, PER_THREAD and KERNEL_ONLY. Option
+ *             flags such as TICKLESS may be OR'd in.
  */
-typedef enum { PER_THREAD = 1, KERNEL_ONLY = 0 } protection_mode;
+typedef enum { PER_THREAD = 1, KERNEL_ONLY = 0, TICKLESS = 1 << 1,
+               SCHED_EDF = 1 << 2 } protection_mode;
 
 /**
  * @enum thread_state
@@ -26,12 +28,42 @@ typedef enum { PER_THREAD = 1, KERNEL_ONLY = 0 } protection_mode;
 typedef enum { RUNNING = 0, RUNNABLE = 1, WAITING = 2, INACTIVE = 3, 
               BLOCKED = 4} thread_state;
 
+/**
+ * @brief      Per-thread timing statistics, kept by the kernel since the
+ *             thread was created. Latency is the delay from a job's release
+ *             to its first instruction, so max_latency - min_latency is the
+ *             release jitter.
+ */
+typedef struct {
+  uint32_t jobs;            /**< jobs that finished by waiting for the next period */
+  uint32_t deadline_misses; /**< jobs still unfinished when the next one was released, overruns among them */
+  uint32_t overruns;        /**< jobs stopped for using up their budget C */
+  uint32_t wcrt;            /**< worst observed release to completion time, in ticks */
+  uint32_t min_latency;     /**< least release to first run delay, in ticks */
+  uint32_t max_latency;     /**< most release to first run delay, in ticks */
+} thread_stats_t;
+
+/**
+ * @brief      Stack use of a thread. Its stacks are painted with a pattern
+ *             when it is created, and the peak is how far down the pattern
+ *             has been overwritten, so it covers the thread's whole life.
+ */
+typedef struct {
+  uint32_t user_size;   /**< bytes of the user stack above its guard */
+  uint32_t user_peak;   /**< most bytes of the user stack used */
+  uint32_t kernel_size; /**< bytes of the kernel stack above its guard */
+  uint32_t kernel_peak; /**< most bytes of the kernel stack used, by syscalls and interrupts */
+} stack_usage_t;
+
 /** @enum exc_return
  * @brief possible return codes
  */
 typedef enum {MSP_HANDLER = 0xFFFFFFF1, MSP_THREAD = 0xFFFFFFF9, 
               PSP_THREAD = 0xFFFFFFFD} exc_return;
 
+/** @brief EXC_RETURN bit that is clear when the exception frame holds FPU state */
+#define EXC_RETURN_BASIC_FRAME (1 << 4)
+
 /**
  * @brief      The SysTick interrupt handler.
  */
@@ -42,6 +74,13 @@ void systick_c_handler( void );
  */
 void *pendsv_c_handler(void *curr_msp);
 
+/**
+ * @brief      Checked on PendSV entry, before the context is saved.
+ *
+ * @return     0 if the running thread stays, so the switch can be skipped.
+ */
+int pendsv_switch_needed( void );
+
 /**
  * @brief      Initialize the thread library
  *
@@ -51,13 +90,19 @@ void *pendsv_c_handler(void *curr_msp);
  * @param[in]  max_threads        Maximum number of threads that will be
  *                                created.
  * @param[in]  stack_size         Declares the size in words of all user and
- *                                kernel stacks created.
+ *                                kernel stacks created. Each is rounded up
+ *                                to MPU subregions, an eighth of a power of
+ *                                two and at least 32B, with one more
+ *                                subregion below it as its guard.
  * @param[in]  idle_fn            Pointer to a thread function to run when no
  *                                other threads are runnable. If NULL is
  *                                is supplied, the kernel will provide its
  *                                own idle function that will sleep.
  * @param[in]  memory_protection  Enum for memory protection, either
- *                                PER_THREAD or KERNEL_ONLY
+ *                                PER_THREAD or KERNEL_ONLY, optionally
+ *                                OR'd with TICKLESS to stop the tick while
+ *                                only the idle thread can run, and with
+ *                                SCHED_EDF to schedule by earliest deadline.
  * @param[in]  max_mutexes        Maximum number of mutexes that will be
  *                                created.
  *
@@ -73,7 +118,8 @@ int sys_thread_init(
 
 /**
  * @brief      Create a new thread running the given function. The thread will
- *             not be created if the UB test fails, and in that case this function
+ *             not be created if the admission test fails (response-time
+ *             analysis, or U <= 1 under EDF), and in that case this function
  *             will return an error.
  *
  * @param[in]  fn     Pointer to the function to run in the new thread.
@@ -128,6 +174,101 @@ uint32_t sys_thread_time( void );
  */
 void sys_wait_until_next_period( void );
 
+/**
+ * @brief      Blocks the calling thread for a number of ticks.
+ *
+ * @param[in]  ticks  Ticks to sleep, 0 returns at once.
+ *
+ * @return     0 once woken, -1 if called from main or the idle thread
+ */
+int sys_sleep_ticks( uint32_t ticks );
+
+/**
+ * @brief      Blocks the calling thread until an absolute tick.
+ *
+ * @param[in]  tick   Value of sys_get_time() to wake at. A tick already
+ *                    reached returns at once.
+ *
+ * @return     0 once woken, -1 if called from main or the idle thread
+ */
+int sys_sleep_until( uint32_t tick );
+
+/**
+ * @brief      Copies out the timing statistics of a thread.
+ *
+ * @param[in]  prio   Static priority the thread was created with. A live
+ *                    thread is preferred over a killed one.
+ * @param[out] stats  Where to store the statistics.
+ *
+ * @return     0 on success or -1 if no thread has that priority, or
+ *             stats is not writable user memory
+ */
+int sys_thread_stats( uint32_t prio, thread_stats_t *stats );
+
+/**
+ * @brief      Copies out the peak stack use of a thread, scanning its
+ *             stacks for the lowest word no longer holding the paint.
+ *
+ * @param[in]  prio   Static priority the thread was created with. A live
+ *                    thread is preferred over a killed one.
+ * @param[out] usage  Where to store the stack use.
+ *
+ * @return     0 on success or -1 if no thread has that priority, or
+ *             usage is not writable user memory
+ */
+int sys_thread_stack_usage( uint32_t prio, stack_usage_t *usage );
+
+/**
+ * @brief      Prints the statistics of every user thread over UART.
+ */
+void thread_stats_dump( void );
+
+/**
+ * @brief      Runs the work SysTick deferred to the idle thread, a stack
+ *             peak scan and the statistics dump. Only the idle thread may
+ *             call it.
+ *
+ * @return     0 on success or -1 if the caller is not the idle thread
+ */
+int sys_idle_work( void );
+
+/**
+ * @brief      Counters reported by cpu_cycles(), all in CPU cycles.
+ */
+typedef enum {
+  CPU_THREAD = 0, /**< run by the thread with the given priority, syscalls included */
+  CPU_THREAD_SVC, /**< the part of CPU_THREAD spent inside syscalls */
+  CPU_IDLE,       /**< run by the idle thread */
+  CPU_KERNEL,     /**< spent in the SysTick, PendSV and UART handlers */
+  CPU_TOTAL       /**< elapsed since the scheduler started */
+} cpu_counter_t;
+
+/**
+ * @brief      Reads a cycle counter, measured with the DWT cycle counter at
+ *             every context switch rather than sampled at SysTick.
+ *
+ * @param[in]  counter  Which counter to read.
+ * @param[in]  prio     Thread priority, for CPU_THREAD and CPU_THREAD_SVC.
+ *
+ * @return     The cycle count, 0 if no thread has that priority
+ */
+uint64_t sys_cpu_cycles( cpu_counter_t counter, uint32_t prio );
+
+/**
+ * @brief      Samples the running thread's cycle count at syscall entry.
+ *
+ * @return     Cycles the running thread has run so far
+ */
+uint64_t svc_account_begin( void );
+
+/**
+ * @brief      Bills the cycles since svc_account_begin() to the running
+ *             thread's syscall time.
+ *
+ * @param[in]  start  The value svc_account_begin() returned
+ */
+void svc_account_end( uint64_t start );
+
 /**
 * @brief      Kills current running thread. Aborts program if current thread is
 *             main thread or the idle thread or if current thread exited
@@ -138,4 +279,14 @@ void sys_wait_until_next_period( void );
 void sys_thread_kill( void );
 void threadFunc(void *fn, void *vargp);
 
+/**
+* @brief      Whether an address lies in a stack guard of the running thread,
+*             the subregion below its user or kernel stack.
+*
+* @param[in]  addr  The faulting address.
+*
+* @return     1 if the access overflowed a stack, 0 otherwise.
+*/
+int stack_guard_hit( uint32_t addr );
+
 #endif /* _SYSCALL_THREAD_H_ */
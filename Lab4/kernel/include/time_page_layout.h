@@ -0,0 +1,45 @@
+/**
+ * @file   time_page_layout.h
+ *
+ * @brief  Layout of the time page, the kernel state user code reads without
+ *         a system call, shared by the kernel, user_common/include/time_page.h
+ *         and the idle_work stub in svc_stubs.S. The page is 32 bytes, which
+ *         the MPU makes read-only to user mode. Every update is wrapped in
+ *         two increments of seq, so a reader that sees seq change, or odd,
+ *         reads again.
+ *
+ * @date   10/17/26
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#ifndef _TIME_PAGE_LAYOUT_H_
+#define _TIME_PAGE_LAYOUT_H_
+
+/** @brief byte offset of idle_work, for assembly */
+#define TIME_PAGE_IDLE_WORK 24
+
+#ifndef __ASSEMBLER__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief      The time page.
+ */
+typedef struct {
+  volatile uint32_t seq;          /**< odd while the kernel writes the page */
+  volatile uint32_t ticks;        /**< ticks since the scheduler started */
+  volatile uint32_t tickless;     /**< non-zero in a tickless sleep, when ticks lags the time */
+  volatile uint32_t thread_ticks; /**< thread_time() of the running thread */
+  volatile uint32_t prio;         /**< effective priority of the running thread */
+  volatile uint32_t running;      /**< id + 1 of the running thread, for umutex_lock */
+  volatile uint32_t idle_work;    /**< non-zero while the idle thread has deferred work to run */
+  volatile uint32_t *umutex_held; /**< per thread id, the bits of the umutexes it may hold */
+} time_page_t;
+
+_Static_assert( offsetof( time_page_t, idle_work ) == TIME_PAGE_IDLE_WORK, "TIME_PAGE_IDLE_WORK is stale" );
+
+#endif /* __ASSEMBLER__ */
+
+#endif /* _TIME_PAGE_LAYOUT_H_ */
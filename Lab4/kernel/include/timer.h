@@ -11,10 +11,19 @@
 #ifndef _TIMER_H_
 #define _TIMER_H_
 
+#include <unistd.h>
+
+/** @brief largest value the 24-bit systick reload register holds */
+#define TIMER_MAX_LOAD 0xFFFFFF
+
 void timer_enable();
 
 int timer_start(int frequency);
 
 void timer_disable();
 
+uint32_t timer_remaining();
+
+void timer_oneshot(int32_t adjust, uint32_t reload);
+
 #endif /* _TIMER_H_ */
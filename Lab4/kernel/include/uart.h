@@ -21,4 +21,6 @@ int uart_get_byte(char *c);
 
 void uart_flush();
 
+int uart_poll_command(char cmd);
+
 #endif /* _UART_H_ */
@@ -20,13 +20,19 @@
 //@}
 /* @brief Refister to enable/disable fpu */
 #define CPACR ((volatile uint32_t *) 0xE000ED88)
-/* @brief FPU control data */
+/* @brief FPU context control register and flags */
+//@{
 #define FPCCR ((volatile uint32_t *) 0xE000EF34)
+#define FPCCR_ASPEN (1U << 31)
+#define FPCCR_LSPEN (1 << 30)
+#define FPCCR_LSPACT 1
+//@}
 /* @brief Interrupt Control and State Register and flags */
 //@{
 #define ICSR ((volatile uint32_t *) 0xE000ED04)
 #define ICSR_PENDSVSET (1 << 28)
 #define ICSR_PENDSVCLR (1 << 27)
+#define ICSR_PENDSTSET (1 << 26)
 //@}
 /* @brief System handler priority register 1 */
 #define SHPR1 ((volatile uint32_t *) 0xE000ED18)
@@ -40,6 +46,16 @@
 #define SHCSR_USGFAULTENA (1 << 18)
 #define SHCSR_SVCALLACT (1 << 7)
 //@}
+/* @brief Debug exception and monitor control register and flags */
+//@{
+#define DEMCR ((volatile uint32_t *) 0xE000EDFC)
+#define DEMCR_TRCENA (1 << 24)
+//@}
+/* @brief DWT control register and flags */
+//@{
+#define DWT_CTRL ((volatile uint32_t *) 0xE0001000)
+#define DWT_CTRL_CYCCNTENA 1
+//@}
 
 /**
  * @brief      Disables stack alignement.
@@ -62,9 +78,9 @@ void init_349( void ){
   *SHPR3 |= 0x10100000;
   *SHPR3 &= 0x1010FFFF;
   
-  // Set mmfault priority to 1
-  *SHPR1 |= 0x00000010;
-  *SHPR1 &= 0xFFFFFF10;
+  // Set mmfault priority to 0, above SysTick and PendSV, so a stack
+  // overflow in either is taken as a MemManage fault, not a HardFault
+  *SHPR1 &= 0xFFFFFF00;
   
 
   data_sync_barrier();
@@ -72,15 +88,56 @@ void init_349( void ){
 }
 
 /**
- * @brief      Enables the fpu.
+ * @brief      Enables the fpu, with automatic and lazy stacking of s0-s15 on
+ *             exception entry from code that has used it.
  */
 void enable_fpu( void ){
   *CPACR |= (0xF << 20);
-  *FPCCR |= (0x1 << 31);
+  *FPCCR |= FPCCR_ASPEN | FPCCR_LSPEN;
   data_sync_barrier();
   instruction_sync_barrier();
 }
 
+/**
+ * @brief      Drops a pending lazy save of s0-s15, so that it is never
+ *             written into the stack of a thread that has been killed.
+ */
+void fpu_discard_lazy_state( void ){
+  *FPCCR &= ~FPCCR_LSPACT;
+}
+
+/**
+ * @brief      Starts the DWT cycle counter from 0.
+ */
+void enable_cycle_counter( void ){
+  *DEMCR |= DEMCR_TRCENA;
+  *DWT_CYCCNT = 0;
+  *DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+volatile uint64_t irq_cycles;
+
+/** @brief handler nesting depth, only the outermost one is timed */
+static volatile uint32_t irq_depth;
+
+/** @brief CYCCNT when the outermost handler was entered */
+static volatile uint32_t irq_start;
+
+/**
+ * @brief      Marks entry to an interrupt handler whose time should not be
+ *             billed to the interrupted thread.
+ */
+void irq_enter( void ){
+  if (irq_depth++ == 0) irq_start = read_cycle_counter();
+}
+
+/**
+ * @brief      Marks exit from an accounted interrupt handler.
+ */
+void irq_exit( void ){
+  if (--irq_depth == 0) irq_cycles += read_cycle_counter() - irq_start;
+}
+
 /**
  * @brief      Pends a pendsv.
  */
@@ -95,6 +152,16 @@ void clear_pendsv( void ){
   *ICSR |= ICSR_PENDSVCLR;
 }
 
+/**
+ * @brief      Checks whether a SysTick exception is waiting to be taken.
+ *
+ * @return     1 if pending, 0 otherwise
+ */
+int systick_pending( void ){
+  if (*ICSR & ICSR_PENDSTSET) return 1;
+  else return 0;
+}
+
 /**
  * @brief      Check if SVC is active/inactive.
  *
@@ -28,6 +28,8 @@ void protect_memory();
  */
 int kernel_main( void ) {
     init_349(); // DO NOT REMOVE THIS LINE
+    enable_fpu();
+    enable_cycle_counter();
     i2c_master_init(0x50);
     led_driver_init(0);
     uart_init(0);
@@ -59,13 +61,20 @@ void protect_memory(){
     if( (status= mm_region_enable(3, &_u_bss, mm_log2ceil_size(1024), 0, 1)) < 0)
         breakpoint();
 
-    //4KB of user heap
+    //4KB of user heap and the 2KB of default thread stack space after it,
+    //an 8KB region less the 2KB main stack that ends it
     extern char __heap_low;
-    if( (status= mm_region_enable(4, &__heap_low, mm_log2ceil_size(4096), 0, 1)) < 0)
+    mm_region_t heap;
+    if( (status= mm_region_encode(&heap, 4, &__heap_low, mm_log2ceil_size(8192), 0, 1)) < 0 ||
+        (status= mm_region_disable_subregions(&heap, 0xC0)) < 0)
         breakpoint();
-        
-    //2KB of default thread stack space 
-    extern char __psp_stack_bottom;
-    if( (status= mm_region_enable(5, &__psp_stack_bottom, mm_log2ceil_size(2048), 0, 1)) < 0)
+    mm_region_load(&heap, 1);
+
+    //Regions 5 and 6 are the running thread's stacks and their guards,
+    //loaded on every context switch
+
+    //32B time page the kernel writes and user code reads in place of syscalls
+    extern char _time_page;
+    if( (status= mm_region_enable(7, &_time_page, mm_log2ceil_size(32), 0, 0)) < 0)
         breakpoint();
 }
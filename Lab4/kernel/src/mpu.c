@@ -84,6 +84,12 @@ typedef struct {
 #define RBAR_REGION ( 0xF )
 //@}
 
+/** @brief RBAR bits below the smallest region's base address. */
+#define RBAR_REGION_MASK ( 0x1F )
+
+/** @brief Smallest region, and so the step of mm_user_range. */
+#define MM_USER_CHUNK 32
+
 /** @brief MPU RASR register masks. */
 //@{
 #define RASR_XN ( 1<<28 )
@@ -93,10 +99,18 @@ typedef struct {
 #define RASR_ENABLE ( 1<<0 )
 //@}
 
+/** @brief MPU RASR subregion disable field, bit i disables the i-th eighth from the base. */
+#define RASR_SRD_SHIFT 8
+
+/** @brief Largest region, the whole 4GB address space. */
+#define REGION_SIZE_LOG2_MAX 32
+
 /** @brief MPU RASR AP user mode encoding. */
 //@{
+#define RASR_AP_NO_ACCESS ( 0b00<<24 )
 #define RASR_AP_USER_READ_ONLY ( 0b10<<24 )
 #define RASR_AP_USER_READ_WRITE ( 0b11<<24 )
+#define RASR_AP_MASK ( 0b111<<24 )
 //@}
 
 /**@brief Systen control block MMIO location.*/
@@ -106,6 +120,10 @@ typedef struct {
 #define MEMFAULTPENDED (1<<13)
 /**@brief Memory fault acrtive (R/W).*/
 #define MEMFAULTACT    1
+/**@brief SysTick handler active (R/W).*/
+#define SYSTICKACT     (1<<11)
+/**@brief PendSV handler active (R/W).*/
+#define PENDSVACT      (1<<10)
 
 
 /**@brief Stacking error.*/
@@ -149,13 +167,19 @@ void mm_c_handler( void *psp ) {
   WARN( !( status & IACCVIOL ), "Instruction access violation\n" );
   WARN( !( status & MMARVALID ), "Faulting Address = %x\n", scb->MMFAR );
 
-  // You cannot recover from stack overflow because the processor has
-  // already pushed the exception context onto the stack, potentially
-  // clobbering whatever is in the adjacent stack.
-  //REMEMBER the stack grows downwards!! 
-  extern char __thread_u_stacks_low; 
-  if ((uint32_t)(scb->MMFAR) <= (uint32_t)(&__thread_u_stacks_low)) {
-    DEBUG_PRINT( "Stack Overflow, aborting\n" );
+  // A guard subregion sits below every stack, so an overflow faults
+  // before it clobbers the adjacent stack and only the offending thread
+  // dies. A stacking error leaves no address, the stack pointer itself
+  // ran into the guard.
+  if ( ( status & MSTKERR ) || ( ( status & MMARVALID ) && stack_guard_hit( scb->MMFAR ) ) ) {
+    DEBUG_PRINT( "Stack Overflow, killing thread\n" );
+  }
+
+  // A kernel stack that overflowed in SysTick or PendSV cannot be left,
+  // the switch away from the thread would be preempting itself. This
+  // handler outranks both, so it sees them active
+  if ( scb->SHCRS & ( SYSTICKACT | PENDSVACT ) ) {
+    DEBUG_PRINT( "Fault in the scheduler, aborting\n" );
     sys_exit( -1 );
   }
 
@@ -174,31 +198,32 @@ void mm_c_handler( void *psp ) {
 }
 
 /**
- * @brief  Enables a memory protection region. Regions must be aligned!
+ * @brief  Encodes a region with the given access permission bits.
  *
+ * @param  region             Where to store the register values.
  * @param  region_number      The region number to enable.
  * @param  base_address       The region's base (starting) address.
- * @param  size_log2          log[2] of the region size.
- * @param  execute            1 if the region should be executable by the user.
- *                            0 otherwise.
- * @param  user_write_access  1 if the user should have write access, 0 if
- *                            read-only
+ * @param  size_log2          log[2] of the region size, up to 32.
+ * @param  ap                 RASR_AP_* access permissions.
+ * @param  xn                 RASR_XN if the region may not be executed, 0 otherwise.
  *
  * @return 0 on success, -1 on failure
  */
-int mm_region_enable(
+static int region_encode(
+  mm_region_t *region,
   uint32_t region_number,
   void *base_address,
   uint8_t size_log2,
-  int execute,
-  int user_write_access
+  uint32_t ap,
+  uint32_t xn
 ){
   if (region_number > REGION_NUMBER_MAX) {
     printk("Invalid region number\n");
     return -1;
   }
 
-  if ((uint32_t)base_address & ((1 << size_log2) - 1)) {
+  if (size_log2 > REGION_SIZE_LOG2_MAX ||
+      (size_log2 < REGION_SIZE_LOG2_MAX && ((uint32_t)base_address & ((1U << size_log2) - 1)))) {
     printk("Misaligned region\n");
     return -1;
   }
@@ -208,17 +233,172 @@ int mm_region_enable(
     return -1;
   }
 
-  mpu_t *mpu = MPU_BASE;
+  uint32_t size = ((size_log2 - 1) << 1) & RASR_SIZE;
 
-  mpu->RNR = region_number & RNR_REGION;
-  mpu->RBAR = (uint32_t)base_address;
+  region->rbar = (uint32_t)base_address | RBAR_VALID | (region_number & RBAR_REGION);
+  region->rasr = size | ap | xn | RASR_ENABLE;
+  return 0;
+}
 
-  uint32_t size = ((size_log2 - 1) << 1) & RASR_SIZE;
+/**
+ * @brief  Encodes a memory protection region. Regions must be aligned!
+ *
+ * @param  region             Where to store the register values.
+ * @param  region_number      The region number to enable.
+ * @param  base_address       The region's base (starting) address.
+ * @param  size_log2          log[2] of the region size, 32 for the whole
+ *                            address space.
+ * @param  execute            1 if the region should be executable by the user.
+ *                            0 otherwise.
+ * @param  user_write_access  1 if the user should have write access, 0 if
+ *                            read-only
+ *
+ * @return 0 on success, -1 on failure
+ */
+int mm_region_encode(
+  mm_region_t *region,
+  uint32_t region_number,
+  void *base_address,
+  uint8_t size_log2,
+  int execute,
+  int user_write_access
+){
   uint32_t ap = user_write_access ? RASR_AP_USER_READ_WRITE : RASR_AP_USER_READ_ONLY;
   uint32_t xn = execute ? 0 : RASR_XN;
 
-  mpu->RASR |= size | ap | xn | RASR_ENABLE;
+  return region_encode(region, region_number, base_address, size_log2, ap, xn);
+}
+
+/**
+ * @brief  Encodes a stack guard. The region is the aligned block holding the
+ *         guard, with only the guard's subregion enabled and no access for
+ *         the kernel either, so the guard costs one subregion below the
+ *         stack and no other region. Accesses to the rest of the block fall
+ *         through to the lower numbered regions.
+ *
+ * @param  region             Where to store the register values.
+ * @param  region_number      The region number to enable.
+ * @param  guard_address      The guard's lowest address, aligned to a
+ *                            subregion.
+ * @param  size_log2          log[2] of the block size, at least
+ *                            MM_SUBREGION_MIN_LOG2.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int mm_guard_encode(
+  mm_region_t *region,
+  uint32_t region_number,
+  void *guard_address,
+  uint8_t size_log2
+){
+  if (size_log2 < MM_SUBREGION_MIN_LOG2) {
+    printk("Region too small for subregions\n");
+    return -1;
+  }
+
+  uint32_t block = (uint32_t)guard_address & ~((1U << size_log2) - 1);
+  uint32_t subregion_log2 = size_log2 - MM_SUBREGIONS_LOG2;
+  uint32_t offset = (uint32_t)guard_address - block;
+
+  if (offset & ((1U << subregion_log2) - 1)) {
+    printk("Misaligned subregion\n");
+    return -1;
+  }
+
+  if (region_encode(region, region_number, (void *)block, size_log2, RASR_AP_NO_ACCESS, RASR_XN) < 0) return -1;
+  return mm_region_disable_subregions(region, (uint8_t)~(1U << (offset >> subregion_log2)));
+}
+
+/**
+ * @brief  Returns log[2] of the size of an encoded region.
+ *
+ * @param  region             The encoded region.
+ *
+ * @return log[2] of the size, 0 if the region is encoded off
+ */
+uint8_t mm_region_size_log2( const mm_region_t *region ){
+  if (!(region->rasr & RASR_ENABLE)) return 0;
+  return ((region->rasr & RASR_SIZE) >> 1) + 1;
+}
+
+/**
+ * @brief  Encodes a region number left disabled. Loading it clears whatever
+ *         the region held before.
+ *
+ * @param  region             Where to store the register values.
+ * @param  region_number      The region number to disable.
+ */
+void mm_region_encode_off( mm_region_t *region, uint32_t region_number ){
+  region->rbar = RBAR_VALID | (region_number & RBAR_REGION);
+  region->rasr = 0;
+}
+
+/**
+ * @brief  Disables subregions of an encoded region. An access to a disabled
+ *         subregion is decided by the lower numbered regions, or the
+ *         background region if none matches.
+ *
+ * @param  region             The encoded region, at least 256B.
+ * @param  srd                Subregions to disable, bit i the i-th eighth
+ *                            from the base.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int mm_region_disable_subregions( mm_region_t *region, uint8_t srd ){
+  uint32_t size_log2 = ((region->rasr & RASR_SIZE) >> 1) + 1;
+
+  if (size_log2 < MM_SUBREGION_MIN_LOG2) {
+    printk("Region too small for subregions\n");
+    return -1;
+  }
+
+  region->rasr |= (uint32_t)srd << RASR_SRD_SHIFT;
+  return 0;
+}
+
+/**
+ * @brief  Programs encoded regions. RBAR with VALID set selects the region
+ *         itself, so the RBAR/RASR pair and its three aliases, which are
+ *         consecutive words, take up to 4 regions as one run of stores.
+ *         RASR is written whole, so nothing of the old region remains.
+ *
+ * @param  regions   The encoded regions.
+ * @param  count     How many, at most 4.
+ */
+void mm_region_load( const mm_region_t *regions, uint32_t count ){
+  mpu_t *mpu = MPU_BASE;
+  volatile uint32_t *pair = &mpu->RBAR;
+
+  for (uint32_t i = 0; i < count; i++){
+    pair[2 * i] = regions[i].rbar;
+    pair[2 * i + 1] = regions[i].rasr;
+  }
+}
+
+/**
+ * @brief  Enables a memory protection region. Regions must be aligned!
+ *
+ * @param  region_number      The region number to enable.
+ * @param  base_address       The region's base (starting) address.
+ * @param  size_log2          log[2] of the region size.
+ * @param  execute            1 if the region should be executable by the user.
+ *                            0 otherwise.
+ * @param  user_write_access  1 if the user should have write access, 0 if
+ *                            read-only
+ *
+ * @return 0 on success, -1 on failure
+ */
+int mm_region_enable(
+  uint32_t region_number,
+  void *base_address,
+  uint8_t size_log2,
+  int execute,
+  int user_write_access
+){
+  mm_region_t region;
 
+  if (mm_region_encode(&region, region_number, base_address, size_log2, execute, user_write_access) < 0) return -1;
+  mm_region_load(&region, 1);
   return 0;
 }
 
@@ -233,6 +413,73 @@ void mm_region_disable( uint32_t region_number ){
   mpu->RASR &= ~RASR_ENABLE;
 }
 
+/**
+ * @brief  Whether user code may access one address, decided as the MPU
+ *         would: the highest numbered enabled region covering it, outside
+ *         its disabled subregions, or the background region, which user
+ *         code may not use. Interrupts stay off while RNR selects each
+ *         region, as a context switch reloads the regions through RBAR.
+ *
+ * @param  addr   The address.
+ * @param  write  1 to ask for write access, 0 for read.
+ *
+ * @return 1 if allowed, 0 otherwise
+ */
+static int user_access(uint32_t addr, int write){
+  mpu_t *mpu = MPU_BASE;
+  int allowed = 0;
+  int state = save_interrupt_state_and_disable();
+
+  for (int r = REGION_NUMBER_MAX; r >= 0; r--){
+    mpu->RNR = r;
+    uint32_t rasr = mpu->RASR;
+    if (!(rasr & RASR_ENABLE)) continue;
+
+    uint32_t size_log2 = ((rasr & RASR_SIZE) >> 1) + 1;
+    uint32_t offset = addr - (mpu->RBAR & ~RBAR_REGION_MASK);
+    if (size_log2 < REGION_SIZE_LOG2_MAX && (offset >> size_log2)) continue;
+    if (size_log2 >= MM_SUBREGION_MIN_LOG2 &&
+        (rasr >> (RASR_SRD_SHIFT + (offset >> (size_log2 - MM_SUBREGIONS_LOG2)))) & 1) continue;
+
+    uint32_t ap = rasr & RASR_AP_MASK;
+    allowed = write ? ap == RASR_AP_USER_READ_WRITE
+                    : (ap == RASR_AP_USER_READ_WRITE || ap == RASR_AP_USER_READ_ONLY);
+    break;
+  }
+
+  restore_interrupt_state(state);
+  return allowed;
+}
+
+/**
+ * @brief  Checks a buffer a syscall was handed against the caller's MPU
+ *         regions, which are loaded while it runs, so under PER_THREAD
+ *         another thread's stack is refused as user code would be. One
+ *         address per 32 bytes is enough, no region or subregion is
+ *         smaller. With the MPU off user code may access everything.
+ *
+ * @param  ptr    Start of the buffer.
+ * @param  len    Its length in bytes.
+ * @param  write  1 if the kernel will write it, 0 if it only reads it.
+ *
+ * @return 1 if user code could make every access itself, 0 otherwise
+ */
+int mm_user_range( const void *ptr, uint32_t len, int write ){
+  mpu_t *mpu = MPU_BASE;
+  uint32_t addr = (uint32_t)ptr;
+  uint32_t end = addr + len;
+
+  if (end < addr) return 0;
+  if (!(mpu->CTRL & CTRL_ENABLE_PROTECTION)) return 1;
+
+  for (; addr < end; addr = (addr | (MM_USER_CHUNK - 1)) + 1){
+    if (!user_access(addr, write)) return 0;
+    //The last chunk ends the address space, addr would wrap to 0
+    if ((addr | (MM_USER_CHUNK - 1)) == UINT32_MAX) break;
+  }
+  return 1;
+}
+
 /**
  * @brief  Returns ceiling (log_2 n).
  */
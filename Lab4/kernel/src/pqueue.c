@@ -0,0 +1,157 @@
+/**
+ * @file   pqueue.c
+ *
+ * @brief  Binary min-heap of intrusive nodes. Insert, remove, rekey and pop
+ *         are O(log n), peek is O(1). Callers provide the storage and any
+ *         locking.
+ *
+ * @date   10/17/26
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <stdint.h>
+#include "pqueue.h"
+
+/**
+ * @brief  whether node a orders before node b
+ */
+static int pq_less( pq_node_t *a, pq_node_t *b ){
+  if (a->key != b->key) return TICK_BEFORE(a->key, b->key);
+  return a->tie < b->tie;
+}
+
+/**
+ * @brief  stores a node at a heap index and records the index in the node
+ */
+static void pq_place( pq_t *pq, uint32_t i, pq_node_t *node ){
+  pq->nodes[i] = node;
+  node->pos = i;
+}
+
+/**
+ * @brief  moves the node at index i towards the root until ordered
+ */
+static void pq_sift_up( pq_t *pq, uint32_t i ){
+  pq_node_t *node = pq->nodes[i];
+
+  while (i > 0){
+    uint32_t parent = (i - 1) / 2;
+    if (!pq_less(node, pq->nodes[parent])) break;
+    pq_place(pq, i, pq->nodes[parent]);
+    i = parent;
+  }
+  pq_place(pq, i, node);
+}
+
+/**
+ * @brief  moves the node at index i towards the leaves until ordered
+ */
+static void pq_sift_down( pq_t *pq, uint32_t i ){
+  pq_node_t *node = pq->nodes[i];
+
+  while (1){
+    uint32_t child = 2 * i + 1;
+    if (child >= pq->size) break;
+    if (child + 1 < pq->size && pq_less(pq->nodes[child + 1], pq->nodes[child]))
+      child++;
+    if (!pq_less(pq->nodes[child], node)) break;
+    pq_place(pq, i, pq->nodes[child]);
+    i = child;
+  }
+  pq_place(pq, i, node);
+}
+
+/**
+ * @brief  initializes an empty queue
+ *
+ * @param  pq          the queue
+ * @param  storage     array of at least capacity node pointers
+ * @param  capacity    maximum number of queued nodes
+ */
+void pq_init( pq_t *pq, pq_node_t **storage, uint32_t capacity ){
+  pq->nodes = storage;
+  pq->size = 0;
+  pq->capacity = capacity;
+}
+
+/**
+ * @brief  marks a node as not queued
+ *
+ * @param  node        the node
+ */
+void pq_node_init( pq_node_t *node ){
+  node->pos = PQ_NONE;
+}
+
+/**
+ * @brief  queues a node by its current key
+ *
+ * @param  pq          the queue
+ * @param  node        the node, which must not already be queued
+ * @return 0 on success, -1 if the queue is full
+ */
+int pq_insert( pq_t *pq, pq_node_t *node ){
+  if (pq->size == pq->capacity) return -1;
+  pq_place(pq, pq->size++, node);
+  pq_sift_up(pq, node->pos);
+  return 0;
+}
+
+/**
+ * @brief  unlinks a node from anywhere in the queue, no-op if not queued
+ *
+ * @param  pq          the queue
+ * @param  node        the node
+ */
+void pq_remove( pq_t *pq, pq_node_t *node ){
+  uint32_t i = node->pos;
+  if (i == PQ_NONE) return;
+
+  node->pos = PQ_NONE;
+  if (i == --pq->size) return;
+
+  //Fill the hole with the last node and restore order in whichever direction
+  pq_place(pq, i, pq->nodes[pq->size]);
+  if (i > 0 && pq_less(pq->nodes[i], pq->nodes[(i - 1) / 2])) pq_sift_up(pq, i);
+  else pq_sift_down(pq, i);
+}
+
+/**
+ * @brief  changes the key of a queued node
+ *
+ * @param  pq          the queue
+ * @param  node        the queued node
+ * @param  key         the new key
+ */
+void pq_update( pq_t *pq, pq_node_t *node, uint32_t key ){
+  uint32_t old_key = node->key;
+  node->key = key;
+  if (node->pos == PQ_NONE) return;
+
+  if (TICK_BEFORE(key, old_key)) pq_sift_up(pq, node->pos);
+  else pq_sift_down(pq, node->pos);
+}
+
+/**
+ * @brief  returns the smallest node without removing it
+ *
+ * @param  pq          the queue
+ * @return the smallest node, NULL if empty
+ */
+pq_node_t *pq_peek( pq_t *pq ){
+  if (!pq->size) return NULL;
+  return pq->nodes[0];
+}
+
+/**
+ * @brief  removes and returns the smallest node
+ *
+ * @param  pq          the queue
+ * @return the smallest node, NULL if empty
+ */
+pq_node_t *pq_pop( pq_t *pq ){
+  pq_node_t *node = pq_peek(pq);
+  if (node) pq_remove(pq, node);
+  return node;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file   profile.c
+ *
+ * @brief  Cycle-count statistics for kernel hot paths, sampled with the DWT
+ *         cycle counter. Everything here compiles to nothing unless the
+ *         kernel is built with PROFILE=1.
+ *
+ * @date   10/17/26
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <stdint.h>
+#include <printk.h>
+#include "profile.h"
+
+#ifdef PROFILE
+
+/** @brief human readable names, indexed by prof_id */
+static const char *prof_names[PROF_NUM] = {
+  "sched pick (bitmap)",
+  "sched pick (scan)",
+  "systick isr",
+  "pendsv switch",
+  "pendsv skipped",
+  "mpu load (tcb)",
+  "mpu load (encoded)"
+};
+
+prof_stat_t prof_stats[PROF_NUM];
+
+uint32_t prof_pick_mismatch;
+
+void prof_reset( void ){
+  for (uint32_t i = 0; i < PROF_NUM; i++){
+    prof_stats[i].count = 0;
+    prof_stats[i].min = UINT32_MAX;
+    prof_stats[i].max = 0;
+    prof_stats[i].total = 0;
+    for (uint32_t b = 0; b < PROF_HIST_BUCKETS; b++) prof_stats[i].hist[b] = 0;
+  }
+  prof_pick_mismatch = 0;
+}
+
+void prof_record( prof_id id, uint32_t cycles ){
+  prof_stat_t *stat = &prof_stats[id];
+
+  if (stat->count == 0 || cycles < stat->min) stat->min = cycles;
+  if (cycles > stat->max) stat->max = cycles;
+  stat->total += cycles;
+  stat->count++;
+
+  uint32_t bucket = cycles ? 31 - count_leading_zeros(cycles) : 0;
+  if (bucket >= PROF_HIST_BUCKETS) bucket = PROF_HIST_BUCKETS - 1;
+  stat->hist[bucket]++;
+}
+
+void prof_dump( void ){
+  printk("---- kernel profile (cycles) ----\n");
+  for (uint32_t i = 0; i < PROF_NUM; i++){
+    prof_stat_t *stat = &prof_stats[i];
+    if (!stat->count) continue;
+    printk("%s: n=%u min=%u avg=%u max=%u\n", prof_names[i], stat->count,
+           stat->min, (uint32_t)(stat->total / stat->count), stat->max);
+    for (uint32_t b = 0; b < PROF_HIST_BUCKETS; b++){
+      if (stat->hist[b]) printk("  [%u, %u): %u\n", 1U << b, 2U << b, stat->hist[b]);
+    }
+  }
+  printk("sched pick mismatches: %u\n", prof_pick_mismatch);
+}
+
+#else
+
+void prof_reset( void ){}
+
+void prof_record( prof_id id, uint32_t cycles ){
+  (void)id;
+  (void)cycles;
+}
+
+void prof_dump( void ){}
+
+#endif /* PROFILE */
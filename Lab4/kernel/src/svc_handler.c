@@ -11,13 +11,19 @@
 #include <stdint.h>
 #include <debug.h>
 #include <svc_num.h>
+#include <svc_batch.h>
 #include <syscall.h>
+#include <mpu.h>
 #include <nvic.h>
 #include <kernel.h>
 #include "syscall_thread.h"
 #include "syscall_mutex.h"
+#include "syscall_sync.h"
+#include "syscall_mqueue.h"
 
-/** @brief stack frame pushed by the SVC instruction using the PSP 
+/** @brief stack frame pushed by the SVC instruction using the PSP. The stubs
+ *  leave every argument in r0-r3 and a fifth in r12, and results return in
+ *  r0, or r0:r1 for 64 bits.
  */ 
 typedef struct {
     uint32_t r0;   /**< reg r0*/
@@ -28,10 +34,184 @@ typedef struct {
     uint32_t lr;   /**< reg lr*/
     uint32_t pc;   /**< reg pc*/
     uint32_t xPSR; /**< reg xPSR*/
-    void    *arg1; /**< user stack frame for passing external info */
-    // void    *arg2; /**< user stack frame for passing external info */
 } stack_frame_t;
 
+/** @brief unpacks one syscall's arguments from the frame and packs its result */
+typedef void (*svc_fn_t)(stack_frame_t *s);
+
+static void svc_batch(stack_frame_t *s);
+
+/** @brief syscall wrappers, one per SVC number */
+//@{
+static void svc_exit(stack_frame_t *s){ sys_exit(s->r0); }
+static void svc_read(stack_frame_t *s){ s->r0= sys_read(s->r0, (char *)s->r1, s->r2); }
+static void svc_write(stack_frame_t *s){ s->r0= sys_write(s->r0, (char *)s->r1, s->r2); }
+static void svc_sbrk(stack_frame_t *s){ s->r0= (uint32_t)sys_sbrk(s->r0); }
+
+static void svc_thread_init(stack_frame_t *s){ s->r0= sys_thread_init(s->r0, s->r1, (void *)s->r2, s->r3, s->r12); }
+static void svc_thread_create(stack_frame_t *s){ s->r0= sys_thread_create((void *)s->r0, s->r1, s->r2, s->r3, (void *)s->r12); }
+static void svc_thread_kill(stack_frame_t *s){ (void)s; sys_thread_kill(); }
+static void svc_scheduler_start(stack_frame_t *s){ s->r0= sys_scheduler_start(s->r0); }
+static void svc_priority(stack_frame_t *s){ s->r0= sys_get_priority(); }
+static void svc_time(stack_frame_t *s){ s->r0= sys_get_time(); }
+static void svc_thread_time(stack_frame_t *s){ s->r0= sys_thread_time(); }
+static void svc_wait(stack_frame_t *s){ (void)s; sys_wait_until_next_period(); }
+static void svc_sleep(stack_frame_t *s){ s->r0= sys_sleep_ticks(s->r0); }
+static void svc_sleep_until(stack_frame_t *s){ s->r0= sys_sleep_until(s->r0); }
+static void svc_thread_stats(stack_frame_t *s){ s->r0= sys_thread_stats(s->r0, (thread_stats_t *)s->r1); }
+static void svc_thread_stack(stack_frame_t *s){ s->r0= sys_thread_stack_usage(s->r0, (stack_usage_t *)s->r1); }
+static void svc_idle_work(stack_frame_t *s){ s->r0= sys_idle_work(); }
+static void svc_cpu_cycles(stack_frame_t *s){
+    uint64_t cycles= sys_cpu_cycles(s->r0, s->r1);
+    s->r0= (uint32_t)cycles;
+    s->r1= (uint32_t)(cycles >> 32);
+}
+
+static void svc_mutex_init(stack_frame_t *s){ s->r0= (uint32_t)sys_mutex_init(s->r0); }
+static void svc_mutex_lock(stack_frame_t *s){ sys_mutex_lock((kmutex_t *)s->r0); }
+static void svc_mutex_unlock(stack_frame_t *s){ sys_mutex_unlock((kmutex_t *)s->r0); }
+static void svc_mutex_stats(stack_frame_t *s){ s->r0= sys_mutex_stats((kmutex_t *)s->r0, (mutex_stats_t *)s->r1); }
+static void svc_umutex_init(stack_frame_t *s){ s->r0= (uint32_t)sys_umutex_init((volatile uint32_t *)s->r0, s->r1, (uint32_t *)s->r2); }
+static void svc_umutex_lock(stack_frame_t *s){ s->r0= sys_umutex_lock((kmutex_t *)s->r0); }
+static void svc_umutex_unlock(stack_frame_t *s){ s->r0= sys_umutex_unlock((kmutex_t *)s->r0); }
+
+static void svc_sem_init(stack_frame_t *s){ s->r0= (uint32_t)sys_sem_init(s->r0); }
+static void svc_sem_wait(stack_frame_t *s){ s->r0= sys_sem_wait((ksem_t *)s->r0, s->r1); }
+static void svc_sem_post(stack_frame_t *s){ s->r0= sys_sem_post((ksem_t *)s->r0); }
+static void svc_event_init(stack_frame_t *s){ s->r0= (uint32_t)sys_event_init(); }
+static void svc_event_wait(stack_frame_t *s){ s->r0= sys_event_wait((kevent_t *)s->r0, s->r1, s->r2, s->r3); }
+static void svc_event_set(stack_frame_t *s){ s->r0= sys_event_set((kevent_t *)s->r0, s->r1); }
+static void svc_event_clear(stack_frame_t *s){ s->r0= sys_event_clear((kevent_t *)s->r0, s->r1); }
+
+static void svc_mq_init(stack_frame_t *s){ s->r0= (uint32_t)sys_mq_init(s->r0, s->r1); }
+static void svc_mq_send(stack_frame_t *s){ s->r0= sys_mq_send((kmqueue_t *)s->r0, (const void *)s->r1, s->r2); }
+static void svc_mq_receive(stack_frame_t *s){ s->r0= sys_mq_receive((kmqueue_t *)s->r0, (void *)s->r1, s->r2); }
+static void svc_mq_alloc(stack_frame_t *s){ s->r0= (uint32_t)sys_mq_alloc((kmqueue_t *)s->r0, s->r1); }
+static void svc_mq_send_buf(stack_frame_t *s){ s->r0= sys_mq_send_buf((kmqueue_t *)s->r0, (void *)s->r1); }
+static void svc_mq_receive_buf(stack_frame_t *s){ s->r0= (uint32_t)sys_mq_receive_buf((kmqueue_t *)s->r0, s->r1); }
+static void svc_mq_free(stack_frame_t *s){ s->r0= sys_mq_free((kmqueue_t *)s->r0, (void *)s->r1); }
+
+/** Deprecated Servo Functions */
+static void svc_deprecated(stack_frame_t *s){ s->r0= -1; }
+//@}
+
+/** @brief wrapper of every SVC number, as specified in svc_num.h. Numbers
+ *  without one, e.g. fstat, return with the frame untouched.
+ */
+static const svc_fn_t svc_table[]= {
+    [SVC_EXIT]=         svc_exit,
+    [SVC_READ]=         svc_read,
+    [SVC_WRITE]=        svc_write,
+    [SVC_SBRK]=         svc_sbrk,
+
+    /**Thread and Mutex syscalls */
+    [SVC_THR_INIT]=     svc_thread_init,
+    [SVC_THR_CREATE]=   svc_thread_create,
+    [SVC_THR_KILL]=     svc_thread_kill,
+    [SVC_SCHD_START]=   svc_scheduler_start,
+    [SVC_PRIORITY]=     svc_priority,
+    [SVC_TIME]=         svc_time,
+    [SVC_THR_TIME]=     svc_thread_time,
+    [SVC_WAIT]=         svc_wait,
+    [SVC_SLEEP]=        svc_sleep,
+    [SVC_SLEEP_UNTIL]=  svc_sleep_until,
+    [SVC_THR_STATS]=    svc_thread_stats,
+    [SVC_THR_STACK]=    svc_thread_stack,
+    [SVC_CPU_CYCLES]=   svc_cpu_cycles,
+    [SVC_IDLE_WORK]=    svc_idle_work,
+    [SVC_MUT_INIT]=     svc_mutex_init,
+    [SVC_MUT_LOK]=      svc_mutex_lock,
+    [SVC_MUT_ULK]=      svc_mutex_unlock,
+    [SVC_MUT_STATS]=    svc_mutex_stats,
+    [SVC_UMUT_INIT]=    svc_umutex_init,
+    [SVC_UMUT_LOK]=     svc_umutex_lock,
+    [SVC_UMUT_ULK]=     svc_umutex_unlock,
+
+    [SVC_SEM_INIT]=     svc_sem_init,
+    [SVC_SEM_WAIT]=     svc_sem_wait,
+    [SVC_SEM_POST]=     svc_sem_post,
+    [SVC_EVT_INIT]=     svc_event_init,
+    [SVC_EVT_WAIT]=     svc_event_wait,
+    [SVC_EVT_SET]=      svc_event_set,
+    [SVC_EVT_CLEAR]=    svc_event_clear,
+
+    [SVC_MQ_INIT]=      svc_mq_init,
+    [SVC_MQ_SEND]=      svc_mq_send,
+    [SVC_MQ_RECEIVE]=   svc_mq_receive,
+    [SVC_MQ_ALLOC]=     svc_mq_alloc,
+    [SVC_MQ_SEND_BUF]=  svc_mq_send_buf,
+    [SVC_MQ_RECV_BUF]=  svc_mq_receive_buf,
+    [SVC_MQ_FREE]=      svc_mq_free,
+    [SVC_BATCH]=        svc_batch,
+
+    [SVC_SERVO_ENABLE]= svc_deprecated,
+    [SVC_SERVO_SET]=    svc_deprecated,
+};
+
+/** @brief number of entries in svc_table */
+#define SVC_TABLE_SIZE (sizeof(svc_table) / sizeof(svc_table[0]))
+
+/** @brief SVCs a batch may run: calls that never block, so the batch
+ *  finishes in the SVC that submitted it, and that check their own user
+ *  pointers rather than kill the thread part way through the batch
+ */
+static const uint8_t svc_batchable[]= {
+    [SVC_WRITE]=        1,
+    [SVC_TIME]=         1,
+    [SVC_PRIORITY]=     1,
+    [SVC_THR_TIME]=     1,
+    [SVC_MUT_ULK]=      1,
+    [SVC_SEM_POST]=     1,
+    [SVC_EVT_SET]=      1,
+    [SVC_EVT_CLEAR]=    1,
+    [SVC_MQ_SEND_BUF]=  1,
+    [SVC_MQ_FREE]=      1,
+};
+
+/** @brief runs the queued syscalls of a ring, in order, through the same
+ *  wrappers as single SVCs. The ring header and both arrays must be user
+ *  memory the caller may write, or read for the submissions, and the
+ *  header is read once so later writes to it cannot move the arrays. A
+ *  call not in svc_batchable completes with -1.
+ *  @param [s] frame of the SVC, r0 is the ring
+ *  @return in r0, the number of calls run, 0 for a bad ring. It stops
+ *          early once the completion ring is full.
+ */
+static void svc_batch(stack_frame_t *s){
+    svc_ring_t *ring= (svc_ring_t *)s->r0;
+    uint32_t done= 0;
+
+    s->r0= 0;
+    if (!MM_USER_WRITABLE(ring)) return;
+    uint32_t mask= ring->mask;
+    svc_sqe_t *sq= ring->sq;
+    svc_cqe_t *cq= ring->cq;
+    if (mask >= SVC_RING_ENTRIES_MAX || (mask & (mask + 1)) != 0 ||
+        !MM_USER_READABLE(sq) || !mm_user_range(sq, (mask + 1) * sizeof(svc_sqe_t), 0) ||
+        !MM_USER_WRITABLE(cq) || !mm_user_range(cq, (mask + 1) * sizeof(svc_cqe_t), 1)) return;
+
+    while (ring->sq_head != ring->sq_tail && ring->cq_tail - ring->cq_head <= mask){
+        svc_sqe_t *sqe= &sq[ring->sq_head & mask];
+        uint32_t num= sqe->num;
+        stack_frame_t frame= { .r0= sqe->args[0], .r1= sqe->args[1], .r2= sqe->args[2],
+                               .r3= sqe->args[3], .r12= sqe->args[4] };
+
+        if (num < sizeof(svc_batchable) && svc_batchable[num]){
+            svc_table[num](&frame);
+        } else {
+            frame.r0= -1;
+        }
+
+        svc_cqe_t *cqe= &cq[ring->cq_tail & mask];
+        cqe->tag= sqe->tag;
+        cqe->result= frame.r0;
+        ring->cq_tail++;
+        ring->sq_head++;
+        done++;
+    }
+    s->r0= done;
+}
+
 /** @brief stack frame pushed by the SVC instruction using the PSP
  *  @param [psp] PSP process stack pointer (pointing to the just-pushed exception frame)
  */
@@ -39,73 +219,9 @@ void svc_c_handler(void *psp){
     stack_frame_t *s= (stack_frame_t*)psp;
     nvic_clear_pending(11);
 
-    uint32_t *tmp= (uint32_t *)(s->pc-2);
-    void *tmp1;
-    uint8_t svc_number= *(tmp);
-    //call different syscalls based on SVC number as specified in svc_num.h
-    switch (svc_number){
-        case SVC_EXIT:
-            sys_exit(s->r0);
-            break;
-        case SVC_READ:
-            s->r0= sys_read(s->r0, (char *)s->r1, s->r2);
-            break;
-        case SVC_WRITE:
-            s->r0= sys_write(s->r0, (char *)s->r1, s->r2);
-            break;
-        case SVC_SBRK:
-            tmp1= sys_sbrk(s->r0);
-            s->arg1= tmp1;
-            break;
-        case SVC_FSTAT:
-            break;
-
-        /**Thread and Mutex syscalls */
-        case SVC_THR_INIT:
-            s->r0= sys_thread_init(s->r0, s->r1, s->arg1, s->r3, s->r12);
-            break;
-        case SVC_THR_CREATE: 
-            s->r0= sys_thread_create((void*)(s->r0), s->r1, s->r2, s->r3, s->arg1);
-            break;
-        case SVC_THR_KILL:
-            sys_thread_kill();
-            break;
-        case SVC_SCHD_START:
-            s->r0= sys_scheduler_start(s->r0);
-            break;
-        case SVC_PRIORITY:
-            s->r0= sys_get_priority();
-            break;
-        case SVC_TIME:
-            s->r0= sys_get_time();
-            break;
-        case SVC_THR_TIME:
-            s->r0= sys_thread_time();
-            break;
-        case SVC_WAIT:
-            sys_wait_until_next_period();
-            break;
-        case SVC_MUT_INIT:
-            tmp1= (void*)sys_mutex_init(s->r0);
-            s->arg1= tmp1;
-            break;
-        case SVC_MUT_LOK:
-            sys_mutex_lock((kmutex_t*)(s->arg1));
-            break;
-        case SVC_MUT_ULK:
-            sys_mutex_unlock((kmutex_t*)(s->arg1));
-            break;
-
-        /** Deprecated Servo Functions */
-        case SVC_SERVO_ENABLE:
-            s->r0= -1; 
-            break;
-        case SVC_SERVO_SET:
-            s->r0= -1;
-            break;
-
-        default:
-            break;
-    }
-    return;
+    //The SVC number is the low byte of the 16-bit instruction before the return address
+    uint32_t svc_number= ((uint16_t *)s->pc)[-1] & 0xFF;
+    uint64_t svc_start= svc_account_begin();
+    if (svc_number < SVC_TABLE_SIZE && svc_table[svc_number] != NULL) svc_table[svc_number](s);
+    svc_account_end(svc_start);
 }
@@ -15,7 +15,10 @@
 #include <nvic.h>
 #include <printk.h>
 #include <kernel.h>
+#include <profile.h>
+#include <mpu.h>
 #include "uart.h"
+#include "syscall_sync.h"
 
 /** Standard out file I/O */
 #define STDOUT 1
@@ -47,9 +50,10 @@ void *sys_sbrk(int incr){
  * @param [str]  buffered to write from
  * @param [len] length of string to write
  * @param [file] number of bytes to write from buffer
+ * @return len, or -1 for another file or a buffer user code may not read
  */
 int sys_write(int file, char *str, int len){
-    if(file != STDOUT) return -1;
+    if(file != STDOUT || len < 0 || !mm_user_range(str, len, 0)) return -1;
     int i=0;
     while(i < len){
         if(str[i] == '\0') break;
@@ -72,7 +76,8 @@ int sys_read(int file, char *str, int len){
     int tmp;
     int i = 0;
 	while(i < len){
-		while((tmp = uart_get_byte(&c)) != 0);
+		//Sleep until the receive interrupt has a byte
+		while((tmp = uart_get_byte(&c)) != 0) uart_rx_wait();
 
         if(c == 0x4)
             return i;
@@ -98,6 +103,7 @@ int sys_read(int file, char *str, int len){
  * @param [status] status no. with which to exit the program
  */
 void sys_exit(int status){
+   prof_dump();
    printk("Exited with status %d\n", status);
    uart_flush();
    led_set_display(status);
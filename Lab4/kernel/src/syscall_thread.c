@@ -12,10 +12,17 @@
 #include <arm.h>
 #include <printk.h>
 #include <timer.h>
+#include <uart.h>
 #include "syscall_thread.h"
 #include "syscall_mutex.h"
+#include "syscall_sync.h"
+#include "syscall_mqueue.h"
 #include "mpu.h"
 #include "syscall.h"
+#include "profile.h"
+#include "pqueue.h"
+#include "kconfig.h"
+#include "time_page_layout.h"
 
 /** @brief Initial XPSR value, all 0s except thumb bit. */
 #define XPSR_INIT 0x1000000
@@ -27,6 +34,25 @@
 /** @brief index of the first user thread */
 #define USER_THREAD_FIRST_IDX 2
 
+/** @brief UART byte that prints the thread statistics, Ctrl-T */
+#define STATS_DUMP_CMD 0x14
+
+/** @brief work SysTick leaves for the idle thread in the time page, one bit each */
+//@{
+#define IDLE_WORK_DUMP   (1U << 0) /**< print the thread statistics */
+#define IDLE_WORK_STACKS (1U << 1) /**< rescan the stacks of the next thread in turn */
+//@}
+
+/** @brief ready map bit for a priority within its word, so that CLZ yields the highest priority */
+#define PRIO_BIT(prio) ((1U << 31) >> ((prio) & 31))
+/** @brief ready map word holding a priority's bit */
+#define PRIO_WORD(prio) ((prio) >> 5)
+
+/** @brief whether a pointer from user code is the start of one of the first count entries of a table */
+#define TABLE_ENTRY(ptr, table, count) \
+  ((uint32_t)((char *)(ptr) - (char *)(table)) < (count) * sizeof(*(table)) && \
+   (uint32_t)((char *)(ptr) - (char *)(table)) % sizeof(*(table)) == 0)
+
 /**
  * @brief      Heap high and low pointers.
  */
@@ -35,9 +61,21 @@ extern char
 __thread_u_stacks_low,
 __thread_u_stacks_top,
 __thread_k_stacks_low,
-__thread_k_stacks_top;
+__thread_k_stacks_top,
+__psp_stack_bottom,
+__psp_stack_top,
+__msp_stack_top;
 //@}
 
+/** @brief index of the kernel stack guard in a thread's encoded MPU regions */
+#define MPU_K_GUARD 0
+/** @brief index of the user stack region, or its guard, in a thread's encoded MPU regions */
+#define MPU_U_STACK 1
+/** @brief larger regions tried for a PER_THREAD user stack that would cross a block of the smallest */
+#define STACK_REGION_STEPS 2
+/** @brief pattern thread stacks are painted with, to find how deep they were used */
+#define STACK_PAINT 0xDEADBEEF
+
 
 /**
  * @brief  Stack frame upon exception.
@@ -54,7 +92,8 @@ typedef struct {
 } interrupt_stack_frame;
 
 /**
- * @brief Calle context saved stack frame
+ * @brief Calle context saved stack frame. Threads that use the FPU also
+ *        have s16-s31 saved right above it.
  */
 typedef struct {
   uint32_t lr;  /**< Register value for lr*/
@@ -72,23 +111,53 @@ typedef struct {
 /**
  * @brief  thread-specific kernel datat structures for thread management
  */
-typedef struct {
+typedef struct tcb_t {
     uint8_t  id;        /**< thread's identifier */    
+    uint8_t job_started; /**< whether the current job has run yet */
+    uint8_t fp_used; /**< whether the thread has FPU state, its saved context then includes s16-s31 */
+    uint8_t wait_prio; /**< priority the thread waits at, its place in its object's wait queue */
     thread_state state; /**< thread's current state i.e running or runnable etc*/
     uint32_t static_prio; /**< thread's static priority */
     uint32_t dyn_prio; /**< thread's dynamic priority */
     uint32_t T;    /**< in ticks*/
     uint32_t C;    /**< in ticks*/
-    uint32_t tickStart;    /**< in ticks*/
     uint32_t u_stack_high; /**< first address in thread's psp */
     uint32_t k_stack_high; /**< first address in thread's msp */
+    mm_region_t mpu[MM_THREAD_REGIONS]; /**< MPU regions of the thread's stacks and their guards, encoded when they are placed */
     uint32_t running_C; /**< computation time thus far in current period*/
-    uint32_t last_deadline; /**< last wakeup time for thread */
-    uint32_t next_deadline; /**< next wakeup time for thread */
+    uint32_t next_deadline; /**< next wakeup time for thread, the current job's release plus T */
     uint32_t total_C; /**< total computation time since thread initialized*/
     void *psp; /**< address of psp */
     void *msp; /**< address of msp */
-    int  svc_status; /**< whether thread was servicing an SVC */
+    uint8_t svc_status; /**< whether thread was servicing an SVC */
+    uint8_t rq_prio; /**< priority list the thread is queued on */
+    uint8_t overran; /**< whether the current job was cut off at C, still unfinished */
+    struct tcb_t *rq_next; /**< next thread in the same priority ready list */
+    struct tcb_t *rq_prev; /**< previous thread in the same priority ready list */
+    pq_node_t release_node; /**< release queue link, keyed by next_deadline */
+    pq_node_t deadline_node; /**< EDF ready heap link, keyed by next_deadline */
+    uint32_t rta_R; /**< worst-case response time from the last admission test */
+    thread_stats_t stats; /**< observed timing since creation */
+    kmutex_t *held; /**< top of the stack of mutexes the thread holds, the last one locked */
+    uint64_t cycles; /**< CPU cycles run, syscalls included, interrupt handlers excluded */
+    uint64_t svc_cycles; /**< part of cycles spent inside syscalls */
+    wait_queue_t *blocked_on; /**< mutex, semaphore or event the thread waits on */
+    struct tcb_t *wait_next; /**< next thread waiting on the same object, at the same or lower priority */
+    struct tcb_t *wait_prev; /**< previous thread waiting on the same object */
+    pq_node_t timeout_node; /**< timeout queue link, keyed by the tick the wait times out */
+    uint32_t wait_result; /**< value the wait returns, preset to the timeout result */
+    union {
+      struct {
+        kmutex_t *want; /**< mutex the thread is trying to lock */
+        uint32_t start; /**< tick of the mutex_lock call */
+      } lock;
+      struct {
+        uint32_t mask; /**< flags waited for */
+        uint32_t mode; /**< event wait mode */
+      } event;
+    } wait; /**< what the thread waits for, by the kind of object */
+    uint16_t u_stack_peak; /**< most bytes of the user stack found used, as of the last scan */
+    uint16_t k_stack_peak; /**< most bytes of the kernel stack found used, as of the last scan */
 } tcb_t;
 
 /**
@@ -103,10 +172,44 @@ typedef struct gcb_t {
   uint32_t u_stack_next; /**< pointer to address starting next user stack*/
   uint32_t k_stack_next; /**< pointer to address starting next kernel stack*/
   uint8_t active_id; /**< source of truth for currently running thread */
-  tcb_t tcbs[16]; /**< thread control blocks */
+  tcb_t *tcbs; /**< thread control blocks, TCB_CAPACITY of them */
   uint32_t num_mutexes; /**< num initialized system mutexes */
   uint32_t max_mutexes; /**< max initializable system mutex */
-  kmutex_t mutexes[32]; /**< system mutextes */
+  kmutex_t *mutexes; /**< system mutextes, MUTEX_CAPACITY of them */
+  uint32_t num_umutexes; /**< the part of num_mutexes backing user mutexes */
+  kmutex_t *umutexes[UMUTEX_CAPACITY]; /**< kernel mutex of each user mutex, by its bit in the held maps */
+  volatile uint32_t *umutex_held; /**< per thread id, the user mutexes it may hold; on the user heap once one is created */
+  uint32_t ready_map[PRIO_WORDS]; /**< bit PRIO_BIT(p) of word PRIO_WORD(p) set iff ready_head[p] is non-empty */
+  tcb_t *ready_head[NUM_PRIOS]; /**< FIFO of ready user threads per effective priority */
+  tcb_t *ready_tail[NUM_PRIOS]; /**< tail of each ready FIFO */
+  uint32_t ceil_map[PRIO_WORDS]; /**< bit PRIO_BIT(c) of word PRIO_WORD(c) set iff ceil_head[c] is non-empty */
+  kmutex_t *ceil_head[NUM_PRIOS]; /**< locked mutexes per priority ceiling */
+  pq_t timeout_q; /**< threads waiting with a timeout, ordered by when it expires */
+  pq_node_t **timeout_nodes; /**< heap storage for timeout_q */
+  uint32_t num_sems; /**< num initialized semaphores */
+  ksem_t *sems; /**< semaphores, SEM_CAPACITY of them */
+  ksem_t uart_rx; /**< binary, posted by the UART receive interrupt for sys_read to sleep on */
+  uint32_t num_events; /**< num initialized event flag groups */
+  kevent_t *events; /**< event flag groups, EVENT_CAPACITY of them */
+  uint32_t num_mqueues; /**< num initialized message queues */
+  kmqueue_t *mqueues; /**< message queues, MQUEUE_CAPACITY of them */
+  uint32_t mq_pool_floor; /**< lowest address queue buffers may take, past the kernel stacks of max_threads */
+  uint32_t mq_pool_low; /**< start of the last queue buffers carved down from the top of the kernel stack arena */
+  pq_t release_q; /**< active user threads ordered by next release time */
+  pq_node_t **release_nodes; /**< heap storage for release_q */
+  uint8_t edf; /**< whether ready threads are ordered by deadline instead of priority */
+  pq_t deadline_q; /**< ready user threads ordered by absolute deadline, EDF only */
+  pq_node_t **deadline_nodes; /**< heap storage for deadline_q */
+  uint8_t rta_valid; /**< whether every rta_R is a fixed point of the current set */
+  uint8_t rta_blocking; /**< whether a blocking term grew since the last admission test */
+  uint8_t tickless; /**< whether idle periods may skip ticks */
+  uint8_t per_thread; /**< whether user code may only reach its own stack, PER_THREAD */
+  uint8_t stack_sample; /**< thread whose stacks the idle thread scanned last */
+  uint32_t tick_cycles; /**< systick cycles per scheduler tick */
+  uint32_t sleep_ticks; /**< ticks the programmed tickless sleep spans, 0 while ticking */
+  uint32_t slice_start; /**< CYCCNT when the running thread was switched in */
+  uint64_t irq_mark; /**< irq_cycles when the running thread was switched in */
+  uint64_t elapsed; /**< cycles from scheduler start to slice_start */
 } gcb_t;
 
 
@@ -114,17 +217,41 @@ typedef struct gcb_t {
 int mem_fault= 0;
 
 /**
- * @brief      Precalculated values for UB test.
+ * @brief fp_used of the running thread, read by the PendSV handler to decide
+ *        whether to save and restore s16-s31. The SVC handler sets it when a
+ *        thread enters a syscall with FPU state, as a PendSV that preempts
+ *        the syscall cannot tell from its own EXC_RETURN.
  */
-float ub_table[] = {
-  0.000, 1.000, .8284, .7798, .7568,
-  .7435, .7348, .7286, .7241, .7205,
-  .7177, .7155, .7136, .7119, .7106,
-  .7094, .7083, .7075, .7066, .7059,
-  .7052, .7047, .7042, .7037, .7033,
-  .7028, .7025, .7021, .7018, .7015,
-  .7012, .7009
-};
+volatile uint32_t fp_active;
+
+/**
+ * @brief k_stack_high of the running thread. The MemManage handler moves
+ *        the MSP there when it faulted in handler mode, as the MSP may be
+ *        the one that ran into its guard. The thread is killed, so nothing
+ *        it kept on its kernel stack is needed again.
+ */
+uint32_t mm_fault_sp;
+
+/** @brief fractional bits of the fixed-point utilization used by EDF admission */
+#define UTIL_FRAC_BITS 24
+/** @brief full utilization in fixed point */
+#define UTIL_ONE (1U << UTIL_FRAC_BITS)
+
+/** @brief the time page, placed by the linker at the start of .kheap. Its idle_work holds IDLE_WORK_* bits */
+extern time_page_t _time_page;
+
+/** @brief tables sized by kconfig.h, carved from the kernel heap region by the linker */
+//@{
+tcb_t tcb_table[TCB_CAPACITY] KHEAP_TABLE;
+kmutex_t mutex_table[MUTEX_CAPACITY] KHEAP_TABLE;
+pq_node_t *release_table[TCB_CAPACITY] KHEAP_TABLE;
+pq_node_t *deadline_table[TCB_CAPACITY] KHEAP_TABLE;
+uint32_t rta_table[TCB_CAPACITY] KHEAP_TABLE;
+pq_node_t *timeout_table[TCB_CAPACITY] KHEAP_TABLE;
+ksem_t sem_table[SEM_CAPACITY] KHEAP_TABLE;
+kevent_t event_table[EVENT_CAPACITY] KHEAP_TABLE;
+kmqueue_t mqueue_table[MQUEUE_CAPACITY] KHEAP_TABLE;
+//@}
 
 /** Intialize shared kernel data structure globally */
 gcb_t gcb;
@@ -135,8 +262,11 @@ tcb_t *get_active_thread();
 /** @brief thread scheduler */
 tcb_t *get_next_thread();
 
+/** @brief whether a context switch would change anything */
+int switch_needed();
+
 /** @brief whether the available stack space is enough for thread stacks */
-int stack_overflows(uint32_t max_threads, uint32_t stack_size);
+int stack_overflows(uint32_t num_stacks, uint32_t stack_size, int per_thread, uint32_t *k_end);
 
 /** @brief helper to setup new threads expected stack frame on pendSV interrupt */
 void setup_init_stack_frame(tcb_t *thread, void *fn, void *vargp);
@@ -144,8 +274,17 @@ void setup_init_stack_frame(tcb_t *thread, void *fn, void *vargp);
 /** @brief initializes default and idle threads*/
 void set_default_threads(void *idle_fn);
 
-/** @brief indicates whether a task set is schedulable */
-int is_schedulable(uint32_t newC, uint32_t newT);
+/** @brief fixed-point utilization of one task, rounded up */
+uint32_t utilization(uint32_t C, uint32_t T);
+
+/** @brief indicates whether a task set stays schedulable with the candidate added */
+int is_schedulable(tcb_t *cand);
+
+/** @brief worst-case response time of a task, 0 if it misses its period */
+uint32_t response_time(tcb_t *task, uint32_t start, tcb_t *cand);
+
+/** @brief longest time a task can be blocked by lower priority mutex holders */
+uint32_t blocking_term(uint32_t prio);
 
 /** @brief updates thread times as global clock changes */
 void update_thread_times();
@@ -153,37 +292,229 @@ void update_thread_times();
 /** @brief switches memory protectino between threads*/
 void switch_mem_protect(tcb_t *next_thread);
 
+/** @brief size in bytes of each of a thread's stacks */
+uint32_t stack_bytes(const tcb_t *thread);
+
+/** @brief smallest region a stack and its guard subregion fit in */
+uint8_t stack_region_log2(uint32_t bytes);
+
+/** @brief bytes a stack and its guard take up in whole subregions */
+uint32_t stack_span(uint32_t bytes, uint8_t size_log2);
+
+/** @brief places a stack in an arena, returns its lowest address */
+uint32_t stack_place(uint32_t next, uint32_t bytes, int exact, uint8_t *size_log2);
+
+/** @brief whether a thread has stacks of its own to guard */
+int owns_stacks(const tcb_t *thread);
+
+/** @brief carves a new thread's stacks and encodes their regions */
+void place_stacks(tcb_t *thread);
+
+/** @brief encodes the MPU regions of a thread's stacks and their guards */
+void encode_stack_regions(mm_region_t *regions, const tcb_t *thread, uint8_t u_log2);
+
+/** @brief prints the use of the stack arenas */
+void stack_report();
+
+/** @brief whether a thread's stacks are painted when it is set up */
+int stack_paintable(const tcb_t *thread);
+
+/** @brief lowest address of a thread's stack above its guard */
+uint32_t stack_floor(const tcb_t *thread, int user);
+
+/** @brief fills a stack with STACK_PAINT */
+void stack_paint(uint32_t low, uint32_t high);
+
+/** @brief bytes of a painted stack used, at least the known peak */
+uint16_t stack_peak(uint32_t low, uint32_t high, uint16_t known);
+
+/** @brief rescans a thread's stacks for its peak use */
+void stack_peaks_update(tcb_t *thread);
+
+/** @brief rescans the stacks of the next thread in turn */
+void stack_sample();
+
 /** @brief Reference to assembly-defined global function for linker resolution */
 extern void thread_kill( void );
 
+/** @brief copies the running thread's time and priority to the time page */
+void time_page_publish();
+
 /** @brief find any one of the inactive threads */
 tcb_t *find_inactive_thread();
 
-/** @brief sets thread is (not) pending to use mutex */
-void set_pending_state(kmutex_t *mutex, uint32_t thread_id, uint32_t val);
+/** @brief locks a mutex for a thread if IPCP allows it, or queues the thread behind the mutex in its way */
+int mutex_try_lock(tcb_t *thread, kmutex_t *mutex);
+
+/** @brief takes a unit from a semaphore known to be valid */
+int sem_take(ksem_t *sem, uint32_t timeout);
+
+/** @brief returns a unit to a semaphore known to be valid */
+void sem_give(ksem_t *sem);
+
+/** @brief makes a thread the holder of a free mutex */
+void mutex_grant(tcb_t *thread, kmutex_t *mutex);
+
+/** @brief unlocks a mutex held by a thread and hands it to the threads waiting on it */
+void mutex_release(tcb_t *thread, kmutex_t *mutex);
+
+/** @brief queues a blocked thread on a kernel object */
+void wait_enqueue(wait_queue_t *queue, tcb_t *thread);
+
+/** @brief takes the highest priority thread waiting on a kernel object */
+tcb_t *wait_dequeue(wait_queue_t *queue);
+
+/** @brief takes a thread off the kernel object it waits on */
+void wait_remove(tcb_t *thread);
+
+/** @brief blocks the running thread on a kernel object, with a timeout */
+void wait_block(wait_queue_t *queue, uint32_t timeout);
+
+/** @brief makes a thread taken off its wait queue runnable again */
+void wait_wake(tcb_t *thread, uint32_t result);
+
+/** @brief flags of an event that satisfy a wait, 0 if the wait goes on */
+uint32_t event_match(uint32_t flags, uint32_t mask, uint32_t mode);
+
+/** @brief adds a lock's blocking time to its mutex's statistics */
+void mutex_record_block(kmutex_t *mutex, uint32_t ticks, int waited);
+
+/** @brief unlocks every mutex a dying thread still holds */
+void mutex_release_all(tcb_t *thread);
+
+/** @brief locks, in the kernel, the user mutexes a thread locked in user space */
+int umutex_adopt(tcb_t *thread);
 
-/** @brief current state of whether thread is pending to use mutex */
-int get_pending_state(kmutex_t *mutex, uint32_t thread_id);
+/** @brief takes a free or queued buffer of a message queue for the running thread */
+void *mq_take(kmqueue_t *mq, int queued, uint32_t timeout);
 
-/** @brief returns whether another mutex with a priorty <= thread_prio is locked by a different thread */
-int locked_geq_prio_mutex(tcb_t *thread);
+/** @brief index of a message queue buffer the running thread owns */
+int mq_owned_slot(kmqueue_t *mq, void *buf);
 
-/** @brief returns next highest dynamic priority after a thread has unlocked mutex */
-int get_fallback_prio(tcb_t *thread);
+/** @brief queues a message queue buffer, or hands it to a waiting receiver */
+void mq_push(kmqueue_t *mq, uint32_t slot);
+
+/** @brief frees a message queue buffer, or hands it to a waiting sender */
+void mq_put_free(kmqueue_t *mq, uint32_t slot);
+
+/** @brief copies a message between a queue buffer and a thread */
+void mq_copy(void *dst, const void *src, uint32_t size);
+
+/** @brief frees every message queue buffer a dying thread still owns */
+void mq_release_all(tcb_t *thread);
+
+/** @brief returns a mutex locked by a different thread with a ceiling at or above the thread's priority */
+kmutex_t *ceiling_blocker(tcb_t *thread);
+
+/** @brief adds a locked mutex to the ceiling map */
+void ceiling_insert(kmutex_t *mutex);
+
+/** @brief removes an unlocked mutex from the ceiling map */
+void ceiling_remove(kmutex_t *mutex);
+
+/** @brief pushes a locked mutex on its holder's stack */
+void held_push(tcb_t *thread, kmutex_t *mutex);
+
+/** @brief takes an unlocked mutex off its holder's stack */
+void held_remove(tcb_t *thread, kmutex_t *mutex);
+
+/** @brief priority a thread runs at given the mutexes it holds */
+uint32_t held_prio(tcb_t *thread);
 
 /** @brief returns current priority of a thread */
 uint32_t get_curr_prio(uint32_t thread_id);
 
 uint32_t is_using_mutex(uint32_t thread_id);
 
+/** @brief changes a thread's state, keeping the ready lists in sync */
+void set_thread_state(tcb_t *thread, thread_state state);
+
+/** @brief changes a thread's dynamic priority, keeping the ready lists in sync */
+void set_dyn_prio(tcb_t *thread, uint32_t prio);
+
+/** @brief stretches the current tick up to the next release while idle */
+void tickless_enter();
+
+/** @brief ends a tickless sleep early, crediting the ticks that have passed */
+void tickless_exit();
+
+/** @brief ticks that have passed so far in the current tickless sleep */
+uint32_t tickless_elapsed();
+
+/** @brief finds a thread by the priority it was created with, live ones first */
+tcb_t *find_thread_by_prio(uint32_t prio);
+
+/** @brief cycles the running thread has run, its current slice included */
+uint64_t active_thread_cycles();
+
+/** @brief zeroes every cycle counter and starts a new slice for the running thread */
+void reset_cycle_accounting();
+
+/** @brief highest priority with a non-empty ready list, NUM_PRIOS if none */
+uint32_t ready_top_prio();
+
+/** @brief appends (or prepends) a thread to the ready list of its priority */
+void ready_enqueue(tcb_t *thread, int at_head);
+
+/** @brief unlinks a thread from its ready list */
+void ready_dequeue(tcb_t *thread);
+
+/** @brief inserts a ready thread into the EDF heap by its deadline */
+void deadline_enqueue(tcb_t *thread);
+
+/** @brief removes a thread from the EDF heap */
+void deadline_dequeue(tcb_t *thread);
+
+/** @brief moves a thread in the EDF heap to its new deadline */
+void deadline_requeue(tcb_t *thread);
+
+/** @brief whether a thread in a state belongs on a ready list */
+static int is_ready_state(thread_state state);
+
+#ifdef PROFILE
+/** @brief reference O(threads x mutexes) scheduler the ready map replaced */
+tcb_t *get_next_thread_scan();
+#endif
+
 
 /**
  * @brief  called when systick counter reaches 0, runs the scheduler, updates thread tick counts
  */
 void systick_c_handler(){
-  gcb.tick_count++;
+  irq_enter();
+  PROF_START(tick_start);
+  //A tickless sleep ends on the tick of the earliest release
+  if (gcb.sleep_ticks){
+    gcb.tick_count += gcb.sleep_ticks;
+    gcb.sleep_ticks = 0;
+  } else {
+    gcb.tick_count++;
+  }
   update_thread_times();
-  pend_pendsv();
+  time_page_publish();
+  //Most ticks leave the running thread in place, skip PendSV for those
+  if (switch_needed()) pend_pendsv();
+  //The scan and the dump wait for the idle thread, they would delay a release here
+  if (gcb.active_id == IDLE_THREAD_IDX) _time_page.idle_work |= IDLE_WORK_STACKS;
+  if (uart_poll_command(STATS_DUMP_CMD)) _time_page.idle_work |= IDLE_WORK_DUMP;
+  PROF_END(PROF_SYSTICK, tick_start);
+  irq_exit();
+}
+
+/**
+ * @brief  PendSV fast path, called before any context is saved. Pends from
+ *         syscalls that end up re-selecting the running thread return here
+ *         without the full save and restore.
+ *
+ * @return 0 if the running thread keeps running, non-zero to switch
+ */
+int pendsv_switch_needed(){
+  irq_enter();
+  PROF_START(check_start);
+  int needed = switch_needed();
+  if (!needed) PROF_END(PROF_PENDSV_SKIP, check_start);
+  irq_exit();
+  return needed;
 }
 
 /**
@@ -192,6 +523,8 @@ void systick_c_handler(){
  * @param  curr_msp     the current main stack pointer, which is passed in the asm handler
  */
 void *pendsv_c_handler(void *curr_msp){ 
+    irq_enter();
+    PROF_START(switch_start);
     clear_pendsv();
 
 
@@ -202,6 +535,13 @@ void *pendsv_c_handler(void *curr_msp){
     tcb_t *last_thread = &gcb.tcbs[gcb.active_id];
 
     last_thread->msp = curr_msp;
+
+    //The asm handler saved s16-s31 if the thread had FPU state, remember it
+    callee_stack_frame *saved = curr_msp;
+    if (fp_active || !(saved->lr & EXC_RETURN_BASIC_FRAME)) last_thread->fp_used = 1;
+
+    //Bill the slice that just ended, less the handlers that interrupted it
+    last_thread->cycles += (uint32_t)(read_cycle_counter() - gcb.slice_start) - (irq_cycles - gcb.irq_mark);
     
     //Store SVC status to restore later
     int svc_status = get_svc_status();
@@ -211,7 +551,18 @@ void *pendsv_c_handler(void *curr_msp){
       last_thread->svc_status = 0;
     }
 
-   tcb_t *next_thread = get_next_thread();
+    PROF_START(pick_start);
+    tcb_t *next_thread = get_next_thread();
+    PROF_END(PROF_SCHED_PICK, pick_start);
+#ifdef PROFILE
+    if (!gcb.edf){
+      PROF_START(scan_start);
+      tcb_t *scan_thread = get_next_thread_scan();
+      PROF_END(PROF_SCHED_PICK_SCAN, scan_start);
+      if (scan_thread != next_thread) prof_pick_mismatch++;
+    }
+#endif
+
     if (next_thread == NULL){
       //All threads have finished executing, return to main
       if (gcb.num_inactive > 0 && gcb.num_inactive == gcb.next - USER_THREAD_FIRST_IDX){
@@ -220,24 +571,44 @@ void *pendsv_c_handler(void *curr_msp){
       } else {
         //Schedule idle thread while others are asleep
         next_thread = &gcb.tcbs[IDLE_THREAD_IDX];
+        if (gcb.tickless && !gcb.sleep_ticks) tickless_enter();
       }
-    } 
+    } else if (gcb.sleep_ticks){
+      tickless_exit();
+    }
 
     if(mem_fault) sys_thread_kill();
 
     if(next_thread->id != last_thread->id && !mem_fault)
         switch_mem_protect(next_thread);
 
+    //First run of a job, its release latency
+    if (next_thread->id >= USER_THREAD_FIRST_IDX && !next_thread->job_started){
+      uint32_t latency = gcb.tick_count - (next_thread->next_deadline - next_thread->T);
+      if (latency < next_thread->stats.min_latency) next_thread->stats.min_latency = latency;
+      if (latency > next_thread->stats.max_latency) next_thread->stats.max_latency = latency;
+      next_thread->job_started = 1;
+    }
+
     ret_msp = next_thread->msp;
     gcb.active_id = next_thread->id;
+    time_page_publish();
+    fp_active = next_thread->fp_used;
 
     //Caller function may have/not changed curr thread state
-    if (last_thread->state == RUNNING) last_thread->state = RUNNABLE;
-    next_thread->state = RUNNING;
+    if (last_thread->state == RUNNING) set_thread_state(last_thread, RUNNABLE);
+    set_thread_state(next_thread, RUNNING);
 
     set_svc_status(next_thread->svc_status);
     // printk("Old thread was %d, new thread is %d, arr size is %d\n", last_thread->id, next_thread->id, gcb.next);
 
+    //The next slice starts once this handler's own time has been counted
+    irq_exit();
+    uint32_t now = read_cycle_counter();
+    gcb.elapsed += (uint32_t)(now - gcb.slice_start);
+    gcb.slice_start = now;
+    gcb.irq_mark = irq_cycles;
+    PROF_END(PROF_PENDSV, switch_start);
 
     return ret_msp;
 }
@@ -246,23 +617,68 @@ void *pendsv_c_handler(void *curr_msp){
 int sys_thread_init(uint32_t max_threads, uint32_t stack_size, void *idle_fn, 
 protection_mode memory_protection, uint32_t max_mutexes){
 
-  if (stack_overflows(max_threads, stack_size)) return -1;
+  if (max_threads > THREAD_CAPACITY || max_mutexes > MUTEX_CAPACITY) return -1;
+  //A user supplied idle function gets a stack of its own
+  uint32_t k_end;
+  if (stack_overflows(max_threads + (idle_fn ? 1 : 0), stack_size, memory_protection & PER_THREAD, &k_end)) return -1;
 
   /** set all threads to inactive, and set IDs*/
+  gcb.tcbs = tcb_table;
+  gcb.mutexes = mutex_table;
+  gcb.release_nodes = release_table;
+  gcb.deadline_nodes = deadline_table;
+  gcb.timeout_nodes = timeout_table;
+  gcb.sems = sem_table;
+  gcb.events = event_table;
+  gcb.mqueues = mqueue_table;
   gcb.max_threads = max_threads;
-  gcb.stack_size = 1 << mm_log2ceil_size(stack_size);
+  gcb.stack_size = stack_size;
   gcb.tick_count = 0;
   gcb.next = 0;
   gcb.num_mutexes = 0;
+  gcb.num_umutexes = 0;
+  gcb.umutex_held = NULL;
   gcb.max_mutexes = max_mutexes;
+  gcb.num_sems = 0;
+  gcb.uart_rx.count = 0;
+  gcb.uart_rx.waiters.head = NULL;
+  gcb.uart_rx.waiters.tail = NULL;
+  gcb.num_events = 0;
+  gcb.num_mqueues = 0;
+  //Queue buffers take the kernel stack space no thread can be given
+  gcb.mq_pool_floor = k_end;
+  gcb.mq_pool_low = (uint32_t)&__thread_k_stacks_top;
   gcb.active_id = MAIN_THREAD_IDX;
   gcb.num_inactive = 0;
   gcb.u_stack_next = (uint32_t)&__thread_u_stacks_low;
   gcb.k_stack_next = (uint32_t)&__thread_k_stacks_low;
+  for (int i = 0; i < PRIO_WORDS; i++) gcb.ready_map[i] = 0;
+  gcb.tickless = (memory_protection & TICKLESS) ? 1 : 0;
+  gcb.edf = (memory_protection & SCHED_EDF) ? 1 : 0;
+  gcb.per_thread = (memory_protection & PER_THREAD) ? 1 : 0;
+  gcb.stack_sample = IDLE_THREAD_IDX;
+  gcb.rta_valid = 1;
+  gcb.rta_blocking = 0;
+  pq_init(&gcb.deadline_q, gcb.deadline_nodes, TCB_CAPACITY);
+  gcb.sleep_ticks = 0;
+  pq_init(&gcb.release_q, gcb.release_nodes, TCB_CAPACITY);
+  pq_init(&gcb.timeout_q, gcb.timeout_nodes, TCB_CAPACITY);
+  for (int i = 0; i < NUM_PRIOS; i++){
+    gcb.ready_head[i] = NULL;
+    gcb.ready_tail[i] = NULL;
+    gcb.ceil_head[i] = NULL;
+  }
+  for (int i = 0; i < PRIO_WORDS; i++) gcb.ceil_map[i] = 0;
   set_default_threads(idle_fn);
+  _time_page.idle_work = 0;
+  _time_page.umutex_held = NULL;
+  time_page_publish();
 
-  if(memory_protection == PER_THREAD) mm_enable();
-  else mm_disable();
+  //Stack guards need the MPU in both modes. KERNEL_ONLY gives user code
+  //the whole address space in place of the heap region, as with the MPU off
+  if (!gcb.per_thread) mm_region_enable(4, (void *)0, 32, 1, 1);
+  switch_mem_protect(&gcb.tcbs[MAIN_THREAD_IDX]);
+  mm_enable();
 
   return 0;
 }
@@ -280,8 +696,11 @@ protection_mode memory_protection, uint32_t max_mutexes){
  * @return 0 on success, -1 on failure
  */
 int sys_thread_create(void *fn, uint32_t prio, uint32_t C, uint32_t T, void *vargp){
-    if (!is_schedulable(C, T)) return -1;
+    if (prio >= NUM_PRIOS) return -1;
     if ((int)gcb.next - USER_THREAD_FIRST_IDX - (int)gcb.num_inactive + 1 > (int)gcb.max_threads) return -1;
+    //The admission test commits the new bounds, so nothing after it may refuse the thread
+    tcb_t cand = { .static_prio = prio, .C = C, .T = T };
+    if (!is_schedulable(&cand)) return -1;
     
     tcb_t *new_thread;
 
@@ -289,15 +708,13 @@ int sys_thread_create(void *fn, uint32_t prio, uint32_t C, uint32_t T, void *var
     if ((int)gcb.next - USER_THREAD_FIRST_IDX < (int)gcb.max_threads){
       new_thread = &gcb.tcbs[gcb.next];
       new_thread->id = gcb.next++;
+      new_thread->state = INACTIVE;
+      pq_node_init(&new_thread->release_node);
+      pq_node_init(&new_thread->deadline_node);
+      pq_node_init(&new_thread->timeout_node);
       
       //MSP and PSP stacks setup
-      gcb.k_stack_next += gcb.stack_size * 4;
-      new_thread->msp = (void*)gcb.k_stack_next;
-      new_thread->k_stack_high = gcb.k_stack_next;
-
-      gcb.u_stack_next += gcb.stack_size * 4;
-      new_thread->psp = (void*)gcb.u_stack_next;
-      new_thread->u_stack_high = gcb.u_stack_next;
+      place_stacks(new_thread);
     } else {
       //Utilize deactivated thread data structure and maintain some properties
       new_thread = find_inactive_thread();
@@ -310,14 +727,29 @@ int sys_thread_create(void *fn, uint32_t prio, uint32_t C, uint32_t T, void *var
     new_thread->T = T;
     new_thread->running_C = 0;
     new_thread->total_C = 0;
-    new_thread->last_deadline = gcb.tick_count;
     new_thread->next_deadline = gcb.tick_count + T;
     new_thread->static_prio = prio;
     new_thread->dyn_prio = new_thread->static_prio;
-    new_thread->state = RUNNABLE;
     new_thread->svc_status = 0;
+    new_thread->rta_R = cand.rta_R;
+    new_thread->stats.jobs = 0;
+    new_thread->stats.deadline_misses = 0;
+    new_thread->stats.overruns = 0;
+    new_thread->stats.wcrt = 0;
+    new_thread->stats.min_latency = UINT32_MAX;
+    new_thread->stats.max_latency = 0;
+    new_thread->job_started = 0;
+    new_thread->overran = 0;
+    new_thread->cycles = 0;
+    new_thread->svc_cycles = 0;
+    new_thread->fp_used = 0;
+    new_thread->held = NULL;
+    new_thread->blocked_on = NULL;
+    new_thread->wait_next = NULL;
+    new_thread->wait_prev = NULL;
 
     setup_init_stack_frame(new_thread, fn, vargp);
+    set_thread_state(new_thread, RUNNABLE);
 
     return 0;
 }
@@ -329,6 +761,8 @@ int sys_thread_create(void *fn, uint32_t prio, uint32_t C, uint32_t T, void *var
 */
 int sys_scheduler_start(uint32_t frequency){
     uint32_t systickDiv= 16000000/frequency;
+    gcb.tick_cycles = systickDiv + 1;
+    reset_cycle_accounting();
     timer_start(systickDiv);
 	pend_pendsv();
 	return 0; 
@@ -348,7 +782,7 @@ uint32_t sys_get_priority(){
  * @return the time passed since the scheduler started (unit of ticks)
 */
 uint32_t sys_get_time(){
-    return gcb.tick_count;
+    return gcb.tick_count + tickless_elapsed();
 }
 
 /**
@@ -377,7 +811,12 @@ void sys_thread_kill(){
   //if a memory fault occurs un-set it
   if(mem_fault) mem_fault=0;
 
-  curr_thread->state= INACTIVE;
+  //A lazy FPU save still pending belongs to this thread's last exception frame
+  fpu_discard_lazy_state();
+
+  mutex_release_all(curr_thread);
+  mq_release_all(curr_thread);
+  set_thread_state(curr_thread, INACTIVE);
   gcb.num_inactive++;
   pend_pendsv();
 }
@@ -392,12 +831,233 @@ void sys_wait_until_next_period(){
   
   //Active thread yields remaining computation time
   if (curr_thread->state == RUNNING) {
-    curr_thread->state = WAITING;
+    uint32_t response = gcb.tick_count - (curr_thread->next_deadline - curr_thread->T);
+    if (response > curr_thread->stats.wcrt) curr_thread->stats.wcrt = response;
+    curr_thread->stats.jobs++;
+    set_thread_state(curr_thread, WAITING);
     pend_pendsv();
   }
 
 }
 
+/**
+ * @brief  blocks the running thread for a number of ticks
+ * @param  ticks    ticks to sleep
+ * @return 0 once woken, -1 for main and idle
+*/
+int sys_sleep_ticks(uint32_t ticks){
+  return sys_sleep_until(gcb.tick_count + ticks);
+}
+
+/**
+ * @brief  blocks the running thread until a tick. It waits on the timeout
+ *         queue with no object to be woken by, so the tick handler wakes it
+ *         and the idle thread's tickless sleep already ends in time for it.
+ * @param  tick     tick to wake at
+ * @return 0 once woken, -1 for main and idle
+*/
+int sys_sleep_until(uint32_t tick){
+  tcb_t *curr_thread = &gcb.tcbs[gcb.active_id];
+  //Main and idle never block
+  if (curr_thread->id < USER_THREAD_FIRST_IDX) return -1;
+
+  int irq_state = save_interrupt_state_and_disable();
+  if (TICK_BEFORE(gcb.tick_count, tick)){
+    curr_thread->wait_result = 0;
+    wait_block(NULL, tick - gcb.tick_count);
+  }
+  restore_interrupt_state(irq_state);
+  return 0;
+}
+
+/**
+ * @brief  copies out a thread's statistics, looked up by static priority
+ * @param  prio     priority the thread was created with
+ * @param  stats    where to store the statistics
+ * @return 0 on success, -1 if no thread was created with that priority
+*/
+int sys_thread_stats(uint32_t prio, thread_stats_t *stats){
+  if (!MM_USER_WRITABLE(stats)) return -1;
+  tcb_t *found = find_thread_by_prio(prio);
+  if (found == NULL) return -1;
+
+  *stats = found->stats;
+  return 0;
+}
+
+/**
+ * @brief  copies out a thread's peak stack use, looked up by static priority
+ * @param  prio     priority the thread was created with
+ * @param  usage    where to store the stack use
+ * @return 0 on success, -1 if no thread was created with that priority
+*/
+int sys_thread_stack_usage(uint32_t prio, stack_usage_t *usage){
+  if (!MM_USER_WRITABLE(usage)) return -1;
+  tcb_t *found = find_thread_by_prio(prio);
+  if (found == NULL) return -1;
+
+  stack_peaks_update(found);
+  usage->user_size = found->u_stack_high - stack_floor(found, 1);
+  usage->user_peak = found->u_stack_peak;
+  usage->kernel_size = found->k_stack_high - stack_floor(found, 0);
+  usage->kernel_peak = found->k_stack_peak;
+  return 0;
+}
+
+/**
+ * @brief  reads one of the CPU cycle counters
+ * @param  counter  which counter to read
+ * @param  prio     thread priority, for CPU_THREAD and CPU_THREAD_SVC
+ * @return the cycle count, 0 if no thread has that priority
+*/
+uint64_t sys_cpu_cycles(cpu_counter_t counter, uint32_t prio){
+  tcb_t *thread;
+
+  switch (counter){
+    case CPU_THREAD:
+      thread = find_thread_by_prio(prio);
+      if (thread == NULL) return 0;
+      if (thread->id == gcb.active_id) return active_thread_cycles();
+      return thread->cycles;
+    case CPU_THREAD_SVC:
+      thread = find_thread_by_prio(prio);
+      return thread ? thread->svc_cycles : 0;
+    case CPU_IDLE:
+      return gcb.tcbs[IDLE_THREAD_IDX].cycles;
+    case CPU_KERNEL:
+      return irq_cycles;
+    case CPU_TOTAL:
+      return gcb.elapsed + (uint32_t)(read_cycle_counter() - gcb.slice_start);
+    default:
+      return 0;
+  }
+}
+
+uint64_t svc_account_begin(){
+  return active_thread_cycles();
+}
+
+void svc_account_end(uint64_t start){
+  uint64_t now = active_thread_cycles();
+  //thread_init and scheduler_start reset the counters mid-call
+  if (now > start) gcb.tcbs[gcb.active_id].svc_cycles += now - start;
+}
+
+/**
+ * @brief  cycles the running thread has run. Only valid outside interrupt
+ *         handlers, as the one in progress is not in irq_cycles yet.
+ * @return the running thread's cycle count
+*/
+uint64_t active_thread_cycles(){
+  uint32_t slice = read_cycle_counter() - gcb.slice_start;
+  return gcb.tcbs[gcb.active_id].cycles + slice - (irq_cycles - gcb.irq_mark);
+}
+
+/**
+ * @brief  zeroes every cycle counter, so they all cover the same interval
+*/
+void reset_cycle_accounting(){
+  for (int i = 0; i < gcb.next; i++){
+    gcb.tcbs[i].cycles = 0;
+    gcb.tcbs[i].svc_cycles = 0;
+  }
+  irq_cycles = 0;
+  gcb.irq_mark = 0;
+  gcb.elapsed = 0;
+  gcb.slice_start = read_cycle_counter();
+}
+
+/**
+ * @brief  finds a thread by its static priority, preferring a live thread
+ *         over a killed one that had the same priority
+ * @param  prio     priority the thread was created with
+ * @return the thread, NULL if none was created with that priority
+*/
+tcb_t *find_thread_by_prio(uint32_t prio){
+  tcb_t *found = NULL;
+
+  for (int i = USER_THREAD_FIRST_IDX; i < gcb.next; i++){
+    tcb_t *thread = &gcb.tcbs[i];
+    if (thread->static_prio != prio) continue;
+    found = thread;
+    if (thread->state != INACTIVE) break;
+  }
+  return found;
+}
+
+/**
+ * @brief  a / b in tenths of a percent, in 32-bit arithmetic. Both values are
+ *         shifted down together until b fits in 22 bits, so the product below
+ *         cannot overflow and no 64-bit division helper is needed.
+ * @return 1000 * a / b, 0 if b is 0
+*/
+uint32_t permille(uint64_t a, uint64_t b){
+  while (b >> 22){
+    a >>= 1;
+    b >>= 1;
+  }
+  if (!b) return 0;
+  return (uint32_t)a * 1000 / (uint32_t)b;
+}
+
+/**
+ * @brief  runs the work SysTick left for the idle thread: a stack scan
+ *         after each tick that found the CPU idle, and the statistics dump
+ *         asked for with Ctrl-T. The idle thread makes this call when the
+ *         time page flags work, so both only take time no thread wanted,
+ *         and a released thread preempts them like any idle code.
+ * @return 0, or -1 if called by any thread but idle
+*/
+int sys_idle_work(){
+  if (gcb.active_id != IDLE_THREAD_IDX) return -1;
+
+  //SysTick may set more bits meanwhile, those wait for the next call
+  int irq_state = save_interrupt_state_and_disable();
+  uint32_t work = _time_page.idle_work;
+  _time_page.idle_work = 0;
+  restore_interrupt_state(irq_state);
+
+  if (work & IDLE_WORK_STACKS) stack_sample();
+  if (work & IDLE_WORK_DUMP) thread_stats_dump();
+  return 0;
+}
+
+/**
+ * @brief  prints the statistics of every user thread, on Ctrl-T from the
+ *         console, in the idle thread through sys_idle_work.
+*/
+void thread_stats_dump(){
+  uint64_t total = sys_cpu_cycles(CPU_TOTAL, 0);
+  uint32_t idle = permille(gcb.tcbs[IDLE_THREAD_IDX].cycles, total);
+  uint32_t kernel = permille(irq_cycles, total);
+
+  printk("---- thread stats at t=%u ----\n", gcb.tick_count);
+  printk("idle %u.%u%%, interrupts %u.%u%%\n", idle / 10, idle % 10, kernel / 10, kernel % 10);
+  printk("id\tprio\tC\tT\tjobs\tmiss\tover\twcrt\tlatency\tcpu%%\n");
+  for (int i = USER_THREAD_FIRST_IDX; i < gcb.next; i++){
+    tcb_t *thread = &gcb.tcbs[i];
+    thread_stats_t *stats = &thread->stats;
+    uint32_t min_latency = stats->min_latency == UINT32_MAX ? 0 : stats->min_latency;
+    uint32_t cpu = permille(thread->cycles, total);
+    printk("%d\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u-%u\t%u.%u%s\n", thread->id, thread->static_prio,
+           thread->C, thread->T, stats->jobs, stats->deadline_misses, stats->overruns,
+           stats->wcrt, min_latency, stats->max_latency, cpu / 10, cpu % 10,
+           thread->state == INACTIVE ? " (killed)" : "");
+  }
+
+  stack_report();
+
+  if (gcb.num_mutexes == 0) return;
+  printk("mutex\tceil\tlocks\tblocked\tmax\tblocking 0,1,2-3,..,64+\n");
+  for (uint32_t i = 0; i < gcb.num_mutexes; i++){
+    mutex_stats_t *stats = &gcb.mutexes[i].stats;
+    printk("%d\t%u\t%u\t%u\t%u\t", gcb.mutexes[i].id, gcb.mutexes[i].prio_ceil,
+           stats->locks, stats->blocked, stats->max_block);
+    for (int b = 0; b < MUTEX_HIST_BUCKETS; b++) printk(b ? ",%u" : "%u", stats->hist[b]);
+    printk("\n");
+  }
+}
+
 /**
  * @brief  initialize a mutex at a given priority ceiling
  * @param  max_prio max priority at which to init the  mutex
@@ -410,7 +1070,20 @@ kmutex_t *sys_mutex_init( uint32_t max_prio ) {
   mutex->id =  gcb.num_mutexes++;
   mutex->prio_ceil = max_prio;
   mutex->locked_by =  -1;
-  mutex->pending = 0;
+  mutex->waiters.head = NULL;
+  mutex->waiters.tail = NULL;
+  mutex->held_next = NULL;
+  mutex->held_prev = NULL;
+  mutex->ceil_next = NULL;
+  mutex->ceil_prev = NULL;
+  mutex->locked_at = 0;
+  mutex->max_hold = 0;
+  mutex->low_holder = 0;
+  mutex->uword = NULL;
+  mutex->stats.locks = 0;
+  mutex->stats.blocked = 0;
+  mutex->stats.max_block = 0;
+  for (int i = 0; i < MUTEX_HIST_BUCKETS; i++) mutex->stats.hist[i] = 0;
   return mutex;
 }
 
@@ -422,12 +1095,16 @@ void sys_mutex_lock( kmutex_t *mutex ) {
   tcb_t *curr_thread = &gcb.tcbs[gcb.active_id];
   if (curr_thread->id == IDLE_THREAD_IDX) return;
   
-  //Abort thread if it dishonors mutex priority
+  //Abort thread if it passes no mutex or dishonors mutex priority, through
+  //the one kill path that also drops its lazy FPU state and message buffers
+  if (!TABLE_ENTRY(mutex, gcb.mutexes, gcb.num_mutexes)){
+    printk("Error: Thread locked no mutex\n");
+    sys_thread_kill();
+    return;
+  }
   if (curr_thread->static_prio < mutex->prio_ceil){
-    curr_thread->state = INACTIVE;
-    gcb.num_inactive++;
     printk("Error: Thread cannot lock mutex %d \n", mutex->id);
-    pend_pendsv();
+    sys_thread_kill();
     return;
   }
 
@@ -436,15 +1113,17 @@ void sys_mutex_lock( kmutex_t *mutex ) {
     return;
   }
   
-  if (mutex->locked_by == -1 && !locked_geq_prio_mutex(curr_thread)){
-    mutex->locked_by = curr_thread->id;
-    if (mutex->prio_ceil < curr_thread->dyn_prio) curr_thread->dyn_prio = mutex->prio_ceil;
+  //A syscall preempted by PendSV may interleave with another thread's lock or unlock
+  int irq_state = save_interrupt_state_and_disable();
+  curr_thread->wait.lock.start = gcb.tick_count;
+  if (mutex_try_lock(curr_thread, mutex)){
+    mutex_record_block(mutex, 0, 0);
   } else {
-    //Acknowledge lock request in mutex's pending bit vector. Swap out thread
-    set_pending_state(mutex, curr_thread->id, 1);
-    curr_thread->state = BLOCKED;
+    //Swap out until an unlock hands the mutex over
+    set_thread_state(curr_thread, BLOCKED);
     pend_pendsv();
   }
+  restore_interrupt_state(irq_state);
 }
 
 /**
@@ -455,114 +1134,949 @@ void sys_mutex_unlock( kmutex_t *mutex ) {
   tcb_t *curr_thread = &gcb.tcbs[gcb.active_id];
   if (curr_thread->id == IDLE_THREAD_IDX) return;
 
+  //Refused, not killed: a batch may hold the unlock, and would go on running for a dead thread
+  if (!TABLE_ENTRY(mutex, gcb.mutexes, gcb.num_mutexes)){
+    printk("Warning: Thread unlocked no mutex\n");
+    return;
+  }
   if (mutex->locked_by != curr_thread->id){
     printk("Warning: mutex resource %d not locked by thread\n", mutex->id);
     return;
   }
   
-  mutex->locked_by = -1;
-  int fallback_prio = get_fallback_prio(curr_thread);
-  if (fallback_prio != -1) curr_thread->dyn_prio = fallback_prio;
-  else curr_thread->dyn_prio = curr_thread->static_prio;
+  int irq_state = save_interrupt_state_and_disable();
+  //Hold times feed the blocking terms of later admission tests, which may clear the flag meanwhile
+  uint32_t hold = gcb.tick_count - mutex->locked_at;
+  if (hold > mutex->max_hold || curr_thread->static_prio > mutex->low_holder) gcb.rta_blocking = 1;
+  if (hold > mutex->max_hold) mutex->max_hold = hold;
+  if (curr_thread->static_prio > mutex->low_holder) mutex->low_holder = curr_thread->static_prio;
+  mutex_release(curr_thread, mutex);
+  restore_interrupt_state(irq_state);
+}
 
-  //After unlocking, grant lock request to another thread
-  for (int i=USER_THREAD_FIRST_IDX; i < gcb.next; i++){
-    tcb_t *thread = &gcb.tcbs[i];
-    //Grant to thread that doesn't violate IPCP rules
-    if (get_pending_state(mutex, thread->id) && !locked_geq_prio_mutex(thread)){
-      mutex->locked_by = thread->id;
-      set_pending_state(mutex, thread->id, 0);
-      //Nested mutex might mean state is no longer in blocked because of earlier unlock
-      if (thread->state == BLOCKED) thread->state = RUNNABLE;
-      pend_pendsv();
-      break;
-    }
+/**
+ * @brief  IPCP lock attempt. A free mutex is granted unless another thread
+ *         holds a mutex whose ceiling is at or above the thread's priority.
+ *         Otherwise the thread waits on the mutex in its way, the one it
+ *         asked for if that is locked, the one setting the ceiling if not,
+ *         and retries once that mutex is unlocked.
+ *
+ * @param  thread   the thread asking for the mutex
+ * @param  mutex    the mutex to lock
+ * @return 1 if the thread now holds the mutex, 0 if it was queued
+ */
+int mutex_try_lock(tcb_t *thread, kmutex_t *mutex){
+  kmutex_t *blocker = mutex->locked_by == -1 ? ceiling_blocker(thread) : mutex;
+
+  if (blocker != NULL){
+    thread->wait.lock.want = mutex;
+    wait_enqueue(&blocker->waiters, thread);
+    return 0;
   }
-  
-}
 
-tcb_t *get_active_thread(){
-   tcb_t *curr_thread = NULL;
-    uint32_t i;
-    for(i=0; i<gcb.next; i++){
-        if (gcb.tcbs[i].state == RUNNING) {
-          curr_thread = &gcb.tcbs[i];
-          break;
-        }
-    }
-    return curr_thread;
+  mutex_grant(thread, mutex);
+  return 1;
 }
 
-tcb_t *get_next_thread(){
-  uint32_t max_prio = (1 << gcb.max_threads); //use high upper bound number
-  tcb_t *next_thread = NULL;
+/**
+ * @brief  makes a thread the holder of a free mutex, raising it to the
+ *         ceiling. Constant time apart from held_push's ceiling update.
+ *
+ * @param  thread   the new holder
+ * @param  mutex    the mutex, unlocked
+ */
+void mutex_grant(tcb_t *thread, kmutex_t *mutex){
+  mutex->locked_by = thread->id;
+  mutex->locked_at = gcb.tick_count;
+  //The store also fails an exclusive store a umutex holder may be in the middle of
+  if (mutex->uword != NULL) *mutex->uword = (thread->id + 1) | UMUTEX_KERNEL;
+  ceiling_insert(mutex);
+  held_push(thread, mutex);
+}
 
-  for (int i=USER_THREAD_FIRST_IDX; i < gcb.next; i++){
-   tcb_t *thread = &gcb.tcbs[i];
-    if ((thread->state == RUNNABLE || thread->state == RUNNING)){
-      uint32_t thread_prio = get_curr_prio(thread->id);
-      if (thread_prio < max_prio){
-        max_prio = thread_prio;
-        next_thread = thread;
-      } else if (thread_prio == max_prio && next_thread != NULL){
-        /* An escalated thread causing priority conflicts should be run first if it uses a mutex
-        Ensures thread is only blocked once initially as is protocol with IPCP */
-        if (is_using_mutex(thread->id)) next_thread = thread;
-      }
+/**
+ * @brief  unlocks a mutex, dropping the holder back to the priority of what
+ *         it still holds, and hands it to the head of its wait queue, the
+ *         highest priority waiter, taken in constant time. Normally that
+ *         head asked for this mutex and takes it, ending the handoff. A
+ *         head stopped by this mutex's ceiling rather than asking for it
+ *         retries its own lock instead, and one that another ceiling still
+ *         stops moves to that mutex's queue. Then the next head is tried,
+ *         so each extra step wakes or requeues one thread that outranks
+ *         whoever gets the mutex.
+ *
+ * @param  thread   the thread holding the mutex
+ * @param  mutex    the mutex to unlock
+ */
+void mutex_release(tcb_t *thread, kmutex_t *mutex){
+  mutex->locked_by = -1;
+  if (mutex->uword != NULL) *mutex->uword = 0;
+  ceiling_remove(mutex);
+  held_remove(thread, mutex);
+
+  tcb_t *waiter;
+  while (mutex->locked_by == -1 && (waiter = wait_dequeue(&mutex->waiters)) != NULL){
+    kmutex_t *want = waiter->wait.lock.want;
+    if (mutex_try_lock(waiter, want)){
+      mutex_record_block(want, gcb.tick_count - waiter->wait.lock.start, 1);
+      wait_wake(waiter, 0);
     }
   }
-
-  return next_thread;
 }
 
-int stack_overflows(uint32_t max_threads, uint32_t stack_size) {
-  uint32_t needed = max_threads *  (1 << mm_log2ceil_size(stack_size)) * 4;
-  uint32_t avail_u = (uint32_t)&__thread_u_stacks_top - (uint32_t)&__thread_u_stacks_low;
-  uint32_t avail_k = (uint32_t)&__thread_k_stacks_top - (uint32_t)&__thread_k_stacks_low;
+/**
+ * @brief  queues a blocked thread on a kernel object, behind every waiter
+ *         at its priority or above. The place is found from the tail, so
+ *         the cost is the number of lower priority threads already
+ *         waiting on the same object, none when waiters arrive highest
+ *         priority first or all share one priority.
+ *
+ * @param  queue    the object the thread waits on
+ * @param  thread   the blocked thread
+ */
+void wait_enqueue(wait_queue_t *queue, tcb_t *thread){
+  uint32_t prio = get_curr_prio(thread->id);
+  tcb_t *prev = queue->tail;
+
+  while (prev != NULL && prev->wait_prio > prio) prev = prev->wait_prev;
+
+  thread->blocked_on = queue;
+  thread->wait_prio = prio;
+  thread->wait_prev = prev;
+  thread->wait_next = prev != NULL ? prev->wait_next : queue->head;
+  if (thread->wait_next != NULL) thread->wait_next->wait_prev = thread;
+  else queue->tail = thread;
+  if (prev != NULL) prev->wait_next = thread;
+  else queue->head = thread;
+}
 
-  if (needed > avail_u || needed > avail_k) return 1;
-  return 0;  
+/**
+ * @brief  takes the highest priority thread waiting on a kernel object, the
+ *         first queued among equals, in constant time
+ *
+ * @param  queue    the object
+ * @return the waiter, NULL if there is none
+ */
+tcb_t *wait_dequeue(wait_queue_t *queue){
+  tcb_t *thread = queue->head;
+  if (thread != NULL) wait_remove(thread);
+  return thread;
 }
 
 /**
- * @brief initializes default and idle threads
- * @param  idle_fn     pointer to the idle function, or NULL if none provided
+ * @brief  takes a thread off the wait queue of its object in constant
+ *         time, for a grant, a timeout or a kill
  *
+ * @param  thread   the waiting thread
  */
-void set_default_threads(void *idle_fn) {
-  /* Function is called in thread_init. Consequently,invariant is that 
-    array idx 0 & 1 are assigned to main & idle threads respectively
-   */
- tcb_t *main_thread = &gcb.tcbs[gcb.next];
-  main_thread->id = gcb.next++;
-  main_thread->state = RUNNING;
+void wait_remove(tcb_t *thread){
+  wait_queue_t *queue = thread->blocked_on;
 
-  //Idle function thread setup similar to regular thread
- tcb_t *idle_thread = &gcb.tcbs[gcb.next];
-  idle_thread->id = gcb.next++;
-  idle_thread->state = RUNNABLE;
-  idle_thread->svc_status = 0;
-    
-  void *used_idle_fn = idle_fn;
+  if (thread->wait_prev != NULL) thread->wait_prev->wait_next = thread->wait_next;
+  else queue->head = thread->wait_next;
+  if (thread->wait_next != NULL) thread->wait_next->wait_prev = thread->wait_prev;
+  else queue->tail = thread->wait_prev;
 
-  extern void idle_default();
-  if (!used_idle_fn){
-      used_idle_fn = &idle_default;
-  }else{
-      gcb.k_stack_next += gcb.stack_size * 4;
-      gcb.u_stack_next += gcb.stack_size * 4;
-  }
+  thread->blocked_on = NULL;
+  thread->wait_next = NULL;
+  thread->wait_prev = NULL;
+}
 
-  idle_thread->msp = (void*)gcb.k_stack_next;
-  idle_thread->k_stack_high = gcb.k_stack_next;
-  idle_thread->psp = (void*)gcb.u_stack_next;
-  idle_thread->u_stack_high = gcb.u_stack_next;
+/**
+ * @brief  blocks the running thread on a semaphore or event. Called with
+ *         interrupts disabled, the switch happens once the caller restores
+ *         them, and the caller resumes when the thread is woken. The
+ *         thread's wait_result must already hold the timeout result.
+ *
+ * @param  queue    the object to wait on, NULL to only wait for the timeout
+ * @param  timeout  ticks until the wait gives up, WAIT_FOREVER for never
+ */
+void wait_block(wait_queue_t *queue, uint32_t timeout){
+  tcb_t *curr_thread = &gcb.tcbs[gcb.active_id];
 
-  setup_init_stack_frame(idle_thread, used_idle_fn, (void*)0);
+  if (queue != NULL) wait_enqueue(queue, curr_thread);
+  if (timeout != WAIT_FOREVER){
+    curr_thread->timeout_node.key = gcb.tick_count + timeout;
+    curr_thread->timeout_node.tie = curr_thread->id;
+    pq_insert(&gcb.timeout_q, &curr_thread->timeout_node);
+  }
+  set_thread_state(curr_thread, BLOCKED);
+  pend_pendsv();
 }
 
-void setup_init_stack_frame(tcb_t *thread, void *fn, void *vargp) {
-  /*Edit ARM-saved context to run function initally 
+/**
+ * @brief  wakes a thread already taken off its wait queue, cancelling its
+ *         timeout
+ *
+ * @param  thread   the woken thread
+ * @param  result   what its wait returns
+ */
+void wait_wake(tcb_t *thread, uint32_t result){
+  if (thread->timeout_node.pos != PQ_NONE) pq_remove(&gcb.timeout_q, &thread->timeout_node);
+  thread->wait_result = result;
+  set_thread_state(thread, RUNNABLE);
+  pend_pendsv();
+}
+
+/**
+ * @brief  adds one granted lock to a mutex's statistics
+ *
+ * @param  mutex    the mutex just locked
+ * @param  ticks    time from the lock call to the grant
+ * @param  waited   whether the thread was blocked, possibly for under a tick
+ */
+void mutex_record_block(kmutex_t *mutex, uint32_t ticks, int waited){
+  mutex_stats_t *stats = &mutex->stats;
+  uint32_t bucket = ticks ? 32 - count_leading_zeros(ticks) : 0;
+
+  if (bucket >= MUTEX_HIST_BUCKETS) bucket = MUTEX_HIST_BUCKETS - 1;
+  stats->hist[bucket]++;
+  stats->locks++;
+  if (waited) stats->blocked++;
+  if (ticks > stats->max_block) stats->max_block = ticks;
+}
+
+/**
+ * @brief  copies out a mutex's lock statistics
+ * @param  mutex    the mutex to report on
+ * @param  stats    where to store the statistics
+ * @return 0 on success, -1 if mutex is not an initialized mutex or stats
+ *         is not writable user memory
+*/
+int sys_mutex_stats(kmutex_t *mutex, mutex_stats_t *stats){
+  if (!TABLE_ENTRY(mutex, gcb.mutexes, gcb.num_mutexes) || !MM_USER_WRITABLE(stats)) return -1;
+
+  *stats = mutex->stats;
+  return 0;
+}
+
+/**
+ * @brief  unlocks the mutexes of a thread that is being killed, so the
+ *         threads waiting on them are not stranded
+ *
+ * @param  thread   the dying thread
+ */
+void mutex_release_all(tcb_t *thread){
+  int irq_state = save_interrupt_state_and_disable();
+  umutex_adopt(thread);
+  while (thread->held != NULL) mutex_release(thread, thread->held);
+  restore_interrupt_state(irq_state);
+}
+
+/**
+ * @brief  creates a user mutex backed by a kernel mutex. The first one also
+ *         takes the held maps from the user heap.
+ * @param  word      the lock word in user memory
+ * @param  max_prio  the priority ceiling
+ * @param  bit       where to store the mutex's bit in the held maps
+ * @return the kernel mutex, NULL if max_mutexes or UMUTEX_CAPACITY would be
+ *         exceeded, the heap is full or a pointer is not writable
+*/
+kmutex_t *sys_umutex_init(volatile uint32_t *word, uint32_t max_prio, uint32_t *bit){
+  if (gcb.num_umutexes >= UMUTEX_CAPACITY || !MM_USER_WRITABLE((uint32_t *)word) || !MM_USER_WRITABLE(bit)) return NULL;
+
+  //Every thread sets bits in its own map, so the maps sit where all of them reach
+  if (gcb.umutex_held == NULL){
+    uint8_t *heap = sys_sbrk(TCB_CAPACITY * 4 + 3);
+    if (heap == (void*)-1) return NULL;
+    gcb.umutex_held = (uint32_t*)(((uint32_t)heap + 3) & ~3U);
+    for (int i = 0; i < TCB_CAPACITY; i++) gcb.umutex_held[i] = 0;
+    _time_page.umutex_held = gcb.umutex_held;
+  }
+
+  kmutex_t *mutex = sys_mutex_init(max_prio);
+  if (mutex == NULL) return NULL;
+
+  *word = 0;
+  mutex->uword = word;
+  gcb.umutexes[gcb.num_umutexes] = mutex;
+  *bit = UMUTEX_BIT(gcb.num_umutexes++);
+  return mutex;
+}
+
+/**
+ * @brief  slow path of umutex_lock, taken when the lock word was not free.
+ *         Once a holder that locked in user space is taken over, the kernel
+ *         mutex decides exactly as for mutex_lock.
+ * @param  mutex    the kernel mutex of the user mutex
+ * @return 0 once locked, -1 if mutex is not a user mutex
+*/
+int sys_umutex_lock(kmutex_t *mutex){
+  if (!TABLE_ENTRY(mutex, gcb.mutexes, gcb.num_mutexes) || mutex->uword == NULL) return -1;
+
+  //Nothing may lock or unlock in user space between the take over and the lock
+  int irq_state = save_interrupt_state_and_disable();
+  uint32_t word = *mutex->uword;
+  uint32_t owner = word & UMUTEX_OWNER;
+  //Only the caller can hold it without the kernel knowing, every other thread was taken over when it was switched out
+  if (owner != 0 && owner <= gcb.next && !(word & UMUTEX_KERNEL)) umutex_adopt(&gcb.tcbs[owner - 1]);
+  sys_mutex_lock(mutex);
+  restore_interrupt_state(irq_state);
+  return 0;
+}
+
+/**
+ * @brief  slow path of umutex_unlock, taken when the kernel has locked the
+ *         mutex too
+ * @param  mutex    the kernel mutex of the user mutex
+ * @return 0 on success, -1 if mutex is not a user mutex
+*/
+int sys_umutex_unlock(kmutex_t *mutex){
+  if (!TABLE_ENTRY(mutex, gcb.mutexes, gcb.num_mutexes) || mutex->uword == NULL) return -1;
+  tcb_t *curr_thread = &gcb.tcbs[gcb.active_id];
+
+  int irq_state = save_interrupt_state_and_disable();
+  if (*mutex->uword == (uint32_t)curr_thread->id + 1) *mutex->uword = 0;
+  else sys_mutex_unlock(mutex);
+  restore_interrupt_state(irq_state);
+  return 0;
+}
+
+/**
+ * @brief  locks, in the kernel, every user mutex a thread locked in user
+ *         space, which raises it to their ceilings and makes its unlocks
+ *         trap. IPCP raises a thread as soon as it locks, but the raise
+ *         only changes the schedule when another thread would otherwise
+ *         run. So this is done when the thread is about to lose the CPU,
+ *         and a lock and unlock with nothing in between never trap. Only
+ *         the mutexes in the thread's held map are looked at, so a thread
+ *         holding none costs one load.
+ *
+ * @param  thread   the thread
+ * @return 1 if any mutex was taken over
+ */
+int umutex_adopt(tcb_t *thread){
+  if (gcb.umutex_held == NULL) return 0;
+  uint32_t self = thread->id + 1;
+  int adopted = 0;
+
+  int irq_state = save_interrupt_state_and_disable();
+  //A bit is set before the lock and cleared after the unlock, so it may be stale but is never missing
+  uint32_t held = gcb.umutex_held[thread->id];
+  while (held){
+    uint32_t i = count_leading_zeros(held);
+    held &= ~UMUTEX_BIT(i);
+    if (i >= gcb.num_umutexes || *gcb.umutexes[i]->uword != self) continue;
+
+    mutex_grant(thread, gcb.umutexes[i]);
+    adopted = 1;
+  }
+  restore_interrupt_state(irq_state);
+  return adopted;
+}
+
+/**
+ * @brief  creates a semaphore
+ * @param  count    units initially available
+ * @return the semaphore, NULL if SEM_CAPACITY would be exceeded
+*/
+ksem_t *sys_sem_init(uint32_t count){
+  if (gcb.num_sems >= SEM_CAPACITY) return NULL;
+
+  ksem_t *sem = &gcb.sems[gcb.num_sems];
+  sem->id = gcb.num_sems++;
+  sem->count = count;
+  sem->waiters.head = NULL;
+  sem->waiters.tail = NULL;
+  return sem;
+}
+
+/**
+ * @brief  takes a unit from a semaphore, blocking until one is posted
+ * @param  sem      the semaphore
+ * @param  timeout  ticks to wait at most, 0 to not wait, WAIT_FOREVER
+ * @return 0 once a unit was taken, -1 on timeout or a bad semaphore
+*/
+int sys_sem_wait(ksem_t *sem, uint32_t timeout){
+  if (!TABLE_ENTRY(sem, gcb.sems, gcb.num_sems)) return -1;
+  return sem_take(sem, timeout);
+}
+
+/**
+ * @brief  sys_sem_wait on a semaphore known to be valid, the kernel's own
+ *         included
+ * @param  sem      the semaphore
+ * @param  timeout  ticks to wait at most, 0 to not wait, WAIT_FOREVER
+ * @return 0 once a unit was taken, -1 on timeout or if the caller may not block
+*/
+int sem_take(ksem_t *sem, uint32_t timeout){
+  tcb_t *curr_thread = &gcb.tcbs[gcb.active_id];
+
+  int irq_state = save_interrupt_state_and_disable();
+  if (sem->count > 0){
+    sem->count--;
+    restore_interrupt_state(irq_state);
+    return 0;
+  }
+  //Main and idle never block
+  if (timeout == 0 || curr_thread->id < USER_THREAD_FIRST_IDX){
+    restore_interrupt_state(irq_state);
+    return -1;
+  }
+
+  //A post hands its unit straight to the woken thread
+  curr_thread->wait_result = (uint32_t)-1;
+  wait_block(&sem->waiters, timeout);
+  restore_interrupt_state(irq_state);
+  return (int)curr_thread->wait_result;
+}
+
+/**
+ * @brief  returns a unit to a semaphore, waking its highest priority waiter
+ *         instead if there is one. Safe in interrupt handlers.
+ * @param  sem      the semaphore
+ * @return 0 on success, -1 on a bad semaphore
+*/
+int sys_sem_post(ksem_t *sem){
+  if (!TABLE_ENTRY(sem, gcb.sems, gcb.num_sems)) return -1;
+  sem_give(sem);
+  return 0;
+}
+
+/**
+ * @brief  sys_sem_post on a semaphore known to be valid, the kernel's own
+ *         included. Safe in interrupt handlers.
+ * @param  sem      the semaphore
+*/
+void sem_give(ksem_t *sem){
+  int irq_state = save_interrupt_state_and_disable();
+  tcb_t *waiter = wait_dequeue(&sem->waiters);
+  if (waiter != NULL) wait_wake(waiter, 0);
+  else if (sem->count != UINT32_MAX) sem->count++;
+  restore_interrupt_state(irq_state);
+}
+
+/**
+ * @brief  a received byte is waiting for sys_read, wakes the thread reading.
+ *         Called by the UART receive interrupt and by SysTick's console
+ *         poll, which picks up bytes while the interrupt is masked. With no
+ *         reader asleep the semaphore is left at 1, not counted up per
+ *         byte: that covers a byte landing between a read's check of the
+ *         UART and its sleep, and a later read checks at most once more.
+*/
+void uart_rx_post(){
+  int irq_state = save_interrupt_state_and_disable();
+  tcb_t *waiter = wait_dequeue(&gcb.uart_rx.waiters);
+  if (waiter != NULL) wait_wake(waiter, 0);
+  else gcb.uart_rx.count = 1;
+  restore_interrupt_state(irq_state);
+}
+
+/**
+ * @brief  sleeps in sys_read until uart_rx_post, instead of spinning on
+ *         the UART. A post may be for a byte already read, so the caller
+ *         checks again. Main and idle cannot block and return at once.
+*/
+void uart_rx_wait(){
+  sem_take(&gcb.uart_rx, WAIT_FOREVER);
+}
+
+/**
+ * @brief  creates an event flag group with every flag clear
+ * @return the group, NULL if EVENT_CAPACITY would be exceeded
+*/
+kevent_t *sys_event_init(){
+  if (gcb.num_events >= EVENT_CAPACITY) return NULL;
+
+  kevent_t *event = &gcb.events[gcb.num_events];
+  event->id = gcb.num_events++;
+  event->flags = 0;
+  event->waiters.head = NULL;
+  event->waiters.tail = NULL;
+  return event;
+}
+
+/**
+ * @brief  flags of an event that satisfy a wait
+ * @param  flags    flags currently set
+ * @param  mask     flags waited for
+ * @param  mode     EVENT_ANY or EVENT_ALL
+ * @return the flags of mask that are set, 0 if the wait is not satisfied
+*/
+uint32_t event_match(uint32_t flags, uint32_t mask, uint32_t mode){
+  uint32_t hit = flags & mask;
+  if ((mode & EVENT_ALL) && hit != mask) return 0;
+  return hit;
+}
+
+/**
+ * @brief  waits for flags of an event group
+ * @param  event    the group
+ * @param  mask     flags to wait for
+ * @param  mode     EVENT_ANY or EVENT_ALL, optionally | EVENT_CLEAR
+ * @param  timeout  ticks to wait at most, 0 to not wait, WAIT_FOREVER
+ * @return the flags of mask that were set, 0 on timeout or a bad group
+*/
+uint32_t sys_event_wait(kevent_t *event, uint32_t mask, uint32_t mode, uint32_t timeout){
+  if (!TABLE_ENTRY(event, gcb.events, gcb.num_events) || mask == 0) return 0;
+  tcb_t *curr_thread = &gcb.tcbs[gcb.active_id];
+
+  int irq_state = save_interrupt_state_and_disable();
+  uint32_t hit = event_match(event->flags, mask, mode);
+  if (hit || timeout == 0 || curr_thread->id < USER_THREAD_FIRST_IDX){
+    if (mode & EVENT_CLEAR) event->flags &= ~hit;
+    restore_interrupt_state(irq_state);
+    return hit;
+  }
+
+  //sys_event_set stores the flags that woke the thread
+  curr_thread->wait.event.mask = mask;
+  curr_thread->wait.event.mode = mode;
+  curr_thread->wait_result = 0;
+  wait_block(&event->waiters, timeout);
+  restore_interrupt_state(irq_state);
+  return curr_thread->wait_result;
+}
+
+/**
+ * @brief  sets flags of an event group and wakes every waiter they now
+ *         satisfy, highest priority first, so a clearing waiter consumes
+ *         the flags before lower priority ones see them. Safe in interrupt
+ *         handlers.
+ * @param  event    the group
+ * @param  flags    flags to set
+ * @return 0 on success, -1 on a bad group
+*/
+int sys_event_set(kevent_t *event, uint32_t flags){
+  if (!TABLE_ENTRY(event, gcb.events, gcb.num_events)) return -1;
+
+  int irq_state = save_interrupt_state_and_disable();
+  event->flags |= flags;
+  tcb_t *next;
+  for (tcb_t *thread = event->waiters.head; thread != NULL; thread = next){
+    next = thread->wait_next;
+    uint32_t hit = event_match(event->flags, thread->wait.event.mask, thread->wait.event.mode);
+    if (!hit) continue;
+    if (thread->wait.event.mode & EVENT_CLEAR) event->flags &= ~hit;
+    wait_remove(thread);
+    wait_wake(thread, hit);
+  }
+  restore_interrupt_state(irq_state);
+  return 0;
+}
+
+/**
+ * @brief  clears flags of an event group
+ * @param  event    the group
+ * @param  flags    flags to clear
+ * @return 0 on success, -1 on a bad group
+*/
+int sys_event_clear(kevent_t *event, uint32_t flags){
+  if (!TABLE_ENTRY(event, gcb.events, gcb.num_events)) return -1;
+
+  int irq_state = save_interrupt_state_and_disable();
+  event->flags &= ~flags;
+  restore_interrupt_state(irq_state);
+  return 0;
+}
+
+/**
+ * @brief  creates a message queue, carving its buffers down from the top of
+ *         the kernel stack arena, past the stacks thread_init left room for
+ * @param  msg_size  bytes per message, at most 64K
+ * @param  depth     buffers, 1 to MQUEUE_DEPTH_MAX
+ * @return the queue, NULL if the table or the buffer pool is full or a size is invalid
+*/
+kmqueue_t *sys_mq_init(uint32_t msg_size, uint32_t depth){
+  if (gcb.num_mqueues >= MQUEUE_CAPACITY) return NULL;
+  if (msg_size == 0 || msg_size > UINT16_MAX || depth == 0 || depth > MQUEUE_DEPTH_MAX) return NULL;
+
+  //Word-aligned buffers let mq_copy move a word at a time
+  uint32_t stride = (msg_size + 3) & ~3U;
+  if (stride * depth > gcb.mq_pool_low - gcb.mq_pool_floor) return NULL;
+  gcb.mq_pool_low -= stride * depth;
+
+  kmqueue_t *mq = &gcb.mqueues[gcb.num_mqueues];
+  mq->id = gcb.num_mqueues++;
+  mq->depth = depth;
+  mq->head = 0;
+  mq->count = 0;
+  mq->msg_size = msg_size;
+  mq->stride = stride;
+  mq->buffers = (uint8_t*)gcb.mq_pool_low;
+  mq->free_map = ~0U << (MQUEUE_DEPTH_MAX - depth);
+  for (uint32_t i = 0; i < depth; i++) mq->owner[i] = MQ_NO_OWNER;
+  mq->senders.head = NULL;
+  mq->senders.tail = NULL;
+  mq->receivers.head = NULL;
+  mq->receivers.tail = NULL;
+  return mq;
+}
+
+/**
+ * @brief  copies a message into a free buffer and queues it
+ * @param  mq       the queue
+ * @param  msg      msg_size bytes to send
+ * @param  timeout  ticks to wait for a free buffer, 0 to not wait, WAIT_FOREVER
+ * @return 0 once queued, -1 on timeout, a bad queue or a msg the caller cannot read
+*/
+int sys_mq_send(kmqueue_t *mq, const void *msg, uint32_t timeout){
+  if (!TABLE_ENTRY(mq, gcb.mqueues, gcb.num_mqueues) || !mm_user_range(msg, mq->msg_size, 0)) return -1;
+
+  void *buf = mq_take(mq, 0, timeout);
+  if (buf == NULL) return -1;
+
+  mq_copy(buf, msg, mq->msg_size);
+  return sys_mq_send_buf(mq, buf);
+}
+
+/**
+ * @brief  copies the oldest message out of a queue and frees its buffer
+ * @param  mq       the queue
+ * @param  msg      where to store msg_size bytes
+ * @param  timeout  ticks to wait for a message, 0 to not wait, WAIT_FOREVER
+ * @return 0 once received, -1 on timeout, a bad queue or a msg the caller
+ *         cannot write, which leaves the message queued
+*/
+int sys_mq_receive(kmqueue_t *mq, void *msg, uint32_t timeout){
+  if (!TABLE_ENTRY(mq, gcb.mqueues, gcb.num_mqueues) || !mm_user_range(msg, mq->msg_size, 1)) return -1;
+
+  void *buf = mq_take(mq, 1, timeout);
+  if (buf == NULL) return -1;
+
+  mq_copy(msg, buf, mq->msg_size);
+  return sys_mq_free(mq, buf);
+}
+
+/**
+ * @brief  takes a free buffer of a queue for the running thread to fill
+ * @param  mq       the queue
+ * @param  timeout  ticks to wait at most, 0 to not wait, WAIT_FOREVER
+ * @return the buffer, NULL on timeout, a bad queue, or under PER_THREAD,
+ *         where user code cannot reach the kernel's buffers
+*/
+void *sys_mq_alloc(kmqueue_t *mq, uint32_t timeout){
+  if (gcb.per_thread) return NULL;
+  return mq_take(mq, 0, timeout);
+}
+
+/**
+ * @brief  queues a buffer the running thread owns, handing it to the highest
+ *         priority receiver if one waits
+ * @param  mq       the queue
+ * @param  buf      the buffer
+ * @return 0 on success, -1 if the thread does not own buf
+*/
+int sys_mq_send_buf(kmqueue_t *mq, void *buf){
+  if (!TABLE_ENTRY(mq, gcb.mqueues, gcb.num_mqueues)) return -1;
+
+  int irq_state = save_interrupt_state_and_disable();
+  int slot = mq_owned_slot(mq, buf);
+  if (slot >= 0) mq_push(mq, slot);
+  restore_interrupt_state(irq_state);
+  return slot >= 0 ? 0 : -1;
+}
+
+/**
+ * @brief  takes the oldest queued buffer for the running thread
+ * @param  mq       the queue
+ * @param  timeout  ticks to wait at most, 0 to not wait, WAIT_FOREVER
+ * @return the buffer, NULL on timeout, a bad queue, or under PER_THREAD,
+ *         where user code cannot reach the kernel's buffers
+*/
+void *sys_mq_receive_buf(kmqueue_t *mq, uint32_t timeout){
+  if (gcb.per_thread) return NULL;
+  return mq_take(mq, 1, timeout);
+}
+
+/**
+ * @brief  frees a buffer the running thread owns, handing it to the highest
+ *         priority thread waiting for one
+ * @param  mq       the queue
+ * @param  buf      the buffer
+ * @return 0 on success, -1 if the thread does not own buf
+*/
+int sys_mq_free(kmqueue_t *mq, void *buf){
+  if (!TABLE_ENTRY(mq, gcb.mqueues, gcb.num_mqueues)) return -1;
+
+  int irq_state = save_interrupt_state_and_disable();
+  int slot = mq_owned_slot(mq, buf);
+  if (slot >= 0) mq_put_free(mq, slot);
+  restore_interrupt_state(irq_state);
+  return slot >= 0 ? 0 : -1;
+}
+
+/**
+ * @brief  takes a buffer of a queue for the running thread, the first free
+ *         one or the oldest queued one, blocking on the matching wait queue
+ *         until mq_put_free or mq_push hands one over
+ * @param  mq       the queue
+ * @param  queued   1 to take a queued message, 0 to take a free buffer
+ * @param  timeout  ticks to wait at most, 0 to not wait, WAIT_FOREVER
+ * @return the buffer, NULL on timeout or a bad queue
+*/
+void *mq_take(kmqueue_t *mq, int queued, uint32_t timeout){
+  if (!TABLE_ENTRY(mq, gcb.mqueues, gcb.num_mqueues)) return NULL;
+  tcb_t *curr_thread = &gcb.tcbs[gcb.active_id];
+  uint32_t slot = MQUEUE_DEPTH_MAX;
+
+  int irq_state = save_interrupt_state_and_disable();
+  if (queued && mq->count > 0){
+    slot = mq->ring[mq->head];
+    if (++mq->head == mq->depth) mq->head = 0;
+    mq->count--;
+  }else if (!queued && mq->free_map){
+    slot = count_leading_zeros(mq->free_map);
+    mq->free_map &= ~MQ_BIT(slot);
+  }
+
+  //Main and idle never block
+  if (slot == MQUEUE_DEPTH_MAX && timeout != 0 && curr_thread->id >= USER_THREAD_FIRST_IDX){
+    curr_thread->wait_result = MQUEUE_DEPTH_MAX;
+    wait_block(queued ? &mq->receivers : &mq->senders, timeout);
+    restore_interrupt_state(irq_state);
+    slot = curr_thread->wait_result;
+  }else{
+    if (slot != MQUEUE_DEPTH_MAX) mq->owner[slot] = curr_thread->id;
+    restore_interrupt_state(irq_state);
+  }
+
+  if (slot == MQUEUE_DEPTH_MAX) return NULL;
+  return mq->buffers + slot * mq->stride;
+}
+
+/**
+ * @brief  index of a buffer of a queue, if the running thread owns it
+ * @param  mq       the queue
+ * @param  buf      start of the buffer
+ * @return the index, -1 if buf is not a buffer of mq the thread owns
+*/
+int mq_owned_slot(kmqueue_t *mq, void *buf){
+  uint32_t offset = (uint32_t)buf - (uint32_t)mq->buffers;
+  uint32_t slot = offset / mq->stride;
+
+  if (slot >= mq->depth || offset != slot * mq->stride) return -1;
+  if (mq->owner[slot] != gcb.tcbs[gcb.active_id].id) return -1;
+  return slot;
+}
+
+/**
+ * @brief  queues a buffer, or hands it straight to the highest priority
+ *         thread waiting for a message. Called with interrupts disabled.
+ * @param  mq       the queue
+ * @param  slot     index of the buffer
+*/
+void mq_push(kmqueue_t *mq, uint32_t slot){
+  tcb_t *waiter = wait_dequeue(&mq->receivers);
+
+  if (waiter != NULL){
+    mq->owner[slot] = waiter->id;
+    wait_wake(waiter, slot);
+    return;
+  }
+
+  //Every buffer is free, queued or owned, so the ring never overflows
+  uint32_t tail = mq->head + mq->count;
+  if (tail >= mq->depth) tail -= mq->depth;
+  mq->ring[tail] = slot;
+  mq->count++;
+  mq->owner[slot] = MQ_NO_OWNER;
+}
+
+/**
+ * @brief  frees a buffer, or hands it straight to the highest priority
+ *         thread waiting for a free one. Called with interrupts disabled.
+ * @param  mq       the queue
+ * @param  slot     index of the buffer
+*/
+void mq_put_free(kmqueue_t *mq, uint32_t slot){
+  tcb_t *waiter = wait_dequeue(&mq->senders);
+
+  if (waiter != NULL){
+    mq->owner[slot] = waiter->id;
+    wait_wake(waiter, slot);
+    return;
+  }
+  mq->owner[slot] = MQ_NO_OWNER;
+  mq->free_map |= MQ_BIT(slot);
+}
+
+/**
+ * @brief  copies a message between a queue buffer and a thread's memory, a
+ *         word at a time while both sides are word aligned
+ * @param  dst      where to copy to
+ * @param  src      where to copy from
+ * @param  size     bytes to copy
+*/
+void mq_copy(void *dst, const void *src, uint32_t size){
+  uint8_t *d = dst;
+  const uint8_t *s = src;
+
+  if ((((uint32_t)d | (uint32_t)s) & 3) == 0){
+    for (; size >= 4; size -= 4, d += 4, s += 4) *(uint32_t*)d = *(const uint32_t*)s;
+  }
+  while (size--) *d++ = *s++;
+}
+
+/**
+ * @brief  frees the message queue buffers of a thread that is being killed,
+ *         so the threads waiting for them are not stranded
+ *
+ * @param  thread   the dying thread
+ */
+void mq_release_all(tcb_t *thread){
+  int irq_state = save_interrupt_state_and_disable();
+  for (uint32_t i = 0; i < gcb.num_mqueues; i++){
+    kmqueue_t *mq = &gcb.mqueues[i];
+    for (uint32_t slot = 0; slot < mq->depth; slot++){
+      if (mq->owner[slot] == thread->id) mq_put_free(mq, slot);
+    }
+  }
+  restore_interrupt_state(irq_state);
+}
+
+tcb_t *get_active_thread(){
+   tcb_t *curr_thread = NULL;
+    uint32_t i;
+    for(i=0; i<gcb.next; i++){
+        if (gcb.tcbs[i].state == RUNNING) {
+          curr_thread = &gcb.tcbs[i];
+          break;
+        }
+    }
+    return curr_thread;
+}
+
+/**
+ * @brief  picks the next thread to run. Under RMS this is the highest
+ *         priority ready thread, in constant time. Under EDF it is the
+ *         ready thread with the earliest deadline, unless the highest
+ *         priority ready thread has been escalated by a mutex ceiling, in
+ *         which case it runs first so it can release the resource.
+ *
+ * @return  the thread to run, NULL if no user thread is ready
+ */
+tcb_t *get_next_thread(){
+  uint32_t prio = ready_top_prio();
+  if (prio == NUM_PRIOS) return NULL;
+  tcb_t *top = gcb.ready_head[prio];
+
+  if (gcb.edf && top->dyn_prio >= top->static_prio){
+    return pq_entry(pq_peek(&gcb.deadline_q), tcb_t, deadline_node);
+  }
+  return top;
+}
+
+/**
+ * @brief  decides whether PendSV has work to do. It has when the running
+ *         thread is no longer running, another thread should run, or the
+ *         idle thread should start a tickless sleep. The only side effect is
+ *         taking over the user mutexes of a thread that loses the CPU.
+ *
+ * @return non-zero if a context switch is needed
+ */
+int switch_needed(){
+  tcb_t *curr_thread = &gcb.tcbs[gcb.active_id];
+  if (mem_fault) return 1;
+  if (curr_thread->state != RUNNING){
+    umutex_adopt(curr_thread);
+    return 1;
+  }
+
+  //A thread about to be preempted takes the ceilings of the user mutexes it holds, which may keep it running
+  tcb_t *next_thread = get_next_thread();
+  if (next_thread != NULL && next_thread != curr_thread && umutex_adopt(curr_thread)) next_thread = get_next_thread();
+  if (next_thread != NULL) return next_thread != curr_thread;
+
+  //Nothing is ready: main once every thread finished, the idle thread otherwise
+  if (curr_thread->id != IDLE_THREAD_IDX) return 1;
+  if (gcb.num_inactive > 0 && gcb.num_inactive == gcb.next - USER_THREAD_FIRST_IDX) return 1;
+  return gcb.tickless && !gcb.sleep_ticks;
+}
+
+#ifdef PROFILE
+tcb_t *get_next_thread_scan(){
+  uint32_t max_prio = UINT32_MAX; //lower than any priority
+  tcb_t *next_thread = NULL;
+
+  for (int i=USER_THREAD_FIRST_IDX; i < gcb.next; i++){
+   tcb_t *thread = &gcb.tcbs[i];
+    if ((thread->state == RUNNABLE || thread->state == RUNNING)){
+      uint32_t thread_prio = get_curr_prio(thread->id);
+      if (thread_prio < max_prio){
+        max_prio = thread_prio;
+        next_thread = thread;
+      } else if (thread_prio == max_prio && next_thread != NULL){
+        /* An escalated thread causing priority conflicts should be run first if it uses a mutex
+        Ensures thread is only blocked once initially as is protocol with IPCP */
+        if (is_using_mutex(thread->id)) next_thread = thread;
+      }
+    }
+  }
+
+  return next_thread;
+}
+#endif
+
+int stack_overflows(uint32_t num_stacks, uint32_t stack_size, int per_thread, uint32_t *k_end) {
+  uint32_t avail_u = (uint32_t)&__thread_u_stacks_top - (uint32_t)&__thread_u_stacks_low;
+  uint32_t avail_k = (uint32_t)&__thread_k_stacks_top - (uint32_t)&__thread_k_stacks_low;
+  if (stack_size > avail_k / 4) return 1;
+
+  //Lay the stacks out as place_stacks will, from the bottom of each arena
+  uint32_t bytes = stack_size * 4;
+  uint32_t u_next = (uint32_t)&__thread_u_stacks_low, k_next = (uint32_t)&__thread_k_stacks_low;
+  for (uint32_t i = 0; i < num_stacks; i++){
+    uint8_t u_log2, k_log2;
+    u_next = stack_place(u_next, bytes, per_thread, &u_log2) + stack_span(bytes, u_log2);
+    k_next = stack_place(k_next, bytes, 0, &k_log2) + stack_span(bytes, k_log2);
+  }
+
+  if (u_next - (uint32_t)&__thread_u_stacks_low > avail_u || k_next - (uint32_t)&__thread_k_stacks_low > avail_k) return 1;
+  *k_end = k_next;
+  return 0;  
+}
+
+/**
+ * @brief initializes default and idle threads
+ * @param  idle_fn     pointer to the idle function, or NULL if none provided
+ *
+ */
+void set_default_threads(void *idle_fn) {
+  /* Function is called in thread_init. Consequently,invariant is that 
+    array idx 0 & 1 are assigned to main & idle threads respectively
+   */
+ tcb_t *main_thread = &gcb.tcbs[gcb.next];
+  main_thread->id = gcb.next++;
+  set_thread_state(main_thread, RUNNING);
+  //Main keeps running on the default stacks it started on
+  main_thread->u_stack_high = (uint32_t)&__psp_stack_top;
+  main_thread->k_stack_high = (uint32_t)&__msp_stack_top;
+  encode_stack_regions(main_thread->mpu, main_thread, stack_region_log2(stack_bytes(main_thread)));
+
+  //Idle function thread setup similar to regular thread
+ tcb_t *idle_thread = &gcb.tcbs[gcb.next];
+  idle_thread->id = gcb.next++;
+  set_thread_state(idle_thread, RUNNABLE);
+  idle_thread->svc_status = 0;
+    
+  void *used_idle_fn = idle_fn;
+
+  extern void idle_default();
+  if (!used_idle_fn){
+      used_idle_fn = &idle_default;
+      idle_thread->msp = (void*)gcb.k_stack_next;
+      idle_thread->k_stack_high = gcb.k_stack_next;
+      idle_thread->psp = (void*)gcb.u_stack_next;
+      idle_thread->u_stack_high = gcb.u_stack_next;
+      encode_stack_regions(idle_thread->mpu, idle_thread, 0);
+  }else{
+      place_stacks(idle_thread);
+  }
+
+  setup_init_stack_frame(idle_thread, used_idle_fn, (void*)0);
+}
+
+void setup_init_stack_frame(tcb_t *thread, void *fn, void *vargp) {
+  //A revived thread is painted again, its peaks are per life like its stats
+  if (stack_paintable(thread)){
+    stack_paint(stack_floor(thread, 1), thread->u_stack_high);
+    stack_paint(stack_floor(thread, 0), thread->k_stack_high);
+  }
+  thread->u_stack_peak = 0;
+  thread->k_stack_peak = 0;
+
+  /*Edit ARM-saved context to run function initally 
   and push callee-saved context onto main stack for assembly handling on restoration */
   interrupt_stack_frame *init_psp = (interrupt_stack_frame*)thread->psp - 1;
   init_psp->pc = (uint32_t)fn;
@@ -577,17 +2091,134 @@ void setup_init_stack_frame(tcb_t *thread, void *fn, void *vargp) {
   thread->msp = init_msp;
 }
 
-int is_schedulable(uint32_t newC, uint32_t newT){
-  float sum = 0;
+/**
+ * @brief  C / T in fixed point with UTIL_FRAC_BITS fraction bits, rounded up
+ *         so that the sum of all tasks never understates the load. Computed
+ *         by long division so neither float nor 64-bit helpers are needed.
+ *
+ * @return the utilization, more than UTIL_ONE if C > T
+ */
+uint32_t utilization(uint32_t C, uint32_t T){
+  if (C > T) return UTIL_ONE + 1;
+
+  uint32_t util = 0;
+  uint32_t rem = C;
+  if (rem == T) return UTIL_ONE;
+  for (int i = 0; i < UTIL_FRAC_BITS; i++){
+    //rem < T, so doubling it cannot overflow for T < 2^31
+    rem <<= 1;
+    util <<= 1;
+    if (rem >= T){
+      rem -= T;
+      util |= 1;
+    }
+  }
+  if (rem) util++;
+  return util;
+}
+
+/**
+ * @brief  Admission test for a new task. Under EDF the set is schedulable
+ *         iff its utilization is at most 1. Under fixed priorities the
+ *         response time of every task whose interference grows, the new one
+ *         and all of equal or lower priority, is recomputed exactly. Higher
+ *         priority tasks are unaffected by the new one, but are recomputed
+ *         too once an observed hold has grown a blocking term since the
+ *         last test. Each iteration restarts from the previous fixed point,
+ *         which stays a lower bound while tasks are only added and blocking
+ *         terms only grow. The new bounds are kept only if all of them fit,
+ *         so a task that passes must then be created.
+ *
+ * @param  cand      static_prio, C and T of the new task, rta_R is filled in
+ * @return 1 if the task can be admitted, 0 otherwise
+ */
+int is_schedulable(tcb_t *cand){
+  if (gcb.edf){
+    uint32_t sum = utilization(cand->C, cand->T);
+    for (int i = USER_THREAD_FIRST_IDX; i < gcb.next && sum <= UTIL_ONE; i++){
+      if (gcb.tcbs[i].state == INACTIVE) continue;
+      sum += utilization(gcb.tcbs[i].C, gcb.tcbs[i].T);
+    }
+    return sum <= UTIL_ONE;
+  }
+
+  //Kept off the caller's kernel stack, which is small with many threads
+  uint32_t *new_R = rta_table;
+  int valid = gcb.rta_valid;
+  int blocking = gcb.rta_blocking;
+
+  cand->rta_R = response_time(cand, 0, cand);
+  if (!cand->rta_R) return 0;
+
   for (int i = USER_THREAD_FIRST_IDX; i < gcb.next; i++){
-    if (gcb.tcbs[i].state == INACTIVE) continue;
-    sum += (float)gcb.tcbs[i].C/ (float)gcb.tcbs[i].T;
+    tcb_t *thread = &gcb.tcbs[i];
+    new_R[i] = thread->rta_R;
+    if (thread->state == INACTIVE) continue;
+    if (thread->static_prio < cand->static_prio && valid && !blocking) continue;
+
+    new_R[i] = response_time(thread, valid ? thread->rta_R : 0, cand);
+    if (!new_R[i]) return 0;
   }
 
-  sum += (float)newC / (float)newT;
-  int num_threads = gcb.next - USER_THREAD_FIRST_IDX  -gcb.num_inactive + 1;
-  if (sum <= ub_table[num_threads]) return 1;
-  return 0;
+  for (int i = USER_THREAD_FIRST_IDX; i < gcb.next; i++) gcb.tcbs[i].rta_R = new_R[i];
+  gcb.rta_valid = 1;
+  gcb.rta_blocking = 0;
+  return 1;
+}
+
+/**
+ * @brief  Response-time analysis, iterating
+ *         R = C + B + sum over the other tasks of equal or higher priority
+ *         of ceil(R / Tj) * Cj
+ *         until it settles or passes the task's period, in integer ticks.
+ *
+ * @param  task      the task under analysis
+ * @param  start     a known lower bound on its response time, 0 if none
+ * @param  cand      task being admitted, counted along with the active ones
+ * @return the response time, 0 if it exceeds the period
+ */
+uint32_t response_time(tcb_t *task, uint32_t start, tcb_t *cand){
+  uint32_t base = task->C + blocking_term(task->static_prio);
+  uint32_t R = start > base ? start : base;
+  if (R > task->T) return 0;
+
+  while (1){
+    uint32_t next = base;
+    for (int i = USER_THREAD_FIRST_IDX; i < gcb.next; i++){
+      tcb_t *other = &gcb.tcbs[i];
+      if (other == task || other->state == INACTIVE || other->static_prio > task->static_prio) continue;
+      next += ((R + other->T - 1) / other->T) * other->C;
+    }
+    if (cand != task && cand->static_prio <= task->static_prio){
+      next += ((R + cand->T - 1) / cand->T) * cand->C;
+    }
+
+    if (next > task->T) return 0;
+    if (next == R) return R;
+    R = next;
+  }
+}
+
+/**
+ * @brief  Blocking term of IPCP. A task of priority prio can be blocked once
+ *         per job by a lower priority thread holding a mutex whose ceiling is
+ *         prio or higher. The kernel cannot know critical section lengths in
+ *         advance, so each mutex that a thread of lower priority than prio
+ *         has held contributes the longest hold it has seen so far; other
+ *         mutexes contribute 0.
+ *
+ * @param  prio      static priority of the task under analysis
+ * @return the blocking term in ticks
+ */
+uint32_t blocking_term(uint32_t prio){
+  uint32_t blocking = 0;
+
+  for (uint32_t i = 0; i < gcb.num_mutexes; i++){
+    kmutex_t *mutex = &gcb.mutexes[i];
+    if (mutex->prio_ceil > prio || mutex->low_holder <= prio) continue;
+    if (mutex->max_hold > blocking) blocking = mutex->max_hold;
+  }
+  return blocking;
 }
 
 void update_thread_times() {
@@ -597,22 +2228,124 @@ void update_thread_times() {
       curr_thread->running_C++;
       curr_thread->total_C++;
       if (curr_thread->running_C == curr_thread->C){
+        curr_thread->stats.overruns++;
+        curr_thread->overran = 1;
         curr_thread->running_C = 0;
-        curr_thread->state = WAITING;
+        set_thread_state(curr_thread, WAITING);
       }
   }
 
-  //Search through threads and prepare woken ones for running
-  for (int i=USER_THREAD_FIRST_IDX; i < gcb.next; i++){
-   tcb_t *thread = &gcb.tcbs[i];
-    if (thread->state == INACTIVE) continue;
-    if (thread->next_deadline <=  gcb.tick_count){
-      thread->state= RUNNABLE;
-      thread->running_C= 0;
-      thread->last_deadline= thread->next_deadline;
-      thread->next_deadline= thread->next_deadline + thread->T;
+  //Release every thread whose period has elapsed, only looking at the queue head
+  pq_node_t *node;
+  while ((node = pq_peek(&gcb.release_q)) && !TICK_BEFORE(gcb.tick_count, node->key)){
+    tcb_t *thread = pq_entry(node, tcb_t, release_node);
+    //A job that has not waited for this release missed its deadline, as
+    //did one cut off at C, which waits without having finished
+    if (thread->state != WAITING || thread->overran) thread->stats.deadline_misses++;
+    thread->overran = 0;
+    thread->job_started = 0;
+
+    //Advance the deadline first, EDF queues the new job by it
+    thread->running_C= 0;
+    thread->next_deadline= thread->next_deadline + thread->T;
+    //A job still ready past its release keeps its place in the EDF heap, under the new deadline
+    if (gcb.edf && is_ready_state(thread->state)) deadline_requeue(thread);
+    //A blocked thread stays blocked until an unlock, post or timeout wakes it
+    if (thread->state != BLOCKED) set_thread_state(thread, RUNNABLE);
+    pq_update(&gcb.release_q, node, thread->next_deadline);
+  }
+
+  //Waits that timed out return the result preset when they blocked
+  int irq_state = save_interrupt_state_and_disable();
+  while ((node = pq_peek(&gcb.timeout_q)) && !TICK_BEFORE(gcb.tick_count, node->key)){
+    tcb_t *thread = pq_entry(node, tcb_t, timeout_node);
+    if (thread->blocked_on != NULL) wait_remove(thread);
+    wait_wake(thread, thread->wait_result);
+  }
+  restore_interrupt_state(irq_state);
+}
+
+/**
+ * @brief  Called when switching to the idle thread. Rather than waking every
+ *         tick, reprogram systick to fire once on the tick of the earliest
+ *         release or wait timeout, from the two queue heads. The current
+ *         tick's remaining
+ *         cycles are kept so tick boundaries do not drift, and the timer
+ *         reverts to one tick per interrupt on its own after firing.
+ */
+void tickless_enter(){
+  pq_node_t *node = pq_peek(&gcb.release_q);
+  pq_node_t *timeout = pq_peek(&gcb.timeout_q);
+  if (timeout && (!node || TICK_BEFORE(timeout->key, node->key))) node = timeout;
+  if (!node || TICK_BEFORE(node->key, gcb.tick_count + 2)) return;
+
+  uint32_t ticks = node->key - gcb.tick_count;
+  uint32_t max_ticks = (TIMER_MAX_LOAD + 1) / gcb.tick_cycles;
+  if (ticks > max_ticks) ticks = max_ticks;
+  if (ticks < 2) return;
+
+  int irq_state = save_interrupt_state_and_disable();
+  uint32_t remaining = timer_remaining();
+  //A tick that already expired must be taken as a normal tick first
+  if (remaining && !systick_pending()){
+    timer_oneshot((ticks - 1) * gcb.tick_cycles, gcb.tick_cycles - 1);
+    gcb.sleep_ticks = ticks;
+  }
+  restore_interrupt_state(irq_state);
+}
+
+/**
+ * @brief  Called when a thread becomes runnable before the tickless sleep is
+ *         over. Credits the whole ticks that have passed and shortens the
+ *         timer to the next tick boundary, resuming normal ticking.
+ */
+void tickless_exit(){
+  int irq_state = save_interrupt_state_and_disable();
+  //The sleep already ended, the pending systick will credit it
+  if (!systick_pending()){
+    uint32_t remaining = timer_remaining();
+    uint32_t ahead = (remaining + gcb.tick_cycles - 1) / gcb.tick_cycles;
+    if (ahead){
+      gcb.tick_count += gcb.sleep_ticks - ahead;
+      gcb.sleep_ticks = 0;
+      timer_oneshot(-(int32_t)((ahead - 1) * gcb.tick_cycles), gcb.tick_cycles - 1);
     }
   }
+  restore_interrupt_state(irq_state);
+}
+
+/**
+ * @brief  copies the running thread's time and priority to the time page.
+ *         Called whenever one of them changes outside the running thread:
+ *         on the tick, on a switch, and when the thread's priority moves.
+ */
+void time_page_publish(){
+  tcb_t *thread = &gcb.tcbs[gcb.active_id];
+
+  int irq_state = save_interrupt_state_and_disable();
+  _time_page.seq++;
+  _time_page.ticks = gcb.tick_count;
+  _time_page.tickless = gcb.sleep_ticks;
+  _time_page.thread_ticks = thread->total_C;
+  _time_page.prio = get_curr_prio(thread->id);
+  _time_page.running = thread->id + 1;
+  _time_page.seq++;
+  restore_interrupt_state(irq_state);
+}
+
+/**
+ * @brief  ticks that have passed since the current tickless sleep began
+ *
+ * @return the elapsed ticks, 0 if the scheduler is ticking normally
+ */
+uint32_t tickless_elapsed(){
+  if (!gcb.sleep_ticks) return 0;
+  //Expired but not yet taken, the counter has already reloaded
+  if (systick_pending()) return gcb.sleep_ticks;
+
+  uint32_t remaining = timer_remaining();
+  uint32_t ahead = (remaining + gcb.tick_cycles - 1) / gcb.tick_cycles;
+  return gcb.sleep_ticks - ahead;
 }
 
 /**
@@ -633,41 +2366,120 @@ tcb_t *find_inactive_thread(){
 }
 
 /**
- * @brief  set mutex pending state
+ * @brief  finds what stops a thread from locking a free mutex under IPCP.
+ *         The ceiling map is walked from the highest ceiling with one CLZ
+ *         per word, and only the thread's own mutexes are skipped. So this
+ *         is not constant time: it costs one step per mutex the thread
+ *         itself holds at a ceiling at or above its priority, its nesting
+ *         depth at worst, and never depends on other threads.
  *
- * @param  mutex       passed kernel mutex
- * @param  thread_id   the passed thread tcb structure
- * @param  val         the value od the mutex
+ * @param  thread      the passed thread TCB structure
+ * @return a mutex locked by another thread with a ceiling at or above the
+ *         thread's priority, NULL if there is none
+ */
+kmutex_t *ceiling_blocker(tcb_t *thread){
+  uint32_t prio = get_curr_prio(thread->id);
+
+  for (uint32_t word = 0; word <= PRIO_WORD(prio); word++){
+    uint32_t bits = gcb.ceil_map[word];
+    while (bits){
+      uint32_t ceil = word * 32 + count_leading_zeros(bits);
+      if (ceil > prio) return NULL;
+      for (kmutex_t *mutex = gcb.ceil_head[ceil]; mutex != NULL; mutex = mutex->ceil_next){
+        if (mutex->locked_by != thread->id) return mutex;
+      }
+      bits &= ~PRIO_BIT(ceil);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief  links a just locked mutex into the list of its ceiling
  *
- * @return  the higher priority locked mutex
+ * @param  mutex       the locked mutex
  */
-void set_pending_state(kmutex_t *mutex, uint32_t thread_id, uint32_t val){
-  if (val) mutex->pending |= (1 << thread_id);
-  else mutex->pending &= ~(1 << thread_id);
+void ceiling_insert(kmutex_t *mutex){
+  uint32_t ceil = mutex->prio_ceil;
+
+  mutex->ceil_prev = NULL;
+  mutex->ceil_next = gcb.ceil_head[ceil];
+  if (mutex->ceil_next != NULL) mutex->ceil_next->ceil_prev = mutex;
+  gcb.ceil_head[ceil] = mutex;
+  gcb.ceil_map[PRIO_WORD(ceil)] |= PRIO_BIT(ceil);
 }
 
-int get_pending_state(kmutex_t *mutex, uint32_t thread_id){
-  return (mutex->pending >> thread_id) & 1;
+/**
+ * @brief  unlinks a just unlocked mutex from the list of its ceiling
+ *
+ * @param  mutex       the unlocked mutex
+ */
+void ceiling_remove(kmutex_t *mutex){
+  uint32_t ceil = mutex->prio_ceil;
+
+  if (mutex->ceil_next != NULL) mutex->ceil_next->ceil_prev = mutex->ceil_prev;
+  if (mutex->ceil_prev != NULL) mutex->ceil_prev->ceil_next = mutex->ceil_next;
+  else gcb.ceil_head[ceil] = mutex->ceil_next;
+  if (gcb.ceil_head[ceil] == NULL) gcb.ceil_map[PRIO_WORD(ceil)] &= ~PRIO_BIT(ceil);
 }
 
 /**
- * @brief  if the priority of the locked mutex is >= get the higher mutex
+ * @brief  pushes a just locked mutex on its holder's stack. Each entry
+ *         keeps the lowest ceiling from it down, so the holder's priority
+ *         is read off the top.
  *
- * @param  thread      the passed thread TCB structure
- * @return  the higher priority locked mutex
+ * @param  thread      the thread holding the mutex
+ * @param  mutex       the locked mutex
  */
-int locked_geq_prio_mutex(tcb_t *thread){
-  int higher_locked_mutex = 0;
+void held_push(tcb_t *thread, kmutex_t *mutex){
+  kmutex_t *top = thread->held;
+
+  mutex->held_next = top;
+  mutex->held_prev = NULL;
+  mutex->held_ceil = mutex->prio_ceil;
+  if (top != NULL){
+    top->held_prev = mutex;
+    if (top->held_ceil < mutex->held_ceil) mutex->held_ceil = top->held_ceil;
+  }
+  thread->held = mutex;
+  set_dyn_prio(thread, held_prio(thread));
+}
 
-  for (uint32_t i=0; i < gcb.num_mutexes; i++){
-    kmutex_t *search_mutex = &gcb.mutexes[i];
-    if  (search_mutex->locked_by != -1 &&
-         search_mutex->locked_by != thread->id && search_mutex->prio_ceil <= get_curr_prio(thread->id)){
-      higher_locked_mutex =  1;
-      break;
-    }
+/**
+ * @brief  takes a just unlocked mutex off its holder's stack. Unlocking in
+ *         reverse order pops the top in constant time. Otherwise the
+ *         entries locked after the mutex recompute their lowest ceiling,
+ *         one step each, so the cost is the holder's nesting depth above
+ *         the mutex, bounded by what the thread holds.
+ *
+ * @param  thread      the thread that held the mutex
+ * @param  mutex       the unlocked mutex
+ */
+void held_remove(tcb_t *thread, kmutex_t *mutex){
+  kmutex_t *below = mutex->held_next;
+  kmutex_t *above = mutex->held_prev;
+
+  if (below != NULL) below->held_prev = above;
+  if (above != NULL) above->held_next = below;
+  else thread->held = below;
+
+  for (; above != NULL; above = above->held_prev){
+    above->held_ceil = above->prio_ceil;
+    if (below != NULL && below->held_ceil < above->held_ceil) above->held_ceil = below->held_ceil;
+    below = above;
   }
-  return higher_locked_mutex;
+  set_dyn_prio(thread, held_prio(thread));
+}
+
+/**
+ * @brief  get the priority a thread runs at under IPCP, the highest of its
+ *         static priority and the ceilings of the mutexes it holds
+ *
+ * @param  thread      the passed thread TCB structure
+ */
+uint32_t held_prio(tcb_t *thread){
+  if (thread->held != NULL && thread->held->held_ceil < thread->static_prio) return thread->held->held_ceil;
+  return thread->static_prio;
 }
 
 /**
@@ -682,54 +2494,503 @@ uint32_t get_curr_prio(uint32_t thread_id){
 }
 
 /**
- * @brief  get the fallback priority of the passed thread in IPCP scheduling
+ * @brief  checks if a thread is currently using a mutex
  *
- * @param  thread      the passed thread TCB structure
+ * @param  thread_id   the identifier of the thread
  */
-int get_fallback_prio(tcb_t *thread){
-  int max_prio_mutex = (1 << gcb.max_threads); //use high upper bound number
+uint32_t is_using_mutex(uint32_t thread_id){
+  return gcb.tcbs[thread_id].held != NULL;
+}
 
-  for (uint32_t i=0; i < gcb.num_mutexes; i++){
-    kmutex_t *search_mutex = &gcb.mutexes[i];
-    if (search_mutex->locked_by == thread->id &&
-        (int)search_mutex->prio_ceil < max_prio_mutex){
-          max_prio_mutex = search_mutex->prio_ceil;
+/**
+ * @brief  switches which memory region is protected
+ *
+ * @param  next_thread        the next scheduled thread
+ */
+void switch_mem_protect(tcb_t *next_thread){
+    mm_fault_sp = next_thread->k_stack_high;
+
+#ifdef PROFILE
+    //Reference: encode the regions on the switch, as before they were kept in the TCB
+    mm_region_t regions[MM_THREAD_REGIONS];
+    PROF_START(encode_start);
+    encode_stack_regions(regions, next_thread, mm_region_size_log2(&next_thread->mpu[MPU_U_STACK]));
+    mm_region_load(regions, MM_THREAD_REGIONS);
+    PROF_END(PROF_MPU_ENCODE, encode_start);
+#endif
+    PROF_START(load_start);
+    mm_region_load(next_thread->mpu, MM_THREAD_REGIONS);
+    PROF_END(PROF_MPU_LOAD, load_start);
+}
+
+/**
+ * @brief  size of each of a thread's two stacks in bytes, as asked for,
+ *         not counting the guard below it
+ *
+ * @param  thread   the thread
+ */
+uint32_t stack_bytes(const tcb_t *thread){
+    //The default psp and msp stacks of main are the same size, and their lowest eighth is the guard
+    if (thread->id == MAIN_THREAD_IDX){
+      uint32_t area = (uint32_t)&__psp_stack_top - (uint32_t)&__psp_stack_bottom;
+      return area - (area >> MM_SUBREGIONS_LOG2);
     }
-  }
-  if (max_prio_mutex == (1 << gcb.max_threads)) return -1;
-  return max_prio_mutex;
+    return gcb.stack_size * 4;
 }
 
 /**
- * @brief  checks if a thread is currently using a mutex
+ * @brief  log[2] of the smallest region a stack and its guard, one
+ *         subregion of it, fit in
  *
- * @param  thread_id   the identifier of the thread
+ * @param  bytes    the stack size
  */
-uint32_t is_using_mutex(uint32_t thread_id){
-  int is_using = 0;
+uint8_t stack_region_log2(uint32_t bytes){
+    uint8_t size_log2 = mm_log2ceil_size(bytes);
+    if (size_log2 < MM_SUBREGION_MIN_LOG2) size_log2 = MM_SUBREGION_MIN_LOG2;
+    //Seven subregions must be left above the guard
+    if (bytes > (((1U << MM_SUBREGIONS_LOG2) - 1) << (size_log2 - MM_SUBREGIONS_LOG2))) size_log2++;
+    return size_log2;
+}
 
-  for (uint32_t i=0; i < gcb.num_mutexes; i++){
-    if (gcb.mutexes[i].locked_by == (int)thread_id){
-      is_using = 1;
-      break;
+/**
+ * @brief  bytes a stack takes up when carved in subregions of a region: its
+ *         guard, the lowest subregion, then the stack rounded up to whole
+ *         subregions
+ *
+ * @param  bytes      the stack size
+ * @param  size_log2  log[2] of the region, at least stack_region_log2(bytes)
+ */
+uint32_t stack_span(uint32_t bytes, uint8_t size_log2){
+    uint32_t subregion = 1U << (size_log2 - MM_SUBREGIONS_LOG2);
+    return (bytes + subregion + subregion - 1) & ~(subregion - 1);
+}
+
+/**
+ * @brief  places a stack at or above the next free address of its arena. A
+ *         stack that only needs its guard, a subregion of any aligned block,
+ *         is packed in subregions of stack_region_log2. A PER_THREAD user
+ *         stack also needs a region opening it alone, so it may not cross a
+ *         block of its region. The smallest region it fits is tried first,
+ *         then up to STACK_REGION_STEPS larger ones with coarser subregions,
+ *         and the one ending lowest wins.
+ *
+ * @param  next       lowest free address of the arena
+ * @param  bytes      the stack size
+ * @param  exact      whether the stack needs a region of its own
+ * @param  size_log2  where to store log[2] of the region chosen
+ *
+ * @return the stack's lowest address, its guard
+ */
+uint32_t stack_place(uint32_t next, uint32_t bytes, int exact, uint8_t *size_log2){
+    uint8_t first = stack_region_log2(bytes);
+    uint32_t best_low = 0, best_high = UINT32_MAX;
+
+    for (uint8_t k = first; k <= first + (exact ? STACK_REGION_STEPS : 0) && k < 32; k++){
+      uint32_t block = 1U << k;
+      uint32_t subregion = block >> MM_SUBREGIONS_LOG2;
+      uint32_t span = stack_span(bytes, k);
+      uint32_t low = (next + subregion - 1) & ~(subregion - 1);
+
+      //Move up to the next block rather than cross into it
+      if (exact && (low & (block - 1)) + span > block) low = (low + block - 1) & ~(block - 1);
+      if (low + span < best_high){
+        best_low = low;
+        best_high = low + span;
+        *size_log2 = k;
+      }
     }
-  }
+    return best_low;
+}
 
-  return is_using;
+/**
+ * @brief  carves a thread's kernel and user stacks from the arenas and
+ *         encodes their MPU regions
+ *
+ * @param  thread   the thread, placed in a new TCB
+ */
+void place_stacks(tcb_t *thread){
+    uint32_t bytes = stack_bytes(thread);
+    uint8_t k_log2, u_log2;
+    uint32_t k_low = stack_place(gcb.k_stack_next, bytes, 0, &k_log2);
+    uint32_t u_low = stack_place(gcb.u_stack_next, bytes, gcb.per_thread, &u_log2);
+
+    gcb.k_stack_next = k_low + stack_span(bytes, k_log2);
+    thread->msp = (void*)gcb.k_stack_next;
+    thread->k_stack_high = gcb.k_stack_next;
+
+    gcb.u_stack_next = u_low + stack_span(bytes, u_log2);
+    thread->psp = (void*)gcb.u_stack_next;
+    thread->u_stack_high = gcb.u_stack_next;
+    encode_stack_regions(thread->mpu, thread, u_log2);
 }
 
 /**
- * @brief  switches which memory region is protected
+ * @brief  whether the thread's stacks are its own to guard. The default idle
+ *         thread is given none and runs where the stack arenas begin.
  *
- * @param  next_thread        the next scheduled thread
+ * @param  thread   the thread
  */
-void switch_mem_protect(tcb_t *next_thread){
+int owns_stacks(const tcb_t *thread){
+    return !(thread->id == IDLE_THREAD_IDX && thread->k_stack_high == (uint32_t)&__thread_k_stacks_low);
+}
+
+/**
+ * @brief  encodes the MPU regions of a thread's stacks once, for
+ *         switch_mem_protect to load. The lowest subregion of each stack is
+ *         a guard nothing may access, so an overflow faults before it
+ *         reaches the stack below. The kernel stack guard is a region of its
+ *         own. Under PER_THREAD the user stack region opens the subregions
+ *         above the guard and no others, and the background region denies
+ *         the guard to user code. Where the lower regions already open the
+ *         user stack, under KERNEL_ONLY and for main's psp, which region 4
+ *         shares with the heap, its guard is a region like the kernel one.
+ *
+ * @param  regions  where to encode, MM_THREAD_REGIONS of them
+ * @param  thread   the thread, its stacks already placed
+ * @param  u_log2   log[2] of the user stack's region, from stack_place
+ */
+void encode_stack_regions(mm_region_t *regions, const tcb_t *thread, uint8_t u_log2){
+    uint32_t bytes = stack_bytes(thread);
+    uint8_t k_log2 = stack_region_log2(bytes);
+
+    if (!owns_stacks(thread)){
+      //The default idle thread only ever takes exception frames, below the user arena
+      mm_region_encode_off(&regions[MPU_K_GUARD], MM_THREAD_REGION_FIRST + MPU_K_GUARD);
+      if (gcb.per_thread)
+        mm_region_encode(&regions[MPU_U_STACK], MM_THREAD_REGION_FIRST + MPU_U_STACK,
+                         (void *)(thread->u_stack_high - (1U << k_log2)), k_log2, 0, 1);
+      else
+        mm_region_encode_off(&regions[MPU_U_STACK], MM_THREAD_REGION_FIRST + MPU_U_STACK);
+      return;
+    }
+
+    uint32_t k_low = thread->k_stack_high - stack_span(bytes, k_log2);
+    uint32_t u_low = thread->u_stack_high - stack_span(bytes, u_log2);
+    mm_guard_encode(&regions[MPU_K_GUARD], MM_THREAD_REGION_FIRST + MPU_K_GUARD, (void *)k_low, k_log2);
+
+    if (gcb.per_thread && thread->id != MAIN_THREAD_IDX){
+      uint32_t subregion_log2 = u_log2 - MM_SUBREGIONS_LOG2;
+      uint32_t block = u_low & ~((1U << u_log2) - 1);
+      uint32_t first = ((u_low - block) >> subregion_log2) + 1;
+      uint32_t end = (thread->u_stack_high - block) >> subregion_log2;
+      uint32_t open = ((1U << end) - 1) & ~((1U << first) - 1);
+
+      mm_region_encode(&regions[MPU_U_STACK], MM_THREAD_REGION_FIRST + MPU_U_STACK, (void *)block, u_log2, 0, 1);
+      mm_region_disable_subregions(&regions[MPU_U_STACK], (uint8_t)~open);
+    } else {
+      mm_guard_encode(&regions[MPU_U_STACK], MM_THREAD_REGION_FIRST + MPU_U_STACK, (void *)u_low, u_log2);
+    }
+}
+
+/**
+ * @brief  whether an address lies in a stack guard of the running thread
+ *
+ * @param  addr   the faulting address
+ */
+int stack_guard_hit(uint32_t addr){
+    tcb_t *thread = &gcb.tcbs[gcb.active_id];
+    uint32_t bytes = stack_bytes(thread);
+    uint8_t k_log2 = stack_region_log2(bytes);
+    uint8_t u_log2 = mm_region_size_log2(&thread->mpu[MPU_U_STACK]);
+
+    if (!owns_stacks(thread)) return 0;
+    return addr - (thread->u_stack_high - stack_span(bytes, u_log2)) < (1U << (u_log2 - MM_SUBREGIONS_LOG2)) ||
+           addr - (thread->k_stack_high - stack_span(bytes, k_log2)) < (1U << (k_log2 - MM_SUBREGIONS_LOG2));
+}
 
-    uint32_t region_size= gcb.stack_size * 4;
-    uint32_t next_u_stack_base= (next_thread->u_stack_high) -region_size;
+/**
+ * @brief  prints how the stack arenas are carved: per arena the stacks
+ *         placed, the bytes asked for, the guards, the rounding up to whole
+ *         subregions, the gaps left to keep PER_THREAD stacks inside one
+ *         block, and what is still free, then the message queue buffers
+ *         carved from the top of the kernel arena. Then the peak use of
+ *         each thread's stacks, as of the last scan.
+ */
+void stack_report(){
+    uint32_t bytes = gcb.stack_size * 4;
+    uint32_t stacks = 0, u_guards = 0, u_spans = 0;
+    uint8_t k_log2 = stack_region_log2(bytes);
+    uint32_t k_guard = 1U << (k_log2 - MM_SUBREGIONS_LOG2);
+
+    for (int i = IDLE_THREAD_IDX; i < gcb.next; i++){
+      tcb_t *thread = &gcb.tcbs[i];
+      if (!owns_stacks(thread)) continue;
+      uint8_t u_log2 = mm_region_size_log2(&thread->mpu[MPU_U_STACK]);
+      stacks++;
+      u_guards += 1U << (u_log2 - MM_SUBREGIONS_LOG2);
+      u_spans += stack_span(bytes, u_log2);
+    }
 
-    if(next_thread->id != MAIN_THREAD_IDX){
-        mm_region_disable(6);
-        mm_region_enable(6, (void*)next_u_stack_base, mm_log2ceil_size(region_size), 0, 1);
+    uint32_t u_low = (uint32_t)&__thread_u_stacks_low, u_top = (uint32_t)&__thread_u_stacks_top;
+    uint32_t k_low = (uint32_t)&__thread_k_stacks_low, k_top = (uint32_t)&__thread_k_stacks_top;
+    uint32_t k_spans = stacks * stack_span(bytes, k_log2);
+
+    printk("---- stacks of %uB, %u placed ----\n", bytes, stacks);
+    printk("arena\tasked\tguards\tround\tgaps\tfree\n");
+    printk("user\t%u\t%u\t%u\t%u\t%u\n", stacks * bytes, u_guards, u_spans - stacks * bytes - u_guards,
+           gcb.u_stack_next - u_low - u_spans, u_top - gcb.u_stack_next);
+    printk("kernel\t%u\t%u\t%u\t%u\t%u\n", stacks * bytes, stacks * k_guard, k_spans - stacks * (bytes + k_guard),
+           gcb.k_stack_next - k_low - k_spans, gcb.mq_pool_low - gcb.k_stack_next);
+    printk("queue buffers\t%u of %u\n", k_top - gcb.mq_pool_low, k_top - gcb.mq_pool_floor);
+
+    //Peaks as last sampled, a rescan of every stack would hold up the dump
+    printk("id\tuser peak/size\tkernel peak/size\n");
+    for (int i = IDLE_THREAD_IDX; i < gcb.next; i++){
+      tcb_t *thread = &gcb.tcbs[i];
+      if (!stack_paintable(thread)) continue;
+      printk("%d\t%u/%u\t%u/%u%s\n", thread->id, thread->u_stack_peak, thread->u_stack_high - stack_floor(thread, 1),
+             thread->k_stack_peak, thread->k_stack_high - stack_floor(thread, 0),
+             thread->state == INACTIVE ? " (killed)" : "");
     }
 }
+
+/**
+ * @brief  whether a thread's stacks are painted each time it is set up to
+ *         run, so their peaks can be scanned. Main was already running on
+ *         its stacks, and the default idle thread has none of its own.
+ *
+ * @param  thread   the thread
+ */
+int stack_paintable(const tcb_t *thread){
+    return thread->id != MAIN_THREAD_IDX && owns_stacks(thread);
+}
+
+/**
+ * @brief  lowest address of a thread's stack the thread may use, the first
+ *         above its guard
+ *
+ * @param  thread   the thread, its stacks already placed
+ * @param  user     1 for the user stack, 0 for the kernel stack
+ */
+uint32_t stack_floor(const tcb_t *thread, int user){
+    uint32_t bytes = stack_bytes(thread);
+    uint8_t size_log2 = user ? mm_region_size_log2(&thread->mpu[MPU_U_STACK]) : stack_region_log2(bytes);
+    uint32_t high = user ? thread->u_stack_high : thread->k_stack_high;
+
+    return high - stack_span(bytes, size_log2) + (1U << (size_log2 - MM_SUBREGIONS_LOG2));
+}
+
+/**
+ * @brief  fills a stack with STACK_PAINT
+ *
+ * @param  low    lowest address to paint
+ * @param  high   one past the highest, the top of the stack
+ */
+void stack_paint(uint32_t low, uint32_t high){
+    for (uint32_t *word = (uint32_t *)low; word < (uint32_t *)high; word++) *word = STACK_PAINT;
+}
+
+/**
+ * @brief  how much of a painted stack has been used: from its top down to
+ *         the lowest word no longer holding the paint. Stacks grow down and
+ *         the paint is never restored, so the scan goes up from the bottom
+ *         and stops at the known peak, only reading the part never used.
+ *
+ * @param  low    lowest address that was painted
+ * @param  high   the top of the stack
+ * @param  known  peak found by the last scan
+ *
+ * @return the peak in bytes, at least known
+ */
+uint16_t stack_peak(uint32_t low, uint32_t high, uint16_t known){
+    const uint32_t *word = (const uint32_t *)low;
+    const uint32_t *mark = (const uint32_t *)(high - known);
+
+    while (word < mark && *word == STACK_PAINT) word++;
+    return high - (uint32_t)word;
+}
+
+/**
+ * @brief  rescans a thread's stacks for its peak use. The peaks are only
+ *         computed when asked for, or sampled when the CPU is idle, never
+ *         on a context switch.
+ *
+ * @param  thread   the thread
+ */
+void stack_peaks_update(tcb_t *thread){
+    if (!stack_paintable(thread)) return;
+    thread->u_stack_peak = stack_peak(stack_floor(thread, 1), thread->u_stack_high, thread->u_stack_peak);
+    thread->k_stack_peak = stack_peak(stack_floor(thread, 0), thread->k_stack_high, thread->k_stack_peak);
+}
+
+/**
+ * @brief  rescans the stacks of one thread, a different one each time, in
+ *         the idle thread's sys_idle_work after a tick that found it
+ *         running. This keeps the peaks stack_report prints current without
+ *         scanning in thread_stats_dump.
+ */
+void stack_sample(){
+    if (++gcb.stack_sample >= gcb.next) gcb.stack_sample = IDLE_THREAD_IDX;
+    stack_peaks_update(&gcb.tcbs[gcb.stack_sample]);
+}
+
+/**
+ * @brief  whether a thread in the given state belongs on a ready list
+ *
+ * @param  state  the thread state
+ */
+static int is_ready_state(thread_state state){
+  return state == RUNNABLE || state == RUNNING;
+}
+
+/**
+ * @brief  changes a thread's state. User threads move on or off the ready
+ *         lists as they enter or leave RUNNABLE/RUNNING, and on or off the
+ *         release queue as they leave or enter INACTIVE; main and idle are
+ *         never queued.
+ *
+ * @param  thread      the thread TCB structure
+ * @param  state       the new state
+ */
+void set_thread_state(tcb_t *thread, thread_state state){
+  if (thread->id >= USER_THREAD_FIRST_IDX){
+    int was_ready = is_ready_state(thread->state);
+    int now_ready = is_ready_state(state);
+
+    if (was_ready && !now_ready){
+      ready_dequeue(thread);
+      if (gcb.edf) deadline_dequeue(thread);
+    } else if (!was_ready && now_ready){
+      ready_enqueue(thread, 0);
+      if (gcb.edf) deadline_enqueue(thread);
+    }
+
+    if (thread->state == INACTIVE && state != INACTIVE){
+      int irq_state = save_interrupt_state_and_disable();
+      thread->release_node.key = thread->next_deadline;
+      thread->release_node.tie = thread->id;
+      pq_insert(&gcb.release_q, &thread->release_node);
+      restore_interrupt_state(irq_state);
+    } else if (state == INACTIVE && thread->state != INACTIVE){
+      //Cached response times may now overstate the least fixed point
+      gcb.rta_valid = 0;
+      int irq_state = save_interrupt_state_and_disable();
+      pq_remove(&gcb.release_q, &thread->release_node);
+      restore_interrupt_state(irq_state);
+    }
+  }
+  thread->state = state;
+}
+
+/**
+ * @brief  changes a thread's dynamic priority. A ready thread that is
+ *         escalated goes to the head of its new list so that, as IPCP
+ *         requires, it runs ahead of equal priority threads it may block.
+ *
+ * @param  thread      the thread TCB structure
+ * @param  prio        the new dynamic priority
+ */
+void set_dyn_prio(tcb_t *thread, uint32_t prio){
+  uint32_t old_prio = get_curr_prio(thread->id);
+  thread->dyn_prio = prio;
+  uint32_t new_prio = get_curr_prio(thread->id);
+
+  if (thread->id == gcb.active_id) time_page_publish();
+  if (new_prio == old_prio || !is_ready_state(thread->state)) return;
+  ready_dequeue(thread);
+  ready_enqueue(thread, new_prio < old_prio);
+}
+
+/**
+ * @brief  finds the highest priority that has a ready thread, one CLZ per
+ *         word of the ready map
+ *
+ * @return the priority, NUM_PRIOS if no user thread is ready
+ */
+uint32_t ready_top_prio(){
+  for (int i = 0; i < PRIO_WORDS; i++){
+    if (gcb.ready_map[i]) return i * 32 + count_leading_zeros(gcb.ready_map[i]);
+  }
+  return NUM_PRIOS;
+}
+
+/**
+ * @brief  links a thread into the ready list of its current priority
+ *
+ * @param  thread      the thread TCB structure
+ * @param  at_head     non-zero to prepend instead of append
+ */
+void ready_enqueue(tcb_t *thread, int at_head){
+  uint32_t prio = get_curr_prio(thread->id);
+  int state = save_interrupt_state_and_disable();
+
+  thread->rq_prio = prio;
+  if (gcb.ready_head[prio] == NULL){
+    thread->rq_next = NULL;
+    thread->rq_prev = NULL;
+    gcb.ready_head[prio] = thread;
+    gcb.ready_tail[prio] = thread;
+    gcb.ready_map[PRIO_WORD(prio)] |= PRIO_BIT(prio);
+  } else if (at_head){
+    thread->rq_prev = NULL;
+    thread->rq_next = gcb.ready_head[prio];
+    gcb.ready_head[prio]->rq_prev = thread;
+    gcb.ready_head[prio] = thread;
+  } else {
+    thread->rq_next = NULL;
+    thread->rq_prev = gcb.ready_tail[prio];
+    gcb.ready_tail[prio]->rq_next = thread;
+    gcb.ready_tail[prio] = thread;
+  }
+
+  restore_interrupt_state(state);
+}
+
+/**
+ * @brief  unlinks a thread from the ready list it was queued on
+ *
+ * @param  thread      the thread TCB structure
+ */
+void ready_dequeue(tcb_t *thread){
+  uint32_t prio = thread->rq_prio;
+  int state = save_interrupt_state_and_disable();
+
+  if (thread->rq_prev) thread->rq_prev->rq_next = thread->rq_next;
+  else gcb.ready_head[prio] = thread->rq_next;
+
+  if (thread->rq_next) thread->rq_next->rq_prev = thread->rq_prev;
+  else gcb.ready_tail[prio] = thread->rq_prev;
+
+  if (gcb.ready_head[prio] == NULL) gcb.ready_map[PRIO_WORD(prio)] &= ~PRIO_BIT(prio);
+  thread->rq_next = NULL;
+  thread->rq_prev = NULL;
+
+  restore_interrupt_state(state);
+}
+
+/**
+ * @brief  inserts a thread into the EDF ready heap, keyed by the absolute
+ *         deadline of its current job. Equal deadlines go to the lower id.
+ *
+ * @param  thread      the thread TCB structure
+ */
+void deadline_enqueue(tcb_t *thread){
+  int state = save_interrupt_state_and_disable();
+  thread->deadline_node.key = thread->next_deadline;
+  thread->deadline_node.tie = thread->id;
+  pq_insert(&gcb.deadline_q, &thread->deadline_node);
+  restore_interrupt_state(state);
+}
+
+/**
+ * @brief  moves a thread already in the EDF ready heap to its current
+ *         next_deadline
+ *
+ * @param  thread      the thread TCB structure
+ */
+void deadline_requeue(tcb_t *thread){
+  int state = save_interrupt_state_and_disable();
+  pq_update(&gcb.deadline_q, &thread->deadline_node, thread->next_deadline);
+  restore_interrupt_state(state);
+}
+
+/**
+ * @brief  removes a thread from the EDF ready heap
+ *
+ * @param  thread      the thread TCB structure
+ */
+void deadline_dequeue(tcb_t *thread){
+  int state = save_interrupt_state_and_disable();
+  pq_remove(&gcb.deadline_q, &thread->deadline_node);
+  restore_interrupt_state(state);
+}
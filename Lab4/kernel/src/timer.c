@@ -9,6 +9,7 @@
  */
 
 #include <timer.h>
+#include <arm.h>
 #include <unistd.h>
 #include <printk.h>
 #include <gpio.h>
@@ -32,6 +33,9 @@ struct STK_reg_map{
 /** @brief Enable higher speed clock */
 #define CLKSOURCE (1 << 2)
 
+/** @brief cycles from the cycle count read in timer_oneshot to the counter taking LOAD, by the Cortex-M4 timings */
+#define TIMER_RESTART_CYCLES 10
+
 /** @brief unused input func parameter specifier */
 #define UNUSED __attribute__((unused))
 
@@ -67,3 +71,37 @@ void timer_disable(){
     struct STK_reg_map *stk= STK_BASE;
     stk->CTRL&= ~ENABLE;
 }
+
+/** @brief cycles left before the systick counter next reaches 0 */
+uint32_t timer_remaining(){
+    struct STK_reg_map *stk= STK_BASE;
+    return stk->VAL;
+}
+
+/**
+ * @brief fires the systick interrupt once, adjust cycles after the current
+ *        period would have ended, then falls back to periodic interrupts
+ *        every reload + 1 cycles. The counter is stopped while LOAD and VAL
+ *        are set, and the cycles it misses are counted on the DWT cycle
+ *        counter and taken off the new count, so tick boundaries do not
+ *        drift. LOAD is only set to reload once the counter has taken the
+ *        one-shot count.
+ *
+ * @param adjust  cycles to add to what is left of the current period, negative to shorten it
+ * @param reload  the periodic reload value to go back to
+ */
+void timer_oneshot(int32_t adjust, uint32_t reload){
+    struct STK_reg_map *stk= STK_BASE;
+
+    stk->CTRL&= ~ENABLE;
+    uint32_t stopped= read_cycle_counter();
+    int32_t count= (int32_t)stk->VAL + adjust;
+
+    count-= (int32_t)(read_cycle_counter() - stopped) + TIMER_RESTART_CYCLES;
+    stk->LOAD= count > 1 ? count - 1 : 1;
+    stk->VAL= 0;
+    stk->CTRL|= ENABLE;
+    //VAL reads 0 until the first clock loads it from LOAD
+    while(stk->VAL == 0);
+    stk->LOAD= reload;
+}
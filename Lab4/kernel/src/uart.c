@@ -15,6 +15,7 @@
 #include <nvic.h>
 #include <arm.h>
 #include "printk.h"
+#include "syscall_sync.h"
 
 /** @brief The UART register map. */
 struct uart_reg_map {
@@ -79,6 +80,9 @@ extern uint8_t uart_buf[MAX_BUF];
 /** global uart buffer FIFO control */
 struct uart_fifo fifo;
 
+/** byte uart_poll_command took from DR that was not the command, -1 if none */
+static int held = -1;
+
 
 void block_interrupts(struct uart_reg_map *uart);
 
@@ -99,6 +103,7 @@ void uart_init(UNUSED int baud){
     fifo.write = 0; //set buffer control to empty values
     fifo.read = 0;
     fifo.count = 0;
+    held = -1;
 
     nvic_irq(38, IRQ_ENABLE);   //enable USART2 IRQ
 
@@ -141,7 +146,12 @@ int uart_get_byte(char *c){
     block_interrupts(uart);
 
     int success = -1;
-    if (fifo.count > 0) {
+    if (held >= 0) {
+        //Received before the read began, ahead of anything in the fifo
+        *c = (char)held;
+        held = -1;
+        success = 0;
+    } else if (fifo.count > 0) {
         *c = uart_buf[fifo.read++];
         fifo.count--;
         success = 0;
@@ -159,6 +169,7 @@ int uart_get_byte(char *c){
 /** @brief - services UART interrputs at the kernel level
  */
 void uart_irq_handler(){
+    irq_enter();
     nvic_clear_pending(38); //clear UART2 irq
     struct uart_reg_map *uart = UART2_BASE;
     int count, tmp;
@@ -171,6 +182,7 @@ void uart_irq_handler(){
             if (fifo.write == MAX_BUF){
                 fifo.write = 0;
             }
+            uart_rx_post();
 		}
     }
 
@@ -191,6 +203,7 @@ void uart_irq_handler(){
             count++;
         }
     }
+    irq_exit();
     return;
 }
 
@@ -206,9 +219,29 @@ void uart_flush(){
     int i=0;
     while(i<MAX_BUF)
         uart_buf[i++]= 0;
+    held = -1;
     (void)tmp;
 }
 
+/** @brief - checks for a console command byte while no read is in progress.
+ *  The RX interrupt is only enabled while a read is waiting, so otherwise
+ *  received bytes sit in DR until overrun. The command is consumed, any
+ *  other byte is held for the next uart_get_byte, and DR is left alone
+ *  until it is read, so no input is lost to the poll.
+ *  @param cmd - the command byte to look for
+ *  @return 1 if cmd was received, 0 otherwise
+ */
+int uart_poll_command(char cmd){
+    struct uart_reg_map *uart = UART2_BASE;
+    if (held >= 0 || !(uart->SR & RXNE) || (uart->CR1 & RXNEIE)) return 0;
+
+    char c = (char)uart->DR;
+    if (c == cmd) return 1;
+    held = (uint8_t)c;
+    uart_rx_post();
+    return 0;
+}
+
 /** @brief - blocks UART transmit/receive interrupts during critical section
  */
 void block_interrupts(struct uart_reg_map *uart){
@@ -47,6 +47,36 @@ intrinsic void wait_for_interrupt( void ) {
   __asm volatile( "wfi" );
 }
 
+/**
+ * @brief      Completes every memory access before the barrier ahead of any
+ *             after it, and keeps the compiler from moving them across. For
+ *             data two threads share without a lock.
+ */
+intrinsic void data_memory_barrier( void ) {
+  __asm volatile( "dmb" ::: "memory" );
+}
+
+/**
+ * @brief      Atomically replaces *addr by desired if it holds expected,
+ *             with LDREX/STREX. A store that loses its reservation, e.g. to
+ *             an interrupt, is retried against the new value.
+ *
+ * @return     1 if *addr was replaced, 0 if it did not hold expected
+ */
+intrinsic int compare_and_swap( volatile uint32_t *addr, uint32_t expected, uint32_t desired ) {
+  uint32_t old, failed;
+
+  do {
+    __asm volatile( "ldrex %0, [%1]" : "=r" ( old ) : "r" ( addr ) : "memory" );
+    if ( old != expected ) {
+      __asm volatile( "clrex" ::: "memory" );
+      return 0;
+    }
+    __asm volatile( "strex %0, %2, [%1]" : "=&r" ( failed ) : "r" ( addr ), "r" ( desired ) : "memory" );
+  } while ( failed );
+  return 1;
+}
+
 /**
  * @brief       Pretends to do work until the given time is past.
  *              For grading.
@@ -91,6 +121,34 @@ void print_status_prio_cnt( char *thread_name, int cnt );
  */
 uint32_t print_fibs( int limit, int interval, uint32_t mod );
 
+/**
+ * @brief           Prints "Failed. " and the message, then spins so that it
+ *                  stays the last line on the console. For tests.
+ *
+ * @param fmt       printf format of the message, without the newline
+ */
+void test_fail( const char *fmt, ... ) __attribute__( ( noreturn, format( printf, 1, 2 ) ) );
+
+/**
+ * @brief           Cycles the thread of priority prio has run, truncated to
+ *                  32 bits, enough to time the loops of one job.
+ *
+ * @param prio      priority of the thread
+ */
+uint32_t thread_cycles( uint32_t prio );
+
+/**
+ * @brief           Runs body calls times and adds the cycles thread prio
+ *                  spent to total. body may use the loop index i. Time an
+ *                  empty body the same way and subtract it to get the cost
+ *                  of the calls alone.
+ */
+#define TIME_LOOP( total, prio, calls, body ) do { \
+  uint32_t start_ = thread_cycles( prio ); \
+  for ( uint32_t i = 0; i < ( calls ); i++ ) { body; } \
+  ( total ) += thread_cycles( prio ) - start_; \
+} while ( 0 )
+
 #undef intrinsic
 
 #endif /* _THREADS_349_ */
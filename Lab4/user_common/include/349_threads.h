@@ -11,7 +11,8 @@
 
 #include <stdint.h>
 
-typedef enum { PER_THREAD = 1, KERNEL_ONLY = 0 } memory_protection_t;
+typedef enum { PER_THREAD = 1, KERNEL_ONLY = 0, TICKLESS = 1 << 1,
+               SCHED_EDF = 1 << 2 } memory_protection_t;
 
 /**
  * @brief      Initialize the thread library
@@ -21,13 +22,25 @@ typedef enum { PER_THREAD = 1, KERNEL_ONLY = 0 } memory_protection_t;
  *
  * @param      max_threads        max number of threads created
  * @param      stack_size         Declares the size in words of all the stacks
- *                                for subsequent calls to thread create.
+ *                                for subsequent calls to thread create. It
+ *                                need not be a power of two: stacks are
+ *                                rounded up to eighths of a power of two,
+ *                                and in both protection modes one more
+ *                                eighth below each is a guard, so a thread
+ *                                that overflows its stack is killed before
+ *                                it reaches the next one.
  * @param      idle_func          Pointer to a thread function to run when no
  *                                other threads are runnable, if arg is NULL,
  *                                then kernel will supply default idle thread.
  * @param      memory_protection  If KERNEL_ONLY, then kernel will be
  *                                protected if PER_THREAD, perthread mem
  *                                protection in addition to kernel protection.
+ *                                OR in TICKLESS to stop the scheduler tick
+ *                                while every thread waits for its period,
+ *                                and SCHED_EDF to run the earliest deadline
+ *                                first with a U <= 1 admission test instead
+ *                                of fixed priorities with response-time
+ *                                analysis.
  * @param      max_mutexes        max number of mutexes created
  *
  * @return     0 on success or -1 on failure
@@ -40,8 +53,8 @@ int thread_init( uint32_t max_threads,
 
 /**
  * @brief      Create a new thread running the given function. The thread will
- *             not be created if the UB test fails, and in that case this function
- *             will return an error.
+ *             not be created if the admission test fails, and in that case
+ *             this function will return an error.
  *
  * @param      fn     Pointer to the function to run in the new thread.
  * @param      prio   Priority of this thread. Lower number are higher
@@ -73,7 +86,8 @@ int thread_create( void ( *fn )( void *vargp ),
 int scheduler_start( uint32_t frequency );
 
 /**
- * @brief      Get the current time.
+ * @brief      Get the current time. This, get_priority() and thread_time()
+ *             read the kernel's time page and make no system call.
  *
  * @return     The time in ticks.
  */
@@ -99,6 +113,113 @@ uint32_t thread_time( void );
  */
 void wait_until_next_period( void );
 
+/**
+ * @brief      Blocks the thread for a number of ticks. Unlike spin_wait(),
+ *             the thread is not runnable meanwhile, so lower priority
+ *             threads run and, with nothing else to do, the CPU sleeps.
+ *             Ticks spent asleep do not count against the thread's budget.
+ *
+ * @param      ticks  Ticks to sleep, 0 returns at once.
+ *
+ * @return     0 once woken, -1 if called from main
+ */
+int sleep_ticks( uint32_t ticks );
+
+/**
+ * @brief      Blocks the thread until get_time() reaches a tick. Sleeping
+ *             until a time computed from the last wake, rather than for a
+ *             number of ticks, does not drift.
+ *
+ * @param      tick  Time to wake at. A time already reached returns at once.
+ *
+ * @return     0 once woken, -1 if called from main
+ */
+int sleep_until( uint32_t tick );
+
+/**
+ * @brief      Per-thread timing statistics, kept by the kernel since the
+ *             thread was created. Latency is the delay from a job's release
+ *             to its first instruction, so max_latency - min_latency is the
+ *             release jitter.
+ */
+typedef struct {
+  uint32_t jobs;            /**< jobs that finished by waiting for the next period */
+  uint32_t deadline_misses; /**< jobs still unfinished when the next one was released, overruns among them */
+  uint32_t overruns;        /**< jobs stopped for using up their budget C */
+  uint32_t wcrt;            /**< worst observed release to completion time, in ticks */
+  uint32_t min_latency;     /**< least release to first run delay, in ticks */
+  uint32_t max_latency;     /**< most release to first run delay, in ticks */
+} thread_stats_t;
+
+/**
+ * @brief      Get the timing statistics the kernel keeps for a thread. They
+ *             are also printed by sending Ctrl-T over UART, once the CPU idles.
+ *
+ * @param      prio   Priority the thread was created with.
+ * @param      stats  Where to store the statistics.
+ *
+ * @return     0 on success or -1 if no thread has that priority
+ */
+int thread_stats( uint32_t prio, thread_stats_t *stats );
+
+/**
+ * @brief      Runs work the kernel defers to the idle thread, the Ctrl-T
+ *             statistics dump and the sampling of stack peaks, if any is
+ *             waiting. The default idle thread calls it each time it
+ *             wakes; an idle function passed to thread_init should call it
+ *             in its loop, or Ctrl-T prints nothing and the peaks it prints
+ *             are only updated by thread_stack_usage. Any other thread
+ *             calling it does nothing.
+ */
+void idle_work( void );
+
+/**
+ * @brief      Stack use of a thread. Its stacks are painted with a pattern
+ *             when it is created, and the peak is how far down the pattern
+ *             has been overwritten, so it covers the thread's whole life.
+ */
+typedef struct {
+  uint32_t user_size;   /**< bytes of the user stack above its guard */
+  uint32_t user_peak;   /**< most bytes of the user stack used */
+  uint32_t kernel_size; /**< bytes of the kernel stack above its guard */
+  uint32_t kernel_peak; /**< most bytes of the kernel stack used, by syscalls and interrupts */
+} stack_usage_t;
+
+/**
+ * @brief      Get the peak stack use of a thread, to size stack_size in
+ *             thread_init. It is also printed for every thread by Ctrl-T.
+ *
+ * @param      prio   Priority the thread was created with.
+ * @param      usage  Where to store the stack use.
+ *
+ * @return     0 on success or -1 if no thread has that priority, or
+ *             usage is not writable
+ */
+int thread_stack_usage( uint32_t prio, stack_usage_t *usage );
+
+/**
+ * @brief      Counters reported by cpu_cycles(), all in CPU cycles.
+ */
+typedef enum {
+  CPU_THREAD = 0, /**< run by the thread with the given priority, syscalls included */
+  CPU_THREAD_SVC, /**< the part of CPU_THREAD spent inside syscalls */
+  CPU_IDLE,       /**< run by the idle thread */
+  CPU_KERNEL,     /**< spent in the SysTick, PendSV and UART handlers */
+  CPU_TOTAL       /**< elapsed since the scheduler started */
+} cpu_counter_t;
+
+/**
+ * @brief      Reads a CPU cycle counter kept by the kernel. The idle
+ *             percentage is 100 * cpu_cycles( CPU_IDLE, 0 ) divided by
+ *             cpu_cycles( CPU_TOTAL, 0 ).
+ *
+ * @param      counter  Which counter to read.
+ * @param      prio     Thread priority, for CPU_THREAD and CPU_THREAD_SVC.
+ *
+ * @return     The cycle count, 0 if no thread has that priority
+ */
+uint64_t cpu_cycles( cpu_counter_t counter, uint32_t prio );
+
 /**
  * @brief      Type definition for mutex, opaque to user
  */
@@ -134,4 +255,217 @@ void mutex_lock( mutex_t *mutex );
  */
 void mutex_unlock( mutex_t *mutex );
 
+/** @brief blocking time histogram buckets: 0, 1, 2-3, 4-7, ... ticks, the last one open ended */
+#define MUTEX_HIST_BUCKETS 8
+
+/**
+ * @brief      Lock statistics of a mutex, kept by the kernel since it was
+ *             initialized. A lock's blocking time runs from the call to
+ *             mutex_lock() until the mutex is handed over. They are also
+ *             printed with the thread statistics on Ctrl-T.
+ */
+typedef struct {
+  uint32_t locks;     /**< lock calls that got the mutex */
+  uint32_t blocked;   /**< the part of locks that had to wait */
+  uint32_t max_block; /**< longest blocking time, in ticks */
+  uint32_t hist[MUTEX_HIST_BUCKETS]; /**< locks by blocking time, bucket b > 0 holding 2^(b-1) to 2^b - 1 ticks */
+} mutex_stats_t;
+
+/**
+ * @brief      Get the lock statistics the kernel keeps for a mutex.
+ *
+ * @param      mutex  The mutex to report on.
+ * @param      stats  Where to store the statistics.
+ *
+ * @return     0 on success or -1 if mutex is not a mutex handle
+ */
+int mutex_stats( mutex_t *mutex, mutex_stats_t *stats );
+
+/**
+ * @brief      Type definitions for semaphores and event flag groups, opaque
+ *             to user
+ */
+//@{
+typedef void sem_t;
+typedef void event_t;
+//@}
+
+/** @brief timeout of the sem_, event_ and mq_ waits that never expires */
+#define WAIT_FOREVER 0xFFFFFFFF
+
+/** @brief event_wait() modes, ANY or ALL optionally with CLEAR */
+//@{
+#define EVENT_ANY   0        /**< wake when any flag of the mask is set */
+#define EVENT_ALL   ( 1 << 0 ) /**< wake when every flag of the mask is set */
+#define EVENT_CLEAR ( 1 << 1 ) /**< clear the flags that woke the thread */
+//@}
+
+/**
+ * @brief      Initialize a counting semaphore
+ *
+ * @param      count  Units initially available.
+ *
+ * @return     A semaphore handle. NULL if the kernel has no semaphore left.
+ */
+sem_t *sem_init( uint32_t count );
+
+/**
+ * @brief      Take a unit from a semaphore
+ *
+ *             Blocks until a unit is posted if none is available. Waiting
+ *             threads are served highest priority first.
+ *
+ * @param      sem      The semaphore to act on.
+ * @param      timeout  Ticks to wait at most, 0 to return at once, or
+ *                      WAIT_FOREVER.
+ *
+ * @return     0 once a unit was taken, -1 on timeout
+ */
+int sem_wait( sem_t *sem, uint32_t timeout );
+
+/**
+ * @brief      Return a unit to a semaphore, waking a waiting thread
+ *
+ * @param      sem  The semaphore to act on.
+ *
+ * @return     0 on success or -1 if sem is not a semaphore handle
+ */
+int sem_post( sem_t *sem );
+
+/**
+ * @brief      Initialize a group of 32 event flags, all clear
+ *
+ * @return     An event handle. NULL if the kernel has no group left.
+ */
+event_t *event_init( void );
+
+/**
+ * @brief      Wait for event flags to be set
+ *
+ * @param      event    The group to act on.
+ * @param      mask     Flags to wait for.
+ * @param      mode     EVENT_ANY or EVENT_ALL, optionally | EVENT_CLEAR to
+ *                      clear the flags that ended the wait.
+ * @param      timeout  Ticks to wait at most, 0 to return at once, or
+ *                      WAIT_FOREVER.
+ *
+ * @return     The flags of mask that ended the wait, 0 on timeout
+ */
+uint32_t event_wait( event_t *event, uint32_t mask, uint32_t mode, uint32_t timeout );
+
+/**
+ * @brief      Set event flags, waking every thread they satisfy
+ *
+ * @param      event  The group to act on.
+ * @param      flags  Flags to set.
+ *
+ * @return     0 on success or -1 if event is not an event handle
+ */
+int event_set( event_t *event, uint32_t flags );
+
+/**
+ * @brief      Clear event flags
+ *
+ * @param      event  The group to act on.
+ * @param      flags  Flags to clear.
+ *
+ * @return     0 on success or -1 if event is not an event handle
+ */
+int event_clear( event_t *event, uint32_t flags );
+
+/**
+ * @brief      Type definition for message queues, opaque to user
+ */
+typedef void mqueue_t;
+
+/**
+ * @brief      Initialize a queue of fixed-size messages. The kernel keeps
+ *             its depth buffers in the stack space past the max_threads
+ *             stacks thread_init() reserved.
+ *
+ * @param      msg_size  Bytes per message, at most 64K.
+ * @param      depth     Buffers, at most 32.
+ *
+ * @return     A queue handle. NULL if the kernel has no queue left or no
+ *             room for the buffers.
+ */
+mqueue_t *mq_init( uint32_t msg_size, uint32_t depth );
+
+/**
+ * @brief      Copy a message into a queue, waking the highest priority
+ *             receiver
+ *
+ * @param      mq       The queue to act on.
+ * @param      msg      msg_size bytes to send.
+ * @param      timeout  Ticks to wait for a free buffer, 0 to not wait or
+ *                      WAIT_FOREVER.
+ *
+ * @return     0 once queued, -1 on timeout, if mq is not a queue handle
+ *             or if the caller cannot read msg
+ */
+int mq_send( mqueue_t *mq, const void *msg, uint32_t timeout );
+
+/**
+ * @brief      Copy the oldest message out of a queue
+ *
+ * @param      mq       The queue to act on.
+ * @param      msg      Where to store msg_size bytes.
+ * @param      timeout  Ticks to wait for a message, 0 to not wait or
+ *                      WAIT_FOREVER.
+ *
+ * @return     0 once received, -1 on timeout, if mq is not a queue handle
+ *             or if the caller cannot write msg
+ */
+int mq_receive( mqueue_t *mq, void *msg, uint32_t timeout );
+
+/**
+ * @brief      Take a free buffer of a queue to build a message in place.
+ *             The caller owns it until mq_send_buf() or mq_free(). Only
+ *             KERNEL_ONLY threads can reach the kernel's buffers.
+ *
+ * @param      mq       The queue to act on.
+ * @param      timeout  Ticks to wait for a free buffer, 0 to not wait or
+ *                      WAIT_FOREVER.
+ *
+ * @return     The buffer, NULL on timeout, if mq is not a queue handle or
+ *             under PER_THREAD
+ */
+void *mq_alloc( mqueue_t *mq, uint32_t timeout );
+
+/**
+ * @brief      Queue an owned buffer without copying it, handing it to the
+ *             highest priority receiver. Never blocks.
+ *
+ * @param      mq   The queue to act on.
+ * @param      buf  A buffer from mq_alloc() or mq_receive_buf().
+ *
+ * @return     0 on success or -1 if the caller does not own buf
+ */
+int mq_send_buf( mqueue_t *mq, void *buf );
+
+/**
+ * @brief      Take the oldest queued buffer without copying it. The caller
+ *             owns it until mq_free() or mq_send_buf(). Only KERNEL_ONLY
+ *             threads can reach the kernel's buffers.
+ *
+ * @param      mq       The queue to act on.
+ * @param      timeout  Ticks to wait for a message, 0 to not wait or
+ *                      WAIT_FOREVER.
+ *
+ * @return     The buffer, NULL on timeout, if mq is not a queue handle or
+ *             under PER_THREAD
+ */
+void *mq_receive_buf( mqueue_t *mq, uint32_t timeout );
+
+/**
+ * @brief      Return an owned buffer to its queue, waking the highest
+ *             priority thread waiting for one
+ *
+ * @param      mq   The queue to act on.
+ * @param      buf  A buffer from mq_alloc() or mq_receive_buf().
+ *
+ * @return     0 on success or -1 if the caller does not own buf
+ */
+int mq_free( mqueue_t *mq, void *buf );
+
 #endif /* _SYSCALL_THREAD_H_ */
@@ -0,0 +1,75 @@
+/** @file spsc_ring.h
+ *
+ *  @brief  Single-producer single-consumer ring of fixed-size messages,
+ *          for one thread to stream data to another without system calls.
+ *          The producer only writes tail and the consumer only writes head,
+ *          so barriers are enough to order them and neither side locks.
+ *          A consumer that finds the ring empty may sleep on a kernel
+ *          semaphore, the doorbell, which the producer posts only while the
+ *          consumer has announced it is waiting. As long as the consumer
+ *          keeps up without running dry, pushes and pops stay in user space.
+ *
+ *          Both threads must be able to reach the ring and its storage, so
+ *          under PER_THREAD protection keep them in globals or on the heap.
+ *
+ *  @author Arden Diakhate-Palme
+ */
+
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#include <stdint.h>
+#include <349_threads.h>
+
+/**
+ * @brief      A ring shared by one producer and one consumer thread.
+ */
+typedef struct {
+  volatile uint32_t head;    /**< messages popped, written by the consumer only */
+  volatile uint32_t tail;    /**< messages pushed, written by the producer only */
+  volatile uint32_t waiting; /**< set while the consumer may sleep on the doorbell */
+  uint32_t mask;             /**< slots - 1, slots is a power of 2 */
+  uint32_t msg_size;         /**< bytes per message */
+  uint8_t *storage;          /**< slots * msg_size bytes */
+  sem_t *doorbell;           /**< posted by the producer to wake the consumer */
+  uint32_t doorbells;        /**< times the producer posted the doorbell */
+} spsc_ring_t;
+
+/**
+ * @brief      Initialize an empty ring. Call after thread_init(), as the
+ *             doorbell is a kernel semaphore.
+ *
+ * @param      ring      The ring.
+ * @param      storage   slots * msg_size bytes for the messages.
+ * @param      slots     Messages the ring holds, a power of 2.
+ * @param      msg_size  Bytes per message.
+ *
+ * @return     0 on success, -1 if slots is not a power of 2 or the kernel has
+ *             no semaphore left
+ */
+int spsc_init( spsc_ring_t *ring, void *storage, uint32_t slots, uint32_t msg_size );
+
+/**
+ * @brief      Copy a message into the ring, ringing the doorbell if the
+ *             consumer waits for it. Producer only, never blocks.
+ *
+ * @param      ring  The ring.
+ * @param      msg   msg_size bytes to push.
+ *
+ * @return     0 on success, -1 if the ring is full
+ */
+int spsc_push( spsc_ring_t *ring, const void *msg );
+
+/**
+ * @brief      Copy the oldest message out of the ring, sleeping until the
+ *             producer pushes one if it is empty. Consumer only.
+ *
+ * @param      ring     The ring.
+ * @param      msg      Where to store msg_size bytes.
+ * @param      timeout  Ticks to wait at most, 0 to not wait or WAIT_FOREVER.
+ *
+ * @return     0 on success, -1 if the ring stayed empty
+ */
+int spsc_pop( spsc_ring_t *ring, void *msg, uint32_t timeout );
+
+#endif /* _SPSC_RING_H_ */
@@ -0,0 +1,72 @@
+/** @file svc_ring.h
+ *
+ *  @brief  Batched system calls. A thread queues calls in a submission
+ *          ring and runs them all with one SVC, svc_ring_submit(), which
+ *          leaves one completion per call in a companion ring. A thread
+ *          that logs or drives actuators at a high rate then pays one trap
+ *          per batch rather than one per call.
+ *
+ *          The calls run in order, exactly as if made one by one. Only
+ *          calls that never block may be queued, the kernel fails any other
+ *          with -1. Buffers passed to queued calls must stay valid until
+ *          the batch is submitted. A ring belongs to a single thread.
+ *
+ *  @author Arden Diakhate-Palme
+ */
+
+#ifndef _SVC_RING_H_
+#define _SVC_RING_H_
+
+#include <stdint.h>
+#include <349_threads.h>
+#include "../../kernel/include/svc_batch.h"
+
+/**
+ * @brief      Initialize empty rings.
+ *
+ * @param      ring     The rings.
+ * @param      sq       Storage for entries submissions.
+ * @param      cq       Storage for entries completions.
+ * @param      entries  Calls each ring holds, a power of 2 up to
+ *                      SVC_RING_ENTRIES_MAX.
+ *
+ * @return     0 on success, -1 if entries is not such a power of 2
+ */
+int svc_ring_init( svc_ring_t *ring, svc_sqe_t *sq, svc_cqe_t *cq, uint32_t entries );
+
+/**
+ * @brief      Queue calls, to run at the next svc_ring_submit().
+ *
+ * @param      ring  The rings.
+ * @param      tag   Value the call's completion carries.
+ *
+ * @return     0 on success, -1 if the submission ring is full
+ */
+//@{
+int svc_ring_write( svc_ring_t *ring, int fd, const void *buf, uint32_t len, uint32_t tag );
+int svc_ring_mutex_unlock( svc_ring_t *ring, mutex_t *mutex, uint32_t tag );
+int svc_ring_get_time( svc_ring_t *ring, uint32_t tag );
+//@}
+
+/**
+ * @brief      Run the queued calls with a single system call. It stops
+ *             early if the completion ring fills, the rest stay queued.
+ *
+ * @param      ring  The rings.
+ *
+ * @return     The number of calls run, 0 if the kernel cannot reach the
+ *             rings or they are not laid out as svc_ring_init() leaves them
+ */
+uint32_t svc_ring_submit( svc_ring_t *ring );
+
+/**
+ * @brief      Take the oldest completion.
+ *
+ * @param      ring  The rings.
+ * @param      cqe   Where to store it.
+ *
+ * @return     0 on success, -1 if there is none
+ */
+int svc_ring_complete( svc_ring_t *ring, svc_cqe_t *cqe );
+
+#endif /* _SVC_RING_H_ */
@@ -0,0 +1,29 @@
+/** @file time_page.h
+ *
+ *  @brief  The page of kernel state user code reads in place of a system
+ *          call. get_time(), get_priority() and thread_time() read it, and
+ *          umutex_lock() takes the running thread's id and held map from it. The kernel
+ *          rewrites it on every tick, context switch and priority change,
+ *          and under PER_THREAD protection user code can only read it.
+ *
+ *  @author Arden Diakhate-Palme
+ */
+
+#ifndef _TIME_PAGE_H_
+#define _TIME_PAGE_H_
+
+#include <stdint.h>
+#include "../../kernel/include/time_page_layout.h"
+
+/** @brief the time page, placed by the linker */
+extern const time_page_t _time_page;
+
+/**
+ * @brief      get_time() through the system call, which is also correct in
+ *             a tickless sleep. For comparison and the sleeping idle thread.
+ *
+ * @return     The time in ticks.
+ */
+uint32_t get_time_slow( void );
+
+#endif /* _TIME_PAGE_H_ */
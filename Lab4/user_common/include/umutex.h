@@ -0,0 +1,71 @@
+/** @file umutex.h
+ *
+ *  @brief  User mutexes. They follow the same priority ceiling protocol as
+ *          mutex_t, but an uncontended lock and unlock is an exclusive
+ *          store on a word in user memory, with no system call. The kernel
+ *          is only entered when the mutex is held by another thread, or
+ *          when the holder was about to be preempted and the kernel applied
+ *          the ceiling for it, in which case the unlock traps to lower the
+ *          thread again. So the kernel need not search for them, a thread
+ *          marks the mutexes it holds in its held map, from the time page.
+ *
+ *          The lock word must be reachable by every thread using the
+ *          mutex, so under PER_THREAD protection keep the umutex_t in a
+ *          global or on the heap.
+ *
+ *  @author Arden Diakhate-Palme
+ */
+
+#ifndef _UMUTEX_H_
+#define _UMUTEX_H_
+
+#include <stdint.h>
+#include <349_threads.h>
+
+/**
+ * @brief      A user mutex.
+ */
+typedef struct {
+  volatile uint32_t word; /**< 0 if free, the holder's thread id + 1 otherwise */
+  mutex_t *kernel;        /**< kernel mutex backing it, for the slow paths */
+  uint32_t bit;           /**< its bit in the held maps */
+} umutex_t;
+
+/**
+ * @brief      Initialize a user mutex. It takes one of the max_mutexes given
+ *             to thread_init().
+ *
+ * @param      mutex     The mutex.
+ * @param      max_prio  The maximum priority of a thread which could use
+ *                       this mutex.
+ *
+ * @return     0 on success, -1 if max_mutexes or the 32 user mutexes would
+ *             be exceeded, or the heap has no room for the held maps
+ */
+int umutex_init( umutex_t *mutex, uint32_t max_prio );
+
+/**
+ * @brief      Lock a user mutex, waiting in the kernel if another thread
+ *             holds it.
+ *
+ * @param      mutex  The mutex to act on.
+ */
+void umutex_lock( umutex_t *mutex );
+
+/**
+ * @brief      Unlock a user mutex.
+ *
+ * @param      mutex  The mutex to act on.
+ */
+void umutex_unlock( umutex_t *mutex );
+
+/**
+ * @brief      System calls behind the user mutexes, for umutex.c only
+ */
+//@{
+mutex_t *umutex_register( volatile uint32_t *word, uint32_t max_prio, uint32_t *bit );
+int umutex_lock_slow( mutex_t *mutex );
+int umutex_unlock_slow( mutex_t *mutex );
+//@}
+
+#endif /* _UMUTEX_H_ */
@@ -1,5 +1,6 @@
 #include <349_threads.h>
 #include <349_lib.h>
+#include <stdarg.h>
 
 void spin_wait( uint32_t ms ) {
   uint32_t targetTime = thread_time() + ms;
@@ -96,3 +97,18 @@ uint32_t print_fibs( int limit, int interval, uint32_t mod) {
   return b;
 
 }
+
+void test_fail( const char *fmt, ... ) {
+  va_list args;
+
+  printf( "Failed. " );
+  va_start( args, fmt );
+  vprintf( fmt, args );
+  va_end( args );
+  printf( "\n" );
+  while ( 1 );
+}
+
+uint32_t thread_cycles( uint32_t prio ) {
+  return ( uint32_t )cpu_cycles( CPU_THREAD, prio );
+}
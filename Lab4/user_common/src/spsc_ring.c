@@ -0,0 +1,85 @@
+/** @file spsc_ring.c
+ *
+ *  @brief  Single-producer single-consumer ring. Push and pop only touch
+ *          the ring; the producer makes a system call only to ring the
+ *          doorbell of a consumer that announced it would sleep, and the
+ *          consumer only to sleep on it.
+ *
+ *  @author Arden Diakhate-Palme
+ */
+
+#include <string.h>
+#include <349_lib.h>
+#include <spsc_ring.h>
+
+int spsc_init( spsc_ring_t *ring, void *storage, uint32_t slots, uint32_t msg_size ) {
+  if ( slots == 0 || ( slots & ( slots - 1 ) ) || msg_size == 0 ) return -1;
+
+  ring->doorbell = sem_init( 0 );
+  if ( ring->doorbell == NULL ) return -1;
+
+  ring->head = 0;
+  ring->tail = 0;
+  ring->waiting = 0;
+  ring->mask = slots - 1;
+  ring->msg_size = msg_size;
+  ring->storage = storage;
+  ring->doorbells = 0;
+  return 0;
+}
+
+int spsc_push( spsc_ring_t *ring, const void *msg ) {
+  uint32_t tail = ring->tail;
+
+  // head and tail run free, they are only ever compared by difference
+  if ( tail - ring->head > ring->mask ) return -1;
+  memcpy( ring->storage + ( tail & ring->mask ) * ring->msg_size, msg, ring->msg_size );
+
+  // The message must be in place before the consumer can see the new tail,
+  // and the tail must be visible before waiting is read. The consumer writes
+  // waiting and then reads tail, so one of the two sees the other's write.
+  data_memory_barrier();
+  ring->tail = tail + 1;
+  data_memory_barrier();
+
+  // Clearing waiting keeps a burst of pushes to one post per sleep
+  if ( ring->waiting ) {
+    ring->waiting = 0;
+    ring->doorbells++;
+    sem_post( ring->doorbell );
+  }
+  return 0;
+}
+
+int spsc_pop( spsc_ring_t *ring, void *msg, uint32_t timeout ) {
+  while ( ring->tail == ring->head ) {
+    if ( timeout == 0 ) return -1;
+
+    // Announce the sleep before looking again, a push after the look rings
+    ring->waiting = 1;
+    data_memory_barrier();
+    if ( ring->tail == ring->head ) {
+      // A stale post from a look that found data only costs one more lap
+      uint32_t start = timeout != WAIT_FOREVER ? get_time() : 0;
+      int rung = sem_wait( ring->doorbell, timeout ) == 0;
+
+      if ( !rung ) {
+        timeout = 0;
+      } else if ( timeout != WAIT_FOREVER ) {
+        uint32_t slept = get_time() - start;
+        timeout = slept < timeout ? timeout - slept : 0;
+      }
+    }
+    ring->waiting = 0;
+  }
+
+  uint32_t head = ring->head;
+
+  // Read the message only after seeing the tail that published it, and
+  // finish reading before handing the slot back to the producer
+  data_memory_barrier();
+  memcpy( msg, ring->storage + ( head & ring->mask ) * ring->msg_size, ring->msg_size );
+  data_memory_barrier();
+  ring->head = head + 1;
+  return 0;
+}
@@ -0,0 +1,50 @@
+#include <svc_ring.h>
+#include "../../kernel/include/svc_num.h"
+
+int svc_ring_init( svc_ring_t *ring, svc_sqe_t *sq, svc_cqe_t *cq, uint32_t entries ) {
+  if ( entries == 0 || entries > SVC_RING_ENTRIES_MAX || ( entries & ( entries - 1 ) ) ) return -1;
+
+  ring->sq_head = 0;
+  ring->sq_tail = 0;
+  ring->cq_head = 0;
+  ring->cq_tail = 0;
+  ring->mask = entries - 1;
+  ring->sq = sq;
+  ring->cq = cq;
+  return 0;
+}
+
+/** @brief queues SVC num with up to three arguments */
+static int svc_ring_push( svc_ring_t *ring, uint32_t num, uint32_t tag,
+                          uint32_t a0, uint32_t a1, uint32_t a2 ) {
+  if ( ring->sq_tail - ring->sq_head > ring->mask ) return -1;
+
+  svc_sqe_t *sqe = &ring->sq[ring->sq_tail & ring->mask];
+  sqe->num = num;
+  sqe->args[0] = a0;
+  sqe->args[1] = a1;
+  sqe->args[2] = a2;
+  sqe->tag = tag;
+  ring->sq_tail++;
+  return 0;
+}
+
+int svc_ring_write( svc_ring_t *ring, int fd, const void *buf, uint32_t len, uint32_t tag ) {
+  return svc_ring_push( ring, SVC_WRITE, tag, fd, ( uint32_t )buf, len );
+}
+
+int svc_ring_mutex_unlock( svc_ring_t *ring, mutex_t *mutex, uint32_t tag ) {
+  return svc_ring_push( ring, SVC_MUT_ULK, tag, ( uint32_t )mutex, 0, 0 );
+}
+
+int svc_ring_get_time( svc_ring_t *ring, uint32_t tag ) {
+  return svc_ring_push( ring, SVC_TIME, tag, 0, 0, 0 );
+}
+
+int svc_ring_complete( svc_ring_t *ring, svc_cqe_t *cqe ) {
+  if ( ring->cq_head == ring->cq_tail ) return -1;
+
+  *cqe = ring->cq[ring->cq_head & ring->mask];
+  ring->cq_head++;
+  return 0;
+}
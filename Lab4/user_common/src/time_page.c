@@ -0,0 +1,25 @@
+#include <349_threads.h>
+#include <time_page.h>
+
+uint32_t get_time( void ) {
+  uint32_t seq, ticks, tickless;
+
+  // The two words must come from the same update, retry if the kernel wrote the page in between
+  do {
+    seq = _time_page.seq;
+    ticks = _time_page.ticks;
+    tickless = _time_page.tickless;
+  } while ( ( seq & 1 ) || seq != _time_page.seq );
+
+  // Only the idle thread runs in a tickless sleep, and only the kernel can tell how far it is
+  return tickless ? get_time_slow() : ticks;
+}
+
+// A single word is read in one load, so these need no retry
+uint32_t get_priority( void ) {
+  return _time_page.prio;
+}
+
+uint32_t thread_time( void ) {
+  return _time_page.thread_ticks;
+}
@@ -0,0 +1,23 @@
+#include <349_lib.h>
+#include <time_page.h>
+#include <umutex.h>
+
+int umutex_init( umutex_t *mutex, uint32_t max_prio ) {
+  mutex->kernel = umutex_register( &mutex->word, max_prio, &mutex->bit );
+  return mutex->kernel != NULL ? 0 : -1;
+}
+
+void umutex_lock( umutex_t *mutex ) {
+  // Marked before the lock, so a preemption right after it finds the mutex
+  _time_page.umutex_held[_time_page.running - 1] |= mutex->bit;
+  if ( !compare_and_swap( &mutex->word, 0, _time_page.running ) ) umutex_lock_slow( mutex->kernel );
+  data_memory_barrier();
+}
+
+void umutex_unlock( umutex_t *mutex ) {
+  data_memory_barrier();
+  // Any other value means the kernel locked the mutex too and must unlock it
+  if ( !compare_and_swap( &mutex->word, _time_page.running, 0 ) ) umutex_unlock_slow( mutex->kernel );
+  // Cleared after the unlock, a stale bit only costs the kernel a look
+  _time_page.umutex_held[_time_page.running - 1] &= ~mutex->bit;
+}
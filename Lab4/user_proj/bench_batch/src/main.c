@@ -0,0 +1,138 @@
+/**
+ * @file   main.c
+ *
+ * @brief  Batched system call benchmark. Every job a logger thread locks
+ *         a shared log with mutex_lock(), emits RECORDS short records with
+ *         write() and unlocks it. With -m single each call is its own SVC.
+ *         With -m batch the writes and the mutex_unlock() are queued in a
+ *         svc_ring_t and run by one svc_ring_submit(), and every
+ *         completion is checked. The lock stays a call of its own, as a
+ *         batch only runs calls that never block. A record is
+ *         4 bytes, so the UART drains the log well within a period and the
+ *         cycles measured are the traps and the calls.
+ *
+ *         make flash USER_PROJ=bench_batch USER_ARG="-m batch"
+ *
+ *         -m single|batch   how the calls are made (default batch)
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <svc_ring.h>
+#include <time_page.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define NUM_THREADS 1
+#define NUM_MUTEXES 1
+#define CLOCK_FREQUENCY 1000
+
+/** @brief log records per job */
+#define RECORDS 16
+/** @brief ring entries, enough for a whole job */
+#define ENTRIES 64
+/** @brief bytes per record */
+#define RECORD_LEN 4
+/** @brief jobs timed */
+#define ROUNDS 50
+#define PERIOD 10
+#define BUDGET 5
+
+/** @brief whether the calls are batched */
+static int batched = 1;
+static mutex_t *log_mutex;
+
+static svc_ring_t ring;
+static svc_sqe_t sq[ENTRIES];
+static svc_cqe_t cq[ENTRIES];
+
+/** @brief cycles the logger spent emitting records */
+static uint32_t cycles;
+/** @brief calls that returned something unexpected */
+static volatile uint32_t errors;
+
+void logger_thread( void *vargp ) {
+  ( void )vargp;
+  static const char records[RECORDS][RECORD_LEN + 1] = {
+    "0...", "1...", "2...", "3...", "4...", "5...", "6...", "7...",
+    "8...", "9...", "a...", "b...", "c...", "d...", "e...", "f...\n"
+  };
+  svc_cqe_t cqe;
+
+  for ( uint32_t round = 0; round < ROUNDS; round++ ) {
+    uint32_t start = thread_cycles( 0 );
+
+    mutex_lock( log_mutex );
+    if ( batched ) {
+      for ( uint32_t i = 0; i < RECORDS; i++ ) svc_ring_write( &ring, STDOUT_FILENO, records[i], RECORD_LEN, 1 );
+      svc_ring_mutex_unlock( &ring, log_mutex, 2 );
+      if ( svc_ring_submit( &ring ) != RECORDS + 1 ) errors++;
+      while ( svc_ring_complete( &ring, &cqe ) == 0 ) {
+        if ( cqe.tag == 1 && cqe.result != RECORD_LEN ) errors++;
+      }
+    } else {
+      for ( uint32_t i = 0; i < RECORDS; i++ ) {
+        if ( write( STDOUT_FILENO, records[i], RECORD_LEN ) != RECORD_LEN ) errors++;
+      }
+      mutex_unlock( log_mutex );
+    }
+
+    cycles += thread_cycles( 0 ) - start;
+    wait_until_next_period();
+  }
+}
+
+int main( int argc, char *const argv[] ) {
+  int opt;
+
+  while ( ( opt = getopt( argc, argv, "m:" ) ) != -1 ) {
+    switch ( opt ) {
+    case 'm':
+      batched = strcmp( optarg, "single" ) != 0;
+      break;
+
+    default:
+      return -1;
+    }
+  }
+
+  ABORT_ON_ERROR( thread_init( NUM_THREADS, USR_STACK_WORDS, NULL, KERNEL_ONLY, NUM_MUTEXES ) );
+  ABORT_ON_ERROR( svc_ring_init( &ring, sq, cq, ENTRIES ) );
+
+  // The kernel must refuse rings it cannot write the completions of, or whose size is not a power of 2
+  svc_ring_t bad = ring;
+  svc_ring_get_time( &bad, 0 );
+  bad.cq = ( svc_cqe_t * )&_time_page;
+  uint32_t run = svc_ring_submit( &bad );
+  bad.cq = cq;
+  bad.mask = ENTRIES - 2;
+  if ( run != 0 || svc_ring_submit( &bad ) != 0 || bad.sq_head != 0 ) {
+    printf( "Failed. A batch ran on a read-only or misshapen ring\n" );
+    return -1;
+  }
+
+  log_mutex = mutex_init( 0 );
+  if ( log_mutex == NULL ) {
+    printf( "Failed to create the mutex\n" );
+    return -1;
+  }
+  ABORT_ON_ERROR( thread_create( &logger_thread, 0, BUDGET, PERIOD, NULL ) );
+
+  printf( "Logging %d records, %s...\n", ROUNDS * RECORDS, batched ? "batched" : "one call each" );
+  ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
+
+  if ( errors ) {
+    printf( "Failed with %d errors\n", ( int )errors );
+    return -1;
+  }
+  printf( "%d cycles per record, %d traps per %d records\n", ( int )( cycles / ( ROUNDS * RECORDS ) ),
+          batched ? 2 : RECORDS + 2, RECORDS );
+
+  return RET_0349;
+}
@@ -0,0 +1,283 @@
+/**
+ * @file   main.c
+ *
+ * @brief  Message passing benchmark. A producer hands BATCH messages per
+ *         period to a higher priority consumer, which checks their sequence
+ *         numbers and reads every word. The messages travel one of three ways:
+ *
+ *         mutex  a ring of globals on the heap guarded by a mutex, the way
+ *                threads shared data before message queues. Every message
+ *                costs a lock and an unlock on each side, and the consumer
+ *                cannot wait for data, so it polls once per period and sees
+ *                each batch a period late.
+ *         copy   mq_send() and mq_receive(), the kernel copies each message
+ *                in and out of its buffer
+ *         zero   mq_alloc() and mq_send_buf() on the producer side,
+ *                mq_receive_buf() and mq_free() on the consumer side, the
+ *                message is built and read in place. KERNEL_ONLY only, the
+ *                kernel's buffers are out of reach under PER_THREAD.
+ *
+ *         With the queues the consumer blocks in the receive, so every
+ *         message wakes it and costs two context switches. The cycles of
+ *         each thread and of the kernel's interrupt handlers are printed per
+ *         message, with the average delivery latency in ticks.
+ *
+ *         make flash USER_PROJ=bench_mqueue USER_ARG="-m zero -s 256"
+ *
+ *         -m mutex|copy|zero   transport (default copy)
+ *         -s bytes             message size, 8 to 256 (default 64)
+ *         -p 0|1               memory protection mode (default KERNEL_ONLY)
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <time_page.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define NUM_THREADS 2
+#define NUM_MUTEXES 1
+#define CLOCK_FREQUENCY 1000
+
+/** @brief priorities of the two threads */
+#define CONSUMER 0
+#define PRODUCER 1
+/** @brief period of both threads */
+#define PERIOD 10
+/** @brief budget of each thread, generous as only the cycle counts matter */
+#define BUDGET 4
+/** @brief jobs the producer runs */
+#define ROUNDS 200
+/** @brief messages per producer job, and buffers of the queue or ring */
+#define BATCH 8
+/** @brief largest message, a local copy of it must fit a thread stack */
+#define MAX_MSG_WORDS 64
+
+/** @brief words of a message, sequence number and send tick first */
+//@{
+#define MSG_SEQ  0
+#define MSG_TICK 1
+//@}
+
+/** @brief ways to move a message from producer to consumer */
+typedef enum { MUTEX, COPY, ZERO } transport_t;
+
+/** @brief transport under test */
+static transport_t transport = COPY;
+/** @brief words per message */
+static uint32_t msg_words = 16;
+
+/** @brief queue of the copy and zero transports */
+static mqueue_t *mq;
+
+/** @brief the mutex transport's ring, guarded by ring_mutex */
+//@{
+static mutex_t *ring_mutex;
+static uint32_t *ring;
+static volatile uint32_t ring_head;
+static volatile uint32_t ring_count;
+//@}
+
+/** @brief consumer results */
+//@{
+static volatile uint32_t received;
+static volatile uint32_t errors;
+static volatile uint32_t latency;
+static volatile uint32_t checksum;
+//@}
+
+/** @brief writes message seq in place */
+static void build( uint32_t *msg, uint32_t seq ) {
+  msg[MSG_SEQ] = seq;
+  msg[MSG_TICK] = get_time();
+  for ( uint32_t i = MSG_TICK + 1; i < msg_words; i++ ) msg[i] = seq ^ i;
+}
+
+/** @brief checks a message is the next one and reads all of it */
+static void consume( const uint32_t *msg ) {
+  if ( msg[MSG_SEQ] != received ) errors++;
+  latency += get_time() - msg[MSG_TICK];
+  for ( uint32_t i = MSG_TICK + 1; i < msg_words; i++ ) checksum += msg[i];
+  received++;
+}
+
+/** @brief appends a message to the mutex transport's ring, 0 if it was full */
+static int ring_put( const uint32_t *msg ) {
+  int put = 0;
+
+  mutex_lock( ring_mutex );
+  if ( ring_count < BATCH ) {
+    memcpy( &ring[( ( ring_head + ring_count ) % BATCH ) * msg_words], msg, msg_words * 4 );
+    ring_count++;
+    put = 1;
+  }
+  mutex_unlock( ring_mutex );
+  return put;
+}
+
+/** @brief takes the oldest message of the mutex transport's ring, 0 if it was empty */
+static int ring_get( uint32_t *msg ) {
+  int got = 0;
+
+  mutex_lock( ring_mutex );
+  if ( ring_count ) {
+    memcpy( msg, &ring[ring_head * msg_words], msg_words * 4 );
+    ring_head = ( ring_head + 1 ) % BATCH;
+    ring_count--;
+    got = 1;
+  }
+  mutex_unlock( ring_mutex );
+  return got;
+}
+
+void producer_thread( void *vargp ) {
+  ( void )vargp;
+  uint32_t msg[MAX_MSG_WORDS];
+  uint32_t seq = 0;
+
+  for ( uint32_t round = 0; round < ROUNDS; round++ ) {
+    for ( uint32_t i = 0; i < BATCH; i++, seq++ ) {
+      if ( transport == ZERO ) {
+        uint32_t *buf = mq_alloc( mq, WAIT_FOREVER );
+        build( buf, seq );
+        if ( mq_send_buf( mq, buf ) ) errors++;
+      } else {
+        build( msg, seq );
+        if ( transport == COPY ) {
+          if ( mq_send( mq, msg, WAIT_FOREVER ) ) errors++;
+        } else if ( !ring_put( msg ) ) {
+          errors++;
+        }
+      }
+    }
+    wait_until_next_period();
+  }
+}
+
+void consumer_thread( void *vargp ) {
+  ( void )vargp;
+  uint32_t msg[MAX_MSG_WORDS];
+
+  while ( received < ROUNDS * BATCH ) {
+    if ( transport == MUTEX ) {
+      // Nothing to block on, drain whatever the last producer job left
+      while ( ring_get( msg ) ) consume( msg );
+    } else {
+      // Each message wakes this job up as soon as it is sent
+      for ( uint32_t i = 0; i < BATCH; i++ ) {
+        if ( transport == COPY ) {
+          if ( mq_receive( mq, msg, WAIT_FOREVER ) ) errors++;
+          else consume( msg );
+        } else {
+          uint32_t *buf = mq_receive_buf( mq, WAIT_FOREVER );
+          consume( buf );
+          if ( mq_free( mq, buf ) ) errors++;
+        }
+      }
+    }
+    wait_until_next_period();
+  }
+}
+
+/** @brief prints cycles per message of one counter */
+static void print_per_msg( const char *name, uint64_t cycles ) {
+  printf( "%s %d cycles/msg\n", name, ( int )( ( uint32_t )cycles / received ) );
+}
+
+int main( int argc, char *const argv[] ) {
+  int protection = KERNEL_ONLY;
+  uint32_t msg_size = msg_words * 4;
+  int opt;
+
+  while ( ( opt = getopt( argc, argv, "m:s:p:" ) ) != -1 ) {
+    switch ( opt ) {
+    case 'm':
+      if ( !strcmp( optarg, "mutex" ) ) transport = MUTEX;
+      else if ( !strcmp( optarg, "zero" ) ) transport = ZERO;
+      break;
+
+    case 's':
+      msg_size = atoi( optarg );
+      if ( msg_size < 8 || msg_size > MAX_MSG_WORDS * 4 ) {
+        printf( "Message size must be 8 to %d bytes\n", MAX_MSG_WORDS * 4 );
+        return -1;
+      }
+      msg_words = ( msg_size + 3 ) / 4;
+      break;
+
+    case 'p':
+      protection = atoi( optarg );
+      break;
+
+    default:
+      return -1;
+    }
+  }
+
+  if ( transport == ZERO && protection != KERNEL_ONLY ) {
+    printf( "The zero transport needs -p 0\n" );
+    return -1;
+  }
+
+  ABORT_ON_ERROR( thread_init( NUM_THREADS, USR_STACK_WORDS, NULL, protection, NUM_MUTEXES ) );
+
+  // The ring lives on the heap, the queue buffers in the kernel
+  if ( transport == MUTEX ) {
+    ring_mutex = mutex_init( CONSUMER );
+    ring = malloc( BATCH * msg_words * 4 );
+    if ( ring_mutex == NULL || ring == NULL ) {
+      printf( "Failed to create the ring\n" );
+      return -1;
+    }
+  } else {
+    mq = mq_init( msg_words * 4, BATCH );
+    if ( mq == NULL ) {
+      printf( "Failed to create the queue\n" );
+      return -1;
+    }
+    // Main never blocks, and may only free the buffer it took
+    if ( transport == ZERO ) {
+      uint8_t *buf = mq_alloc( mq, 0 );
+      if ( mq_receive_buf( mq, WAIT_FOREVER ) != NULL || buf == NULL ||
+           mq_free( mq, buf + msg_words * 4 ) == 0 || mq_free( mq, buf ) != 0 ) {
+        printf( "Failed. Main received from an empty queue or freed a buffer it did not own\n" );
+        return -1;
+      }
+    }
+    // A receive into memory main cannot write leaves the message queued
+    uint32_t msg[MAX_MSG_WORDS] = { 0 };
+    if ( mq_send( mq, msg, 0 ) || mq_receive( mq, ( void * )&_time_page, 0 ) != -1 ||
+         mq_receive( mq, msg, 0 ) ) {
+      printf( "Failed. mq_receive wrote to the read-only time page or lost the message\n" );
+      return -1;
+    }
+  }
+
+  ABORT_ON_ERROR( thread_create( &consumer_thread, CONSUMER, BUDGET, PERIOD, NULL ) );
+  ABORT_ON_ERROR( thread_create( &producer_thread, PRODUCER, BUDGET, PERIOD, NULL ) );
+
+  const char *names[] = { "mutex", "copy", "zero" };
+  printf( "Passing %d messages of %d bytes by %s...\n", ROUNDS * BATCH, ( int )msg_size, names[transport] );
+  ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
+
+  if ( errors || received != ROUNDS * BATCH ) {
+    printf( "Failed. %d of %d messages received, %d errors\n", ( int )received, ROUNDS * BATCH,
+            ( int )errors );
+    return -1;
+  }
+
+  // A run takes ROUNDS periods, every count fits 32 bits
+  print_per_msg( "producer", cpu_cycles( CPU_THREAD, PRODUCER ) );
+  print_per_msg( "consumer", cpu_cycles( CPU_THREAD, CONSUMER ) );
+  print_per_msg( "kernel", cpu_cycles( CPU_KERNEL, 0 ) );
+  printf( "latency %d.%d ticks, checksum %x\n", ( int )( latency / received ),
+          ( int )( latency * 10 / received % 10 ), ( unsigned )checksum );
+
+  return RET_0349;
+}
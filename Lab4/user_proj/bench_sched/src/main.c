@@ -0,0 +1,223 @@
+/**
+ * @file   main.c
+ *
+ * @brief  Scheduler benchmark. Runs the grade_rms or grade_pcp task set for a
+ *         bounded number of ticks and then exits, so that a kernel built with
+ *         PROFILE=1 prints its context switch cycle counts. The kernel's
+ *         per-thread deadline and overrun statistics are printed at the end,
+ *         with the idle share and the interrupt cycles spent per tick.
+ *
+ *         make flash USER_PROJ=bench_sched PROFILE=1 USER_ARG="-s pcp"
+ *
+ *         To compare RMS and EDF admission and deadline misses, run the rms
+ *         set with growing computation times under both policies:
+ *
+ *         USER_ARG="-c 100" (U ~ 65%), "-c 110", "-c 120", "-c 130",
+ *         "-c 140", "-c 150" (U ~ 97%), each with and without -e.
+ *         RMS rejects the set from -c 120 (U ~ 78% > 72.4%) onwards, EDF
+ *         admits every step up to -c 154.
+ *
+ *         -s rms|pcp   task set to run (default rms)
+ *         -p 0|1       memory protection mode (default KERNEL_ONLY)
+ *         -t           tickless idle, skip ticks while only idle can run
+ *         -e           earliest deadline first instead of RMS
+ *         -c pct       scale every computation time to pct percent
+ *         -f hz        tick frequency, a multiple of 1000 (default 1000);
+ *                      task times are scaled so every run covers 21 s
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define MAX_THREADS 8
+#define NUM_MUTEXES 3
+#define CLOCK_FREQUENCY 1000
+/** @brief ticks at CLOCK_FREQUENCY after which every thread returns */
+#define RUN_TICKS 21000
+/** @brief spin slack so that a job fits inside its budget */
+#define REDUCE_SPIN_MS 5
+
+/** @brief one periodic task; cs_len == 0 means it takes no mutex */
+typedef struct {
+  uint32_t C;       /**< computation time */
+  uint32_t T;       /**< period */
+  int mutex;        /**< index of the mutex used in the critical section */
+  uint32_t cs_pre;  /**< work before the critical section */
+  uint32_t cs_len;  /**< work inside the critical section */
+} task_t;
+
+/** @brief grade_rms task set */
+static const task_t RMS_SET[] = {
+  { 300, 3100, 0, 0, 0 }, { 200, 3300, 0, 0, 0 },
+  { 400, 3500, 0, 0, 0 }, { 400, 4700, 0, 0, 0 },
+  { 500, 5100, 0, 0, 0 }, { 400, 5200, 0, 0, 0 },
+  { 600, 8900, 0, 0, 0 }, { 500, 10200, 0, 0, 0 }
+};
+
+/** @brief grade_pcp task set, ceilings of mutexes 0,1,2 are 0,2,3 */
+static const task_t PCP_SET[] = {
+  { 500, 2500, 0, 100, 400 }, { 200, 3000, 0, 0, 0 },
+  { 500, 3300, 1, 200, 300 }, { 500, 4000, 2, 100, 300 },
+  { 500, 6300, 1, 200, 300 }, { 700, 8500, 2, 0, 700 }
+};
+
+/** @brief priority ceilings of the pcp set's mutexes */
+static const uint32_t PCP_CEILINGS[] = { 0, 2, 3 };
+
+/** @brief task set being run */
+const task_t *set = RMS_SET;
+
+/** @brief mutexes handed to the tasks */
+mutex_t *mutexes[NUM_MUTEXES];
+
+/** @brief ticks per CLOCK_FREQUENCY tick at the selected frequency */
+uint32_t tick_scale = 1;
+
+/** @brief percentage every computation time is scaled to */
+uint32_t c_pct = 100;
+
+/** @brief converts a CLOCK_FREQUENCY work time of the task set to ticks */
+static uint32_t work_ticks( uint32_t ms ) {
+  return ms * c_pct / 100 * tick_scale;
+}
+
+/** @brief Runs one task until RUN_TICKS
+ *
+ *  @param vargp   index of the task in the running set
+ */
+void task_fn( void *vargp ) {
+  int id = ( int )vargp;
+  const task_t *task = &set[id];
+  uint32_t pre = work_ticks( task->cs_pre );
+  uint32_t cs = work_ticks( task->cs_len );
+  uint32_t reduce = REDUCE_SPIN_MS * tick_scale;
+  uint32_t post = work_ticks( task->C ) - pre - cs;
+
+  while ( get_time() < RUN_TICKS * tick_scale ) {
+    if ( task->cs_len ) {
+      spin_wait( pre );
+      mutex_lock( mutexes[task->mutex] );
+      spin_wait( cs - reduce );
+      mutex_unlock( mutexes[task->mutex] );
+      if ( post ) spin_wait( post );
+    } else {
+      spin_wait( post - reduce );
+    }
+    wait_until_next_period();
+  }
+}
+
+int main( int argc, char *const argv[] ) {
+  int num_tasks = sizeof( RMS_SET ) / sizeof( task_t );
+  int num_mutexes = 0;
+  int protection = KERNEL_ONLY;
+  uint32_t freq = CLOCK_FREQUENCY;
+  int opt;
+
+  while ( ( opt = getopt( argc, argv, "s:p:f:tec:" ) ) != -1 ) {
+    switch ( opt ) {
+    case 's':
+      if ( !strcmp( optarg, "pcp" ) ) {
+        set = PCP_SET;
+        num_tasks = sizeof( PCP_SET ) / sizeof( task_t );
+        num_mutexes = NUM_MUTEXES;
+      }
+      break;
+
+    case 'p':
+      protection = ( protection & ( TICKLESS | SCHED_EDF ) ) | atoi( optarg );
+      break;
+
+    case 't':
+      protection |= TICKLESS;
+      break;
+
+    case 'e':
+      protection |= SCHED_EDF;
+      break;
+
+    case 'c':
+      c_pct = atoi( optarg );
+      break;
+
+    case 'f':
+      freq = atoi( optarg );
+      if ( freq < CLOCK_FREQUENCY || freq % CLOCK_FREQUENCY ) {
+        printf( "Frequency must be a multiple of %d\n", CLOCK_FREQUENCY );
+        return -1;
+      }
+      tick_scale = freq / CLOCK_FREQUENCY;
+      break;
+
+    default:
+      return -1;
+    }
+  }
+
+  ABORT_ON_ERROR( thread_init( MAX_THREADS, USR_STACK_WORDS, NULL, protection, num_mutexes ) );
+
+  for ( int i = 0; i < num_mutexes; i++ ) {
+    mutexes[i] = mutex_init( PCP_CEILINGS[i] );
+    if ( mutexes[i] == NULL ) {
+      printf( "Failed to create mutex\n" );
+      return -1;
+    }
+  }
+
+  const char *policy = ( protection & SCHED_EDF ) ? "edf" : "rms";
+  uint32_t util = 0;
+
+  for ( int i = 0; i < num_tasks; i++ ) {
+    util += work_ticks( set[i].C ) * 1000 / ( set[i].T * tick_scale );
+    if ( thread_create( &task_fn, i, work_ticks( set[i].C ), set[i].T * tick_scale,
+                        ( void * )i ) ) {
+      printf( "%s rejected thread %d, U = %d.%d%%\n", policy, i, ( int )( util / 10 ), ( int )( util % 10 ) );
+      return RET_0349;
+    }
+  }
+
+  printf( "Running %s set under %s, U = %d.%d%%, for %d ticks at %d Hz...\n",
+          set == PCP_SET ? "pcp" : "rms", policy, ( int )( util / 10 ), ( int )( util % 10 ),
+          ( int )( RUN_TICKS * tick_scale ), ( int )freq );
+  ABORT_ON_ERROR( scheduler_start( freq ) );
+
+  uint32_t total = 0;
+  thread_stats_t stats;
+  for ( int i = 0; i < num_tasks; i++ ) {
+    if ( thread_stats( i, &stats ) ) continue;
+    printf( "task %d: jobs %d, missed %d, overran %d, wcrt %d, latency %d-%d\n", i,
+            ( int )stats.jobs, ( int )stats.deadline_misses, ( int )stats.overruns,
+            ( int )stats.wcrt, ( int )stats.min_latency, ( int )stats.max_latency );
+    total += stats.deadline_misses;
+  }
+  printf( "%s U = %d.%d%%: %d deadline misses\n", policy, ( int )( util / 10 ), ( int )( util % 10 ),
+          ( int )total );
+
+  // Scale both down so the ratio fits 32-bit math; there is no libgcc for 64-bit division
+  uint64_t idle = cpu_cycles( CPU_IDLE, 0 );
+  uint64_t run = cpu_cycles( CPU_TOTAL, 0 );
+  while ( run >> 22 ) {
+    idle >>= 1;
+    run >>= 1;
+  }
+  if ( run ) {
+    uint32_t idle_pm = ( uint32_t )idle * 1000 / ( uint32_t )run;
+    printf( "idle %d.%d%%\n", ( int )( idle_pm / 10 ), ( int )( idle_pm % 10 ) );
+  }
+
+  // Interrupt time per tick, SysTick and PendSV mostly; a 21 s run fits 32 bits
+  uint32_t ticks = get_time();
+  if ( ticks ) {
+    printf( "interrupt overhead %d cycles/tick\n", ( int )( ( uint32_t )cpu_cycles( CPU_KERNEL, 0 ) / ticks ) );
+  }
+
+  return RET_0349;
+}
@@ -0,0 +1,177 @@
+/**
+ * @file   main.c
+ *
+ * @brief  Sensor to controller throughput benchmark. Every period a sensor
+ *         thread pushes BURST readings and a controller thread pops them,
+ *         through either the user-space SPSC ring or a kernel message queue
+ *         (mq_send and mq_receive, two system calls per reading).
+ *
+ *         By default the sensor has the higher priority, so each burst is
+ *         in the ring before the controller looks and the ring path makes
+ *         no system call at all. With -w the controller has the higher
+ *         priority and is always asleep when a reading arrives, so every
+ *         push rings the doorbell and costs two context switches, the worst
+ *         case for the ring.
+ *
+ *         The cycles both threads spent are turned into the messages per
+ *         second a 16MHz CPU could move if it did nothing else.
+ *
+ *         make flash USER_PROJ=bench_spsc USER_ARG="-m ring -w"
+ *
+ *         -m ring|mq   transport (default ring)
+ *         -w           controller waits for every reading
+ *         -b burst     readings per period, 1 to 32 (default 32)
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <spsc_ring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define NUM_THREADS 2
+#define NUM_MUTEXES 0
+#define CLOCK_FREQUENCY 1000
+/** @brief CPU cycles per second */
+#define CPU_FREQUENCY 16000000
+
+/** @brief period and budget of both threads */
+#define PERIOD 5
+#define BUDGET 2
+/** @brief jobs of each thread */
+#define ROUNDS 400
+/** @brief largest burst, and slots of the ring or queue */
+#define SLOTS 32
+
+/** @brief one sensor reading */
+typedef struct {
+  uint32_t seq;     /**< readings pushed before this one */
+  int32_t value[3]; /**< e.g. a 3-axis sample */
+} reading_t;
+
+/** @brief whether readings go through the ring or a message queue */
+static int use_ring = 1;
+/** @brief readings per period */
+static uint32_t burst = SLOTS;
+/** @brief priorities of the two threads */
+static uint32_t sensor_prio = 0;
+static uint32_t controller_prio = 1;
+
+/** @brief the ring, shared by the two threads */
+static spsc_ring_t ring;
+static reading_t ring_storage[SLOTS];
+/** @brief the queue of the mq transport */
+static mqueue_t *mq;
+
+/** @brief controller results */
+//@{
+static volatile uint32_t received;
+static volatile uint32_t errors;
+//@}
+
+void sensor_thread( void *vargp ) {
+  ( void )vargp;
+  reading_t reading;
+  uint32_t seq = 0;
+
+  for ( uint32_t round = 0; round < ROUNDS; round++ ) {
+    for ( uint32_t i = 0; i < burst; i++, seq++ ) {
+      reading.seq = seq;
+      reading.value[0] = seq;
+      reading.value[1] = -seq;
+      reading.value[2] = seq * 3;
+      int full = use_ring ? spsc_push( &ring, &reading ) : mq_send( mq, &reading, 0 );
+      if ( full ) errors++;
+    }
+    wait_until_next_period();
+  }
+}
+
+void controller_thread( void *vargp ) {
+  ( void )vargp;
+  reading_t reading;
+
+  for ( uint32_t round = 0; round < ROUNDS; round++ ) {
+    for ( uint32_t i = 0; i < burst; i++ ) {
+      int empty = use_ring ? spsc_pop( &ring, &reading, WAIT_FOREVER )
+                           : mq_receive( mq, &reading, WAIT_FOREVER );
+      if ( empty || reading.seq != received || reading.value[1] != -reading.value[0] ) errors++;
+      received++;
+    }
+    wait_until_next_period();
+  }
+}
+
+int main( int argc, char *const argv[] ) {
+  int opt;
+
+  while ( ( opt = getopt( argc, argv, "m:wb:" ) ) != -1 ) {
+    switch ( opt ) {
+    case 'm':
+      use_ring = strcmp( optarg, "mq" ) != 0;
+      break;
+
+    case 'w':
+      sensor_prio = 1;
+      controller_prio = 0;
+      break;
+
+    case 'b':
+      burst = atoi( optarg );
+      if ( burst < 1 || burst > SLOTS ) {
+        printf( "Burst must be 1 to %d\n", SLOTS );
+        return -1;
+      }
+      break;
+
+    default:
+      return -1;
+    }
+  }
+
+  ABORT_ON_ERROR( thread_init( NUM_THREADS, USR_STACK_WORDS, NULL, KERNEL_ONLY, NUM_MUTEXES ) );
+
+  if ( use_ring ) {
+    ABORT_ON_ERROR( spsc_init( &ring, ring_storage, SLOTS, sizeof( reading_t ) ) );
+  } else {
+    mq = mq_init( sizeof( reading_t ), SLOTS );
+    if ( mq == NULL ) {
+      printf( "Failed to create the queue\n" );
+      return -1;
+    }
+  }
+
+  ABORT_ON_ERROR( thread_create( &sensor_thread, sensor_prio, BUDGET, PERIOD, NULL ) );
+  ABORT_ON_ERROR( thread_create( &controller_thread, controller_prio, BUDGET, PERIOD, NULL ) );
+
+  printf( "Passing %d readings through the %s, %s first...\n", ROUNDS * burst,
+          use_ring ? "ring" : "queue", sensor_prio ? "controller" : "sensor" );
+  ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
+
+  if ( errors || received != ROUNDS * burst ) {
+    printf( "Failed. %d of %d readings received, %d errors\n", ( int )received,
+            ( int )( ROUNDS * burst ), ( int )errors );
+    return -1;
+  }
+
+  // ROUNDS periods of work fit 32 bits of cycles
+  uint32_t sensor = cpu_cycles( CPU_THREAD, sensor_prio );
+  uint32_t controller = cpu_cycles( CPU_THREAD, controller_prio );
+  uint32_t svc = cpu_cycles( CPU_THREAD_SVC, sensor_prio ) + cpu_cycles( CPU_THREAD_SVC, controller_prio );
+  uint32_t kernel = cpu_cycles( CPU_KERNEL, 0 );
+  uint32_t per_msg = ( sensor + controller ) / received;
+
+  printf( "sensor %d, controller %d cycles/reading, %d of them in syscalls\n",
+          ( int )( sensor / received ), ( int )( controller / received ), ( int )( svc / received ) );
+  printf( "interrupt handlers %d cycles/reading\n", ( int )( kernel / received ) );
+  if ( use_ring ) printf( "doorbells %d\n", ( int )ring.doorbells );
+  if ( per_msg ) printf( "throughput %d readings/s\n", ( int )( CPU_FREQUENCY / per_msg ) );
+
+  return RET_0349;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file   main.c
+ *
+ * @brief  System call round trip benchmark. A thread times CALLS calls each
+ *         of get_time_slow(), a bare SVC with one result, sbrk( 0 ), and a
+ *         mutex_lock() and mutex_unlock() pair, which before the dispatch
+ *         table passed their arguments through the user stack. Cycles per
+ *         call are reported less an empty loop. Build the same project at
+ *         the parent commit to compare against the switch dispatch.
+ *
+ *         make flash USER_PROJ=bench_svc
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <time_page.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define NUM_THREADS 1
+#define NUM_MUTEXES 1
+#define CLOCK_FREQUENCY 1000
+
+/** @brief calls timed per job and kind */
+#define CALLS 100
+/** @brief jobs timed */
+#define ROUNDS 20
+#define PERIOD 10
+#define BUDGET 5
+
+/** @brief the calls timed */
+typedef enum { EMPTY = 0, TIME, SBRK, MUTEX, NUM_KINDS } kind_t;
+static const char *names[NUM_KINDS] = { "empty loop", "get_time_slow", "sbrk(0)", "mutex lock+unlock" };
+
+/** @brief cycles of each kind summed over every job */
+static uint32_t cycles[NUM_KINDS];
+static mutex_t *mutex;
+/** @brief sink for the loops, so the calls are not optimized away */
+static volatile uint32_t sink;
+
+void bench_thread( void *vargp ) {
+  ( void )vargp;
+
+  for ( uint32_t round = 0; round < ROUNDS; round++ ) {
+    TIME_LOOP( cycles[EMPTY], 0, CALLS, sink = i );
+    TIME_LOOP( cycles[TIME], 0, CALLS, sink = get_time_slow() );
+    TIME_LOOP( cycles[SBRK], 0, CALLS, sink = ( uint32_t )sbrk( 0 ) );
+    TIME_LOOP( cycles[MUTEX], 0, CALLS, mutex_lock( mutex ); mutex_unlock( mutex ); sink = i );
+
+    wait_until_next_period();
+  }
+}
+
+int main( void ) {
+
+  ABORT_ON_ERROR( thread_init( NUM_THREADS, USR_STACK_WORDS, NULL, KERNEL_ONLY, NUM_MUTEXES ) );
+
+  mutex = mutex_init( 0 );
+  if ( mutex == NULL ) {
+    printf( "Failed to create the mutex\n" );
+    return -1;
+  }
+  ABORT_ON_ERROR( thread_create( &bench_thread, 0, BUDGET, PERIOD, NULL ) );
+
+  printf( "Timing %d calls of each kind...\n", CALLS * ROUNDS );
+  ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
+
+  for ( int i = TIME; i < NUM_KINDS; i++ ) {
+    printf( "%s: %d cycles\n", names[i], ( int )( ( cycles[i] - cycles[EMPTY] ) / ( CALLS * ROUNDS ) ) );
+  }
+
+  return RET_0349;
+}
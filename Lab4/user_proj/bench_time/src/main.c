@@ -0,0 +1,81 @@
+/**
+ * @file   main.c
+ *
+ * @brief  Time page benchmark. A thread calls get_time() CALLS times through
+ *         the time page and then through the system call, and reports the
+ *         cycles per call of each, less the cycles of an empty loop. Each
+ *         pass is repeated over several jobs, and the two must agree on the
+ *         time whenever they are read back to back.
+ *
+ *         make flash USER_PROJ=bench_time
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <time_page.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define NUM_THREADS 1
+#define NUM_MUTEXES 0
+#define CLOCK_FREQUENCY 1000
+
+/** @brief calls timed per job and way */
+#define CALLS 200
+/** @brief jobs timed */
+#define ROUNDS 20
+#define PERIOD 10
+#define BUDGET 5
+
+/** @brief cycles summed over every job */
+//@{
+static uint32_t empty_cycles;
+static uint32_t page_cycles;
+static uint32_t svc_cycles;
+//@}
+/** @brief times the two ways disagreed */
+static volatile uint32_t errors;
+/** @brief sink for the loops, so the calls are not optimized away */
+static volatile uint32_t sink;
+
+void bench_thread( void *vargp ) {
+  ( void )vargp;
+
+  for ( uint32_t round = 0; round < ROUNDS; round++ ) {
+    TIME_LOOP( empty_cycles, 0, CALLS, sink = i );
+    TIME_LOOP( page_cycles, 0, CALLS, sink = get_time() );
+    TIME_LOOP( svc_cycles, 0, CALLS, sink = get_time_slow() );
+
+    // A tick may fall between the two reads, but not two
+    uint32_t page = get_time();
+    uint32_t svc = get_time_slow();
+    if ( svc - page > 1 || get_priority() != 0 ) errors++;
+
+    wait_until_next_period();
+  }
+}
+
+int main( void ) {
+
+  ABORT_ON_ERROR( thread_init( NUM_THREADS, USR_STACK_WORDS, NULL, PER_THREAD, NUM_MUTEXES ) );
+  ABORT_ON_ERROR( thread_create( &bench_thread, 0, BUDGET, PERIOD, NULL ) );
+
+  printf( "Timing %d get_time calls each way...\n", CALLS * ROUNDS );
+  ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
+
+  if ( errors ) {
+    printf( "Failed. The time page and the syscall disagreed %d times\n", ( int )errors );
+    return -1;
+  }
+
+  printf( "get_time: time page %d cycles, syscall %d cycles\n",
+          ( int )( ( page_cycles - empty_cycles ) / ( CALLS * ROUNDS ) ),
+          ( int )( ( svc_cycles - empty_cycles ) / ( CALLS * ROUNDS ) ) );
+
+  return RET_0349;
+}
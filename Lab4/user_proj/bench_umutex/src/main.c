@@ -0,0 +1,142 @@
+/**
+ * @file   main.c
+ *
+ * @brief  User mutex benchmark. The high priority thread first times ITERS
+ *         uncontended lock and unlock pairs of a user mutex and of a kernel
+ *         mutex, both with ceiling 0. Then, in every job, the low priority
+ *         thread locks the user mutex, wakes the high priority thread, which
+ *         takes the mutex over from it, and blocks while holding it. The
+ *         high priority thread's umutex_lock must then wait in the kernel,
+ *         and gets the mutex when the low priority thread unlocks.
+ *
+ *         make flash USER_PROJ=bench_umutex
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <umutex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define NUM_THREADS 2
+#define NUM_MUTEXES 2
+#define CLOCK_FREQUENCY 1000
+
+/** @brief priorities, C and T of the two threads */
+#define HIGH 0
+#define LOW 1
+#define PERIOD 10
+#define BUDGET 4
+/** @brief lock and unlock pairs timed uncontended */
+#define ITERS 100
+/** @brief contended handoffs */
+#define ROUNDS 50
+
+/** @brief the user mutex, global so both threads reach its word */
+static umutex_t umutex;
+static mutex_t *kmutex;
+/** @brief wakes the high priority thread once the low one holds the mutex */
+static sem_t *go;
+/** @brief never posted, the low priority thread waits on it to block while holding the mutex */
+static sem_t *gate;
+
+/** @brief cycles of the uncontended loops, the empty one included */
+//@{
+static uint32_t empty_cycles;
+static uint32_t user_cycles;
+static uint32_t kernel_cycles;
+//@}
+/** @brief cycles of the contended umutex_lock and umutex_unlock of the high priority thread */
+static uint32_t wait_cycles;
+static uint32_t handoff_cycles;
+/** @brief umutex_lock calls that returned while the other thread was inside */
+static volatile uint32_t errors;
+/** @brief thread inside the critical section, -1 if none */
+static volatile int inside = -1;
+static volatile uint32_t handoffs;
+/** @brief sink for the loops, so the empty one is not optimized away */
+static volatile uint32_t sink;
+
+static void time_uncontended( void ) {
+  TIME_LOOP( empty_cycles, HIGH, ITERS, sink = i );
+  TIME_LOOP( user_cycles, HIGH, ITERS, umutex_lock( &umutex ); umutex_unlock( &umutex ); sink = i );
+  TIME_LOOP( kernel_cycles, HIGH, ITERS, mutex_lock( kmutex ); mutex_unlock( kmutex ); sink = i );
+}
+
+void high_thread( void *vargp ) {
+  ( void )vargp;
+
+  time_uncontended();
+  for ( uint32_t round = 0; round < ROUNDS; round++ ) {
+    sem_wait( go, WAIT_FOREVER );
+
+    uint32_t start = thread_cycles( HIGH );
+    umutex_lock( &umutex );
+    wait_cycles += thread_cycles( HIGH ) - start;
+    if ( inside != -1 ) errors++;
+    inside = HIGH;
+    handoffs++;
+    inside = -1;
+    start = thread_cycles( HIGH );
+    umutex_unlock( &umutex );
+    handoff_cycles += thread_cycles( HIGH ) - start;
+
+    wait_until_next_period();
+  }
+}
+
+void low_thread( void *vargp ) {
+  ( void )vargp;
+
+  for ( uint32_t round = 0; round < ROUNDS; round++ ) {
+    umutex_lock( &umutex );
+    inside = LOW;
+    // Taken over here, the ceiling keeps this thread running
+    sem_post( go );
+    // Blocks holding the mutex, so the high priority thread waits for it
+    sem_wait( gate, 1 );
+    inside = -1;
+    umutex_unlock( &umutex );
+
+    // Unless the kernel ceiling was dropped, this is never reached before the high priority thread is done
+    if ( handoffs != round + 1 ) errors++;
+    wait_until_next_period();
+  }
+}
+
+int main( void ) {
+
+  ABORT_ON_ERROR( thread_init( NUM_THREADS, USR_STACK_WORDS, NULL, KERNEL_ONLY, NUM_MUTEXES ) );
+
+  kmutex = mutex_init( HIGH );
+  go = sem_init( 0 );
+  gate = sem_init( 0 );
+  if ( umutex_init( &umutex, HIGH ) || kmutex == NULL || go == NULL || gate == NULL ) {
+    printf( "Failed to create the mutexes and semaphores\n" );
+    return -1;
+  }
+
+  ABORT_ON_ERROR( thread_create( &high_thread, HIGH, BUDGET, PERIOD, NULL ) );
+  ABORT_ON_ERROR( thread_create( &low_thread, LOW, BUDGET, PERIOD, NULL ) );
+
+  printf( "Timing %d lock pairs and %d handoffs...\n", ITERS, ROUNDS );
+  ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
+
+  if ( errors || handoffs != ROUNDS ) {
+    printf( "Failed. %d of %d handoffs, %d errors\n", ( int )handoffs, ROUNDS, ( int )errors );
+    return -1;
+  }
+
+  printf( "uncontended lock+unlock: umutex %d cycles, mutex %d cycles\n",
+          ( int )( ( user_cycles - empty_cycles ) / ITERS ),
+          ( int )( ( kernel_cycles - empty_cycles ) / ITERS ) );
+  printf( "contended umutex_lock %d cycles, umutex_unlock after it %d cycles\n",
+          ( int )( wait_cycles / ROUNDS ), ( int )( handoff_cycles / ROUNDS ) );
+
+  return RET_0349;
+}
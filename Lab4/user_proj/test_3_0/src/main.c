@@ -1,7 +1,10 @@
 /**
  * @file   main.c
  *
- * @brief  Tests the UB test.
+ * @brief  Tests the response-time admission test. Thread 2 is admitted up
+ *         to C = 500, well past the 200 the UB test allowed. Its response
+ *         time is then exactly its period and the CPU is fully used, so
+ *         thread 3 is refused at every C.
  *
  * @author Benjamin Huang <zemingbh@andrew.cmu.edu>
  */
@@ -25,7 +28,7 @@ void thread_fn( void *vargp ) {
     print_num_status_cnt( num, cnt++ );
     wait_until_next_period();
   }
-  if ( num == NUM_THREADS - 1 ) printf( "Test passed!\n" );
+  if ( num == 2 ) printf( "Test passed!\n" );
   while ( 1 ) wait_until_next_period();
 }
 
@@ -45,7 +48,7 @@ int main( void ) {
     stat = thread_create( &thread_fn, 2, try_C, 1000, ( void * )2 );
     if ( stat == 0 ) break;
   }
-  if ( try_C != 200 ) {
+  if ( try_C != 500 ) {
     printf ( "Test failed, thread 2. C = %d\n", try_C );
     return 1;
   }
@@ -54,7 +57,7 @@ int main( void ) {
     stat = thread_create( &thread_fn, 3, try_C, 5000, ( void * )3 );
     if ( stat == 0 ) break;
   }
-  if ( try_C != 275 ) {
+  if ( try_C != 0 ) {
     printf ( "Test failed, thread 3. C = %d\n", try_C );
     return 1;
   }
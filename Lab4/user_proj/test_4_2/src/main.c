@@ -1,9 +1,9 @@
 /**
  * @file   main.c
  *
- * @brief  Tests UB test on thread spawning after scheduler_start.
- *         Note that set C should fail to create thread 2, because it
- *         violates the UB test.
+ * @brief  Tests the admission test on thread spawning after scheduler_start.
+ *         Set C's thread 2 was refused by the UB test, but its response
+ *         time is exactly its period (950), so it is now admitted and runs.
  *
  * @author Benjamin Huang <zemingbh@andrew.cmu.edu>
  */
@@ -92,7 +92,7 @@ int main( void ) {
 
   ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
 
-  if ( counters[ 0 ] == 0 && counters[ 1 ] == 3 && counters[ 2 ] == 2 ) {
+  if ( counters[ 0 ] == 1 && counters[ 1 ] == 3 && counters[ 2 ] == 3 ) {
     printf( "Test passed!\n" );
   } else {
     printf( "Test failed.\n" );
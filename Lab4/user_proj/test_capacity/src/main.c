@@ -0,0 +1,141 @@
+/**
+ * @file   main.c
+ *
+ * @brief  Stress tests the kernel tables at capacity. 64 small threads are
+ *         created, using priorities past the first word of the ready map,
+ *         and all 32 mutexes. The upper half of the threads return after a
+ *         few jobs, thread 0 then revives them into the freed TCBs, and at
+ *         both points one more thread or mutex than the capacity must be
+ *         refused. Build the kernel with the default THREAD_CAPACITY=64 and
+ *         MUTEX_CAPACITY=32.
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 448B, so 64 fit in the stack region with a 64B guard below each */
+#define USR_STACK_WORDS 112
+#define NUM_THREADS 64
+#define NUM_MUTEXES 32
+#define CLOCK_FREQUENCY 1000
+
+/** @brief jobs run by each thread of the upper half, per life */
+#define JOBS 4
+/** @brief jobs run by each thread of the lower half, outliving the upper half */
+#define LONG_JOBS ( JOBS + 2 )
+/** @brief period of every thread, long enough for all 64 jobs */
+#define PERIOD 400
+/** @brief budget of every thread but 0 */
+#define BUDGET 2
+/** @brief budget of thread 0, which also runs 33 admission tests to revive the upper half */
+#define REVIVE_BUDGET 200
+
+/** @brief mutex i is shared by threads i and i + NUM_MUTEXES, ceiling i */
+static mutex_t *mutexes[NUM_MUTEXES];
+/** @brief priority of the thread holding each mutex, -1 if free */
+static volatile int owner[NUM_MUTEXES];
+/** @brief jobs completed at each priority, over all lives */
+static volatile uint32_t runs[NUM_THREADS];
+/** @brief number of checks that failed */
+static volatile uint32_t errors;
+
+void sensor_thread( void *vargp );
+
+/**
+ * @brief  creates the threads in [first, last), all at PERIOD
+ * @return number of threads that could not be created
+ */
+static uint32_t create_range( uint32_t first, uint32_t last ) {
+  uint32_t failed = 0;
+
+  for ( uint32_t i = first; i < last; i++ ) {
+    uint32_t C = i == 0 ? REVIVE_BUDGET : BUDGET;
+    if ( thread_create( &sensor_thread, i, C, PERIOD, ( void * )i ) ) failed++;
+  }
+  return failed;
+}
+
+/**
+ * @brief  tries to create one thread too many, at a priority that would
+ *         otherwise be admitted
+ * @return 1 if the kernel refused it
+ */
+static int overfill_refused( void ) {
+  return thread_create( &sensor_thread, NUM_THREADS - 1, BUDGET, PERIOD, ( void * )( NUM_THREADS - 1 ) ) != 0;
+}
+
+void sensor_thread( void *vargp ) {
+  uint32_t prio = ( uint32_t )vargp;
+  uint32_t m = prio % NUM_MUTEXES;
+  uint32_t jobs = prio < NUM_THREADS / 2 ? LONG_JOBS : JOBS;
+
+  for ( uint32_t cnt = 0; cnt < jobs; cnt++ ) {
+    mutex_lock( mutexes[m] );
+    if ( owner[m] != -1 || get_priority() != m ) errors++;
+    owner[m] = prio;
+    runs[prio]++;
+    owner[m] = -1;
+    mutex_unlock( mutexes[m] );
+
+    // The ceiling must be dropped again once nothing is held
+    if ( get_priority() != prio ) errors++;
+
+    // By now the upper half has returned, refill the table and overfill it
+    if ( prio == 0 && cnt == JOBS ) {
+      if ( create_range( NUM_THREADS / 2, NUM_THREADS ) ) errors++;
+      if ( !overfill_refused() ) errors++;
+    }
+
+    wait_until_next_period();
+  }
+}
+
+int main( void ) {
+
+  ABORT_ON_ERROR( thread_init( NUM_THREADS, USR_STACK_WORDS, NULL, KERNEL_ONLY, NUM_MUTEXES ) );
+
+  for ( int i = 0; i < NUM_MUTEXES; i++ ) {
+    mutexes[i] = mutex_init( i );
+    owner[i] = -1;
+    if ( mutexes[i] == NULL ) {
+      printf( "Failed to create mutex %d\n", i );
+      return -1;
+    }
+  }
+  if ( mutex_init( 0 ) != NULL ) {
+    printf( "Failed. Mutex %d was created past capacity\n", NUM_MUTEXES );
+    return -1;
+  }
+
+  if ( create_range( 0, NUM_THREADS ) ) {
+    printf( "Failed to create %d threads\n", NUM_THREADS );
+    return -1;
+  }
+  if ( !overfill_refused() ) {
+    printf( "Failed. Thread %d was created past capacity\n", NUM_THREADS );
+    return -1;
+  }
+
+  printf( "Created %d threads and %d mutexes! Starting scheduler...\n", NUM_THREADS, NUM_MUTEXES );
+  ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
+
+  for ( int i = 0; i < NUM_THREADS; i++ ) {
+    uint32_t expected = i < NUM_THREADS / 2 ? LONG_JOBS : 2 * JOBS;
+    if ( runs[i] != expected ) {
+      printf( "Thread %d ran %d jobs, expected %d\n", i, ( int )runs[i], ( int )expected );
+      errors++;
+    }
+  }
+
+  if ( errors ) {
+    printf( "Failed with %d errors\n", ( int )errors );
+    return -1;
+  }
+  printf( "Test passed!\n" );
+  return 0;
+}
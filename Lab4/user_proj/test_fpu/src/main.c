@@ -0,0 +1,136 @@
+/**
+ * @file   main.c
+ *
+ * @brief  Tests FPU context switching. Two threads fill all 32 FPU registers
+ *         with their own pattern, spin, and check the pattern is intact. The
+ *         slower one is preempted by the faster one in the middle of every
+ *         spin, so s0-s15 (stacked lazily by the hardware) and s16-s31
+ *         (saved by PendSV) must both survive the switch. A third thread
+ *         never touches the FPU and keeps the integer-only switch path.
+ *
+ *         make flash USER_PROJ=test_fpu FLOAT=hard
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define NUM_THREADS 3
+#define NUM_MUTEXES 0
+#define CLOCK_FREQUENCY 1000
+
+/** @brief jobs of the slow FPU thread to check */
+#define NUM_JOBS 20
+/** @brief FPU registers */
+#define NUM_FP_REGS 32
+/** @brief spin loop iterations per 100us, about 3 cycles each at 16MHz */
+#define SPIN_PER_100US 500
+
+/** @brief C and T of each thread, highest priority first */
+static const uint32_t C[NUM_THREADS] = { 2, 10, 1 };
+static const uint32_t T[NUM_THREADS] = { 5, 20, 50 };
+/** @brief spin time of the FPU threads in 100us, the slow one spans a release of the fast one */
+static const uint32_t SPIN[NUM_THREADS] = { 5, 80, 0 };
+
+/** @brief jobs finished by each thread */
+static volatile uint32_t jobs[NUM_THREADS];
+/** @brief registers that did not hold their value */
+static volatile uint32_t corrupted;
+
+/**
+ * @brief  loads every FPU register, spins, and stores them back, all in one
+ *         asm block so the compiler cannot use the registers in between
+ */
+static void fp_hold( const float *in, float *out, uint32_t spins ) {
+#ifdef __ARM_FP
+  __asm volatile(
+    "vldm %[in], {s0-s31}\n"
+    "1: subs %[n], %[n], #1\n"
+    "bne 1b\n"
+    "vstm %[out], {s0-s31}\n"
+    : [n] "+r" ( spins )
+    : [in] "r" ( in ), [out] "r" ( out )
+    : "memory", "cc",
+      "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+      "s8", "s9", "s10", "s11", "s12", "s13", "s14", "s15",
+      "s16", "s17", "s18", "s19", "s20", "s21", "s22", "s23",
+      "s24", "s25", "s26", "s27", "s28", "s29", "s30", "s31" );
+#else
+  ( void )spins;
+  for ( int i = 0; i < NUM_FP_REGS; i++ ) out[i] = in[i];
+#endif
+}
+
+void fpu_thread( void *vargp ) {
+  int id = ( int )vargp;
+  float in[NUM_FP_REGS];
+  float out[NUM_FP_REGS];
+
+  while ( 1 ) {
+    for ( int i = 0; i < NUM_FP_REGS; i++ ) {
+      in[i] = ( float )( id * 1000 + jobs[id] * NUM_FP_REGS + i ) + 0.5f;
+    }
+
+    uint32_t preempted = jobs[0];
+    fp_hold( in, out, SPIN[id] * SPIN_PER_100US );
+
+    for ( int i = 0; i < NUM_FP_REGS; i++ ) {
+      if ( out[i] != in[i] ) corrupted++;
+    }
+
+    if ( id == 1 && jobs[0] == preempted ) {
+      printf( "Failed. Thread 1 was not preempted during job %d\n", ( int )jobs[1] );
+      while ( 1 );
+    }
+    jobs[id]++;
+
+    if ( id == 1 && jobs[1] == NUM_JOBS ) {
+      if ( corrupted || !jobs[2] ) {
+        printf( "Failed. %d registers corrupted, integer thread ran %d jobs\n",
+                ( int )corrupted, ( int )jobs[2] );
+      } else {
+        printf( "Test passed!\n" );
+      }
+      while ( 1 );
+    }
+
+    wait_until_next_period();
+  }
+}
+
+void int_thread( void *vargp ) {
+  ( void )vargp;
+
+  while ( 1 ) {
+    jobs[2]++;
+    wait_until_next_period();
+  }
+}
+
+int main( void ) {
+
+#ifndef __ARM_FP
+  printf( "Build with FLOAT=hard to run this test\n" );
+  return -1;
+#endif
+
+  ABORT_ON_ERROR( thread_init( NUM_THREADS, USR_STACK_WORDS, NULL, KERNEL_ONLY, NUM_MUTEXES ) );
+
+  for ( int i = 0; i < NUM_THREADS; i++ ) {
+    void ( *fn )( void * ) = i < 2 ? &fpu_thread : &int_thread;
+    ABORT_ON_ERROR( thread_create( fn, i, C[i], T[i], ( void * )i ),
+      "Failed to create thread %d\n", i
+    );
+  }
+
+  printf( "Successfully created threads! Starting scheduler...\n" );
+  ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
+
+  return 0;
+}
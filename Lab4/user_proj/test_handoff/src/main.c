@@ -0,0 +1,104 @@
+/**
+ * @file   main.c
+ *
+ * @brief  Tests that an unlocked mutex goes to its highest priority waiter.
+ *         The low priority thread locks the mutex and overruns its budget
+ *         while holding it. The middle thread then blocks on the mutex,
+ *         followed by the high priority one. When the low thread comes back
+ *         and unlocks, the high thread must get the mutex first even though
+ *         it asked last and was created last, and the blocking histogram
+ *         must show both waits.
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define NUM_THREADS 3
+#define NUM_MUTEXES 1
+#define CLOCK_FREQUENCY 1000
+
+/** @brief priorities of the threads, the low one is created first */
+#define HIGH 0
+#define MID 1
+#define LOW 2
+/** @brief tick the low thread holds the mutex until, past its budget */
+#define HOLD_UNTIL 10
+
+static mutex_t *mutex;
+/** @brief priorities in the order the high and middle threads got the mutex */
+static volatile uint32_t order[2];
+static volatile uint32_t granted;
+
+void waiter_thread( void *vargp ) {
+  uint32_t prio = ( uint32_t )vargp;
+
+  // First job: let the low thread take the mutex
+  wait_until_next_period();
+
+  mutex_lock( mutex );
+  order[granted++] = prio;
+  mutex_unlock( mutex );
+
+  if ( granted == 2 ) {
+    mutex_stats_t stats;
+    mutex_stats( mutex, &stats );
+
+    // Both waits were 13 and 15 ticks, bucket 4 holds 8 to 15
+    if ( order[0] != HIGH || order[1] != MID ) {
+      printf( "Failed. Mutex went to priority %d before %d\n", ( int )order[0], ( int )order[1] );
+    } else if ( stats.locks != 3 || stats.blocked != 2 || stats.hist[0] != 1 || stats.hist[4] != 2 ) {
+      printf( "Failed. %d locks, %d blocked, %d unblocked, %d blocked 8-15 ticks\n", ( int )stats.locks,
+              ( int )stats.blocked, ( int )stats.hist[0], ( int )stats.hist[4] );
+    } else {
+      printf( "Test passed! Longest blocking %d ticks\n", ( int )stats.max_block );
+    }
+    while ( 1 );
+  }
+
+  while ( 1 ) wait_until_next_period();
+}
+
+void holder_thread( void *vargp ) {
+  ( void )vargp;
+
+  mutex_lock( mutex );
+  // Overruns the budget here, holding the mutex until the next period
+  while ( get_time() < HOLD_UNTIL );
+  mutex_unlock( mutex );
+
+  while ( 1 ) wait_until_next_period();
+}
+
+int main( void ) {
+
+  ABORT_ON_ERROR( thread_init( NUM_THREADS, USR_STACK_WORDS, NULL, KERNEL_ONLY, NUM_MUTEXES ) );
+
+  mutex = mutex_init( HIGH );
+  if ( mutex == NULL ) {
+    printf( "Failed to create mutex\n" );
+    return -1;
+  }
+
+  // The high and middle threads block on their second job
+  ABORT_ON_ERROR( thread_create( &holder_thread, LOW, 3, 20, NULL ),
+    "Failed to create thread %d\n", LOW
+  );
+  ABORT_ON_ERROR( thread_create( &waiter_thread, MID, 2, 5, ( void * )MID ),
+    "Failed to create thread %d\n", MID
+  );
+  ABORT_ON_ERROR( thread_create( &waiter_thread, HIGH, 2, 7, ( void * )HIGH ),
+    "Failed to create thread %d\n", HIGH
+  );
+
+  printf( "Successfully created threads! Starting scheduler...\n" );
+  ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
+
+  return 0;
+}
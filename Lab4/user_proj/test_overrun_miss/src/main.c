@@ -0,0 +1,61 @@
+/**
+ * @file   main.c
+ *
+ * @brief  Tests that a job cut off at its budget counts as a deadline miss.
+ *         The thread's first job spins through three periods, overrunning
+ *         C in each, and its second job checks that each overrun is also a
+ *         miss. thread_stats must refuse a pointer user code cannot write.
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <time_page.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define NUM_THREADS 1
+#define NUM_MUTEXES 0
+#define CLOCK_FREQUENCY 1000
+
+/** @brief budget and period of the thread */
+#define C 2
+#define T 10
+/** @brief tick the first job spins until, in its third period */
+#define SPIN_UNTIL 25
+
+void overrun_thread( UNUSED void *vargp ) {
+  thread_stats_t stats;
+
+  while ( get_time() < SPIN_UNTIL );
+  wait_until_next_period();
+
+  if ( thread_stats( 0, ( thread_stats_t * )&_time_page ) != -1 ||
+       thread_stats( 0, ( thread_stats_t * )( ( char * )&stats + 2 ) ) != -1 ) {
+    printf( "Failed. thread_stats wrote to a read-only or misaligned pointer\n" );
+  } else if ( thread_stats( 0, &stats ) ) {
+    printf( "Failed. No stats for priority 0\n" );
+  } else if ( stats.overruns != 3 || stats.deadline_misses != 3 ) {
+    printf( "Failed. %d overruns, %d misses\n", ( int )stats.overruns, ( int )stats.deadline_misses );
+  } else {
+    printf( "Test passed!\n" );
+  }
+
+  while ( 1 ) wait_until_next_period();
+}
+
+int main( void ) {
+
+  ABORT_ON_ERROR( thread_init( NUM_THREADS, USR_STACK_WORDS, NULL, KERNEL_ONLY, NUM_MUTEXES ) );
+
+  ABORT_ON_ERROR( thread_create( &overrun_thread, 0, C, T, NULL ) );
+
+  printf( "Starting scheduler...\n" );
+  ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
+
+  return 0;
+}
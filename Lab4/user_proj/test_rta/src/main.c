@@ -0,0 +1,104 @@
+/**
+ * @file   main.c
+ *
+ * @brief  Feeds the task set of every test_* and grade_* project through the
+ *         response-time admission test without starting the scheduler. All
+ *         of them must be admitted, apart from the sets written to be
+ *         rejected, which must fail on the expected thread. Threads take
+ *         priority = index, as in the original tests.
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define MAX_THREADS 14
+#define NUM_MUTEXES 0
+
+/** @brief one task set and the thread admission should stop at */
+typedef struct {
+  const char *name;          /**< project the set comes from */
+  int num;                   /**< number of threads */
+  uint32_t C[MAX_THREADS];   /**< computation times */
+  uint32_t T[MAX_THREADS];   /**< periods */
+  int reject;                /**< index of the thread to be refused, -1 if none */
+} task_set_t;
+
+/** @brief 14 identical threads */
+#define X14( v ) { v, v, v, v, v, v, v, v, v, v, v, v, v, v }
+
+static const task_set_t SETS[] = {
+  { "test_0_0", 1, { 100 }, { 500 }, -1 },
+  { "test_0_1", 2, { 1, 1 }, { 3, 3 }, -1 },
+  { "test_0_2", 14, X14( 1 ), X14( 28 ), -1 },
+  { "test_1_0", 14, X14( 100 ), X14( 7000 ), -1 },
+  { "test_1_1", 1, { 123 }, { 1024 }, -1 },
+  { "test_1_4", 2, { 321, 123 }, { 1024, 1024 }, -1 },
+  { "test_2_0", 1, { 10 }, { 10 }, -1 },
+  { "test_2_3", 4, { 100, 100, 100, 100 }, { 1000, 1000, 1000, 1000 }, -1 },
+  { "test_3_0", 3, { 50, 50, 500 }, { 200, 200, 1000 }, -1 },
+  { "test_3_0 C2+", 3, { 50, 50, 600 }, { 200, 200, 1000 }, 2 },
+  { "test_3_0 C3", 4, { 50, 50, 500, 25 }, { 200, 200, 1000, 5000 }, 3 },
+  { "test_3_1", 3, { 50, 50, 50 }, { 1000, 2000, 3000 }, -1 },
+  { "test_3_3", 3, { 40, 300, 350 }, { 410, 800, 1200 }, -1 },
+  { "test_4_1", 6, { 100, 50, 50, 50, 50, 50 }, { 2000, 500, 500, 500, 500, 500 }, -1 },
+  { "test_4_2 A", 3, { 100, 440, 180 }, { 500, 1100, 1200 }, -1 },
+  { "test_4_2 B", 3, { 100, 100, 380 }, { 500, 700, 900 }, -1 },
+  { "test_4_2 C", 3, { 100, 150, 450 }, { 500, 750, 950 }, -1 },
+  { "test_4_2 C+", 3, { 100, 150, 500 }, { 500, 750, 950 }, 2 },
+  { "test_5_0", 1, { 400 }, { 500 }, -1 },
+  { "test_5_1", 2, { 100, 100 }, { 500, 500 }, -1 },
+  { "test_6_0", 1, { 500 }, { 500 }, -1 },
+  { "test_6_2", 2, { 50, 1000 }, { 500, 2500 }, -1 },
+  { "test_7_0", 3, { 10, 50, 75 }, { 100, 200, 400 }, -1 },
+  { "test_7_1", 2, { 20, 150 }, { 100, 1000 }, -1 },
+  { "test_7_2", 2, { 100, 10000 }, { 500, 1000000 }, -1 },
+  { "test_7_3", 2, { 20, 30 }, { 104, 200 }, -1 },
+  { "test_8_0", 3, { 100, 100, 750 }, { 500, 500, 2000 }, -1 },
+  { "test_9_0", 3, { 400, 500, 300 }, { 1100, 1600, 3100 }, -1 },
+  { "test_9_1", 3, { 300, 100, 600 }, { 700, 900, 2600 }, -1 },
+  { "grade_pcp", 6, { 500, 200, 500, 500, 500, 700 }, { 2500, 3000, 3300, 4000, 6300, 8500 }, -1 },
+  { "grade_rms", 8, { 300, 200, 400, 400, 500, 400, 600, 500 },
+    { 3100, 3300, 3500, 4700, 5100, 5200, 8900, 10200 }, -1 },
+  { "grade_revive", 5, { 50, 50, 50, 50, 100 }, { 500, 500, 500, 500, 500 }, -1 },
+  { "harmonic", 3, { 250, 500, 2000 }, { 1000, 2000, 4000 }, -1 },
+  { "harmonic+", 3, { 250, 500, 2001 }, { 1000, 2000, 4000 }, 2 }
+};
+
+void thread_fn( UNUSED void *vargp ) {
+  while ( 1 ) wait_until_next_period();
+}
+
+int main( void ) {
+  int failed = 0;
+
+  for ( uint32_t s = 0; s < sizeof( SETS ) / sizeof( task_set_t ); s++ ) {
+    const task_set_t *set = &SETS[s];
+    int refused = -1;
+
+    ABORT_ON_ERROR( thread_init( MAX_THREADS, USR_STACK_WORDS, NULL, KERNEL_ONLY, NUM_MUTEXES ) );
+
+    for ( int i = 0; i < set->num; i++ ) {
+      if ( thread_create( &thread_fn, i, set->C[i], set->T[i], NULL ) ) {
+        refused = i;
+        break;
+      }
+    }
+
+    if ( refused != set->reject ) {
+      printf( "Failed %s: refused thread %d, expected %d\n", set->name, refused, set->reject );
+      failed = 1;
+    } else {
+      printf( "%s ok\n", set->name );
+    }
+  }
+
+  if ( !failed ) printf( "Test passed!\n" );
+  return failed;
+}
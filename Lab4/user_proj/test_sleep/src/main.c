@@ -0,0 +1,110 @@
+/**
+ * @file   main.c
+ *
+ * @brief  Tests sleep_until and sleep_ticks. In every job the high priority
+ *         thread sleeps until SLEEPS evenly spaced ticks and must wake on
+ *         each exactly, while the low priority thread does its work in the
+ *         gaps and then sleeps for a number of ticks itself. With both
+ *         asleep the kernel idles tickless, so most of the run is idle.
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define NUM_THREADS 2
+#define NUM_MUTEXES 0
+#define CLOCK_FREQUENCY 1000
+
+/** @brief wakes of the high priority thread per job, and the ticks between them */
+#define SLEEPS 4
+#define STEP 100
+/** @brief work and sleep of the low priority thread per job */
+#define WORK_MS 30
+#define NAP 300
+/** @brief number of jobs of the high priority thread to check */
+#define NUM_JOBS 5
+
+/** @brief period of both threads */
+#define PERIOD 1000
+
+/** @brief jobs finished by the low priority thread */
+static volatile uint32_t low_jobs;
+
+void high_thread( void *vargp ) {
+  ( void )vargp;
+
+  for ( uint32_t cnt = 0; ; cnt++ ) {
+    uint32_t release = PERIOD * cnt;
+
+    // Neither may block
+    uint32_t t = get_time();
+    if ( sleep_ticks( 0 ) || sleep_until( release ) || get_time() != t ) {
+      test_fail( "A zero sleep should have returned at t = %u, returned at t = %u", ( unsigned int )t,
+                 ( unsigned int )get_time() );
+    }
+
+    for ( uint32_t i = 1; i <= SLEEPS; i++ ) {
+      sleep_until( release + i * STEP );
+      if ( get_time() != release + i * STEP ) {
+        test_fail( "Thread 0 should have woken up at t = %u, woke up at t = %u",
+                   ( unsigned int )( release + i * STEP ), ( unsigned int )get_time() );
+      }
+    }
+
+    if ( low_jobs != cnt + 1 ) {
+      test_fail( "Thread 1 ran %d jobs while thread 0 slept through %d", ( int )low_jobs, ( int )cnt + 1 );
+    }
+    if ( cnt + 1 == NUM_JOBS ) {
+      uint32_t idle = ( uint32_t )( 100 * cpu_cycles( CPU_IDLE, 0 ) / cpu_cycles( CPU_TOTAL, 0 ) );
+      printf( "Idle %d%%\n", ( int )idle );
+      printf( "Test passed!\n" );
+      while ( 1 );
+    }
+    wait_until_next_period();
+  }
+}
+
+void low_thread( void *vargp ) {
+  ( void )vargp;
+
+  while ( 1 ) {
+    spin_wait( WORK_MS );
+
+    // Only the high priority thread runs in between, for a tick at most at each wake
+    uint32_t start = get_time();
+    sleep_ticks( NAP );
+    uint32_t t = get_time();
+    if ( t < start + NAP || t > start + NAP + SLEEPS ) {
+      test_fail( "Thread 1 should have woken up at t = %u, woke up at t = %u", ( unsigned int )( start + NAP ),
+                 ( unsigned int )t );
+    }
+
+    low_jobs++;
+    wait_until_next_period();
+  }
+}
+
+int main( void ) {
+
+  ABORT_ON_ERROR( thread_init( NUM_THREADS, USR_STACK_WORDS, NULL, KERNEL_ONLY | TICKLESS, NUM_MUTEXES ) );
+
+  if ( sleep_ticks( 1 ) != -1 ) {
+    printf( "Failed. main must not be able to sleep\n" );
+    return -1;
+  }
+
+  ABORT_ON_ERROR( thread_create( &high_thread, 0, 5, PERIOD, NULL ) );
+  ABORT_ON_ERROR( thread_create( &low_thread, 1, 100, PERIOD, NULL ) );
+
+  printf( "Successfully created threads! Starting scheduler...\n" );
+  ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
+
+  return 0;
+}
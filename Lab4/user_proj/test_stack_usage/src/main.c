@@ -0,0 +1,123 @@
+/**
+ * @file   main.c
+ *
+ * @brief  Tests the stack high-watermarks. Before the scheduler starts a
+ *         thread has used exactly its initial frames, which main checks.
+ *         Thread 0 then recurses through a known amount of stack and its
+ *         user peak must cover it, thread 1 stays shallow, and the peaks
+ *         must never go down. Ctrl-T prints the same peaks for every thread.
+ *         thread_stack_usage must refuse a pointer user code cannot write.
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <time_page.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define NUM_THREADS 2
+#define NUM_MUTEXES 0
+#define CLOCK_FREQUENCY 1000
+
+/** @brief levels thread 0 recurses and the words of locals at each */
+#define DEPTH 4
+#define FRAME_WORDS 32
+/** @brief bytes a new thread has used, its exception frame and its saved callee registers */
+#define INIT_USER_PEAK ( 8 * 4 )
+#define INIT_KERNEL_PEAK ( 10 * 4 )
+/** @brief number of jobs of thread 0 to check */
+#define NUM_JOBS 3
+
+/** @brief C and T of both threads */
+#define BUDGET 20
+#define PERIOD 100
+
+static stack_usage_t usage_of( uint32_t prio ) {
+  stack_usage_t usage;
+  if ( thread_stack_usage( prio, &usage ) ) test_fail( "No stack use for thread %u", ( unsigned int )prio );
+  return usage;
+}
+
+/**
+ * @brief  uses at least FRAME_WORDS words of stack per level
+ * @return a sum the compiler cannot fold away
+ */
+static uint32_t recurse( uint32_t depth ) {
+  volatile uint32_t frame[FRAME_WORDS];
+
+  for ( uint32_t i = 0; i < FRAME_WORDS; i++ ) frame[i] = depth + i;
+  if ( depth == 0 ) return frame[0];
+  return frame[FRAME_WORDS - 1] + recurse( depth - 1 );
+}
+
+void deep_thread( void *vargp ) {
+  ( void )vargp;
+  uint32_t last_peak = 0;
+
+  for ( uint32_t cnt = 0; ; cnt++ ) {
+    recurse( DEPTH - 1 );
+
+    stack_usage_t deep = usage_of( 0 );
+    stack_usage_t shallow = usage_of( 1 );
+    if ( deep.user_peak < DEPTH * FRAME_WORDS * 4 )
+      test_fail( "Thread 0 user peak below its recursion: %u", ( unsigned int )deep.user_peak );
+    if ( deep.user_peak > deep.user_size )
+      test_fail( "Thread 0 user peak past its stack: %u", ( unsigned int )deep.user_peak );
+    if ( deep.user_peak < last_peak ) test_fail( "Thread 0 user peak went down to %u", ( unsigned int )deep.user_peak );
+    if ( shallow.user_peak >= deep.user_peak )
+      test_fail( "Thread 1 used as much stack as thread 0: %u", ( unsigned int )shallow.user_peak );
+    if ( deep.kernel_peak <= INIT_KERNEL_PEAK || deep.kernel_peak > deep.kernel_size )
+      test_fail( "Thread 0 kernel peak: %u", ( unsigned int )deep.kernel_peak );
+    last_peak = deep.user_peak;
+
+    if ( cnt + 1 == NUM_JOBS ) {
+      printf( "Thread 0 used %u of %uB user and %u of %uB kernel stack\n", ( unsigned int )deep.user_peak,
+              ( unsigned int )deep.user_size, ( unsigned int )deep.kernel_peak, ( unsigned int )deep.kernel_size );
+      printf( "Thread 1 used %u of %uB user and %u of %uB kernel stack\n", ( unsigned int )shallow.user_peak,
+              ( unsigned int )shallow.user_size, ( unsigned int )shallow.kernel_peak,
+              ( unsigned int )shallow.kernel_size );
+      printf( "Test passed!\n" );
+      while ( 1 );
+    }
+    wait_until_next_period();
+  }
+}
+
+void shallow_thread( void *vargp ) {
+  ( void )vargp;
+
+  while ( 1 ) wait_until_next_period();
+}
+
+int main( void ) {
+
+  ABORT_ON_ERROR( thread_init( NUM_THREADS, USR_STACK_WORDS, NULL, PER_THREAD, NUM_MUTEXES ) );
+
+  ABORT_ON_ERROR( thread_create( &deep_thread, 0, BUDGET, PERIOD, NULL ) );
+  ABORT_ON_ERROR( thread_create( &shallow_thread, 1, BUDGET, PERIOD, NULL ) );
+
+  stack_usage_t usage;
+  if ( thread_stack_usage( NUM_THREADS, &usage ) != -1 ) test_fail( "Stack use of a missing thread did not fail" );
+  if ( thread_stack_usage( 0, ( stack_usage_t * )&_time_page ) != -1 )
+    test_fail( "Stack use was written to a read-only pointer" );
+  for ( uint32_t prio = 0; prio < NUM_THREADS; prio++ ) {
+    usage = usage_of( prio );
+    if ( usage.user_peak != INIT_USER_PEAK )
+      test_fail( "User peak of a new thread: %u", ( unsigned int )usage.user_peak );
+    if ( usage.kernel_peak != INIT_KERNEL_PEAK )
+      test_fail( "Kernel peak of a new thread: %u", ( unsigned int )usage.kernel_peak );
+    if ( usage.user_size < USR_STACK_WORDS * 4 || usage.kernel_size < USR_STACK_WORDS * 4 )
+      test_fail( "Stack sizes above the guards: %u, %u", ( unsigned int )usage.user_size,
+                 ( unsigned int )usage.kernel_size );
+  }
+
+  printf( "Successfully created threads! Starting scheduler...\n" );
+  ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
+
+  return 0;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file   main.c
+ *
+ * @brief  Tests semaphores and event flags. A producer posts one item per
+ *         period to a semaphore that a higher priority consumer blocks on,
+ *         and sets an event flag every other period. A watcher waits for
+ *         the flag with a timeout shorter than two periods, so it must see
+ *         every flag once and time out in between.
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define NUM_THREADS 3
+#define NUM_MUTEXES 0
+#define CLOCK_FREQUENCY 1000
+
+/** @brief thread priorities */
+#define CONSUMER 0
+#define PRODUCER 1
+#define WATCHER 2
+/** @brief producer jobs to check after */
+#define NUM_JOBS 20
+/** @brief period of every thread */
+#define PERIOD 10
+/** @brief how long the watcher waits for the flag, set every 2 * PERIOD */
+#define WATCH_TIMEOUT 15
+/** @brief the flag the producer sets */
+#define FLAG_ODD_JOB ( 1 << 3 )
+
+static sem_t *items;
+static event_t *events;
+static volatile uint32_t consumed;
+static volatile uint32_t hits;
+static volatile uint32_t timeouts;
+
+void consumer_thread( void *vargp ) {
+  ( void )vargp;
+
+  while ( 1 ) {
+    if ( sem_wait( items, WAIT_FOREVER ) == 0 ) consumed++;
+  }
+}
+
+void producer_thread( void *vargp ) {
+  ( void )vargp;
+
+  for ( uint32_t job = 0;; job++ ) {
+    if ( job == NUM_JOBS ) {
+      if ( consumed != NUM_JOBS || hits != NUM_JOBS / 2 || timeouts == 0 ) {
+        printf( "Failed. Consumed %d of %d, %d of %d flags seen, %d timeouts\n", ( int )consumed,
+                NUM_JOBS, ( int )hits, NUM_JOBS / 2, ( int )timeouts );
+      } else {
+        printf( "Test passed!\n" );
+      }
+      while ( 1 );
+    }
+
+    sem_post( items );
+    if ( job & 1 ) event_set( events, FLAG_ODD_JOB );
+    wait_until_next_period();
+  }
+}
+
+void watcher_thread( void *vargp ) {
+  ( void )vargp;
+
+  while ( 1 ) {
+    uint32_t flags = event_wait( events, FLAG_ODD_JOB, EVENT_ANY | EVENT_CLEAR, WATCH_TIMEOUT );
+    if ( flags == FLAG_ODD_JOB ) hits++;
+    else timeouts++;
+  }
+}
+
+int main( void ) {
+
+  ABORT_ON_ERROR( thread_init( NUM_THREADS, USR_STACK_WORDS, NULL, KERNEL_ONLY, NUM_MUTEXES ) );
+
+  items = sem_init( 0 );
+  events = event_init();
+  if ( items == NULL || events == NULL ) {
+    printf( "Failed to create the semaphore and event group\n" );
+    return -1;
+  }
+  // Without a timeout, waits that cannot be satisfied return at once
+  if ( sem_wait( items, 0 ) != -1 || event_wait( events, FLAG_ODD_JOB, EVENT_ALL, 0 ) != 0 ) {
+    printf( "Failed. An empty semaphore or clear flag did not refuse\n" );
+    return -1;
+  }
+
+  ABORT_ON_ERROR( thread_create( &consumer_thread, CONSUMER, 2, PERIOD, NULL ),
+    "Failed to create thread %d\n", CONSUMER
+  );
+  ABORT_ON_ERROR( thread_create( &producer_thread, PRODUCER, 2, PERIOD, NULL ),
+    "Failed to create thread %d\n", PRODUCER
+  );
+  ABORT_ON_ERROR( thread_create( &watcher_thread, WATCHER, 2, PERIOD, NULL ),
+    "Failed to create thread %d\n", WATCHER
+  );
+
+  printf( "Successfully created threads! Starting scheduler...\n" );
+  ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
+
+  return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file   main.c
+ *
+ * @brief  Tests tickless idle. Both threads finish their work early and wait
+ *         for their next period, so the kernel sleeps through the idle time.
+ *         Every job must still start on the exact tick it is released, the
+ *         same times test_1_1 style tests check with the tick running. The
+ *         3000 tick period is longer than one systick reload can cover at
+ *         1kHz, so the kernel has to chain sleeps to reach it.
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define NUM_THREADS 2
+#define NUM_MUTEXES 0
+#define CLOCK_FREQUENCY 1000
+
+/** @brief work done in each job, well under C */
+#define WORK_MS 20
+/** @brief number of jobs of the slower thread to check */
+#define NUM_JOBS 5
+
+/** @brief C and T of each thread, highest priority first */
+static const uint32_t C[NUM_THREADS] = { 50, 100 };
+static const uint32_t T[NUM_THREADS] = { 500, 3000 };
+
+void thread_fn( void *vargp ) {
+  int id = ( int )vargp;
+  /* The lower priority thread may be released together with the higher one */
+  uint32_t slack = id ? C[0] : 0;
+  int cnt = 0;
+
+  while ( 1 ) {
+    uint32_t release = T[id] * cnt;
+    uint32_t t = get_time();
+
+    if ( t < release || t > release + slack ) {
+      printf( "Failed. Thread %d should have woken up at t = %u\n", id, ( unsigned int )release );
+      printf( "Woke up at t = %u\n", ( unsigned int )t );
+      while ( 1 );
+    }
+
+    print_num_status_cnt( id, cnt++ );
+
+    if ( id == 1 && cnt > NUM_JOBS ) {
+      printf( "Test passed!\n" );
+      while ( 1 );
+    }
+
+    spin_wait( WORK_MS );
+    wait_until_next_period();
+  }
+}
+
+int main( void ) {
+
+  ABORT_ON_ERROR( thread_init( NUM_THREADS, USR_STACK_WORDS, NULL, KERNEL_ONLY | TICKLESS, NUM_MUTEXES ) );
+
+  for ( int i = 0; i < NUM_THREADS; i++ ) {
+    ABORT_ON_ERROR( thread_create( &thread_fn, i, C[i], T[i], ( void * )i ),
+      "Failed to create thread %d\n", i
+    );
+  }
+
+  printf( "Successfully created threads! Starting scheduler...\n" );
+  ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
+
+  return 0;
+
+}
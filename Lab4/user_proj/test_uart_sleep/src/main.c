@@ -0,0 +1,78 @@
+/**
+ * @file   main.c
+ *
+ * @brief  Tests that a thread waiting for console input sleeps until the
+ *         UART receive interrupt wakes it, instead of spinning. The high
+ *         priority reader calls read() with nothing typed. Had it spun, it
+ *         would overrun its budget every period. After 10 periods the low
+ *         priority thread checks that the reader never overran and ran for
+ *         under a tick. Any line typed meanwhile is echoed back.
+ *
+ * @author Arden Diakhate-Palme
+ */
+
+#include <349_lib.h>
+#include <349_threads.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** @brief thread user space stack size - 1KB */
+#define USR_STACK_WORDS 256
+#define NUM_THREADS 2
+#define NUM_MUTEXES 0
+#define CLOCK_FREQUENCY 1000
+#define CPU_FREQUENCY 16000000
+
+/** @brief priorities of the threads */
+#define READER 0
+#define CHECKER 1
+/** @brief C and T of both threads */
+#define BUDGET 50
+#define PERIOD 100
+/** @brief tick the checker looks at the reader, after 10 of its periods */
+#define CHECK_AT 1000
+
+/** @brief CPU cycles in one tick */
+#define TICK_CYCLES ( CPU_FREQUENCY / CLOCK_FREQUENCY )
+
+void reader_thread( UNUSED void *vargp ) {
+  char line[32];
+
+  while ( 1 ) {
+    int n = read( STDIN_FILENO, line, sizeof( line ) - 1 );
+    if ( n > 0 ) {
+      line[n] = 0;
+      printf( "Read %s", line );
+    }
+  }
+}
+
+void checker_thread( UNUSED void *vargp ) {
+  thread_stats_t stats;
+
+  while ( get_time() < CHECK_AT ) wait_until_next_period();
+
+  uint64_t cycles = cpu_cycles( CPU_THREAD, READER );
+  thread_stats( READER, &stats );
+  if ( stats.overruns != 0 || cycles >= TICK_CYCLES ) {
+    printf( "Failed. Reader overran %d times, ran %d cycles\n", ( int )stats.overruns, ( int )cycles );
+  } else {
+    printf( "Test passed! Reader ran %d cycles\n", ( int )cycles );
+  }
+
+  while ( 1 ) wait_until_next_period();
+}
+
+int main( void ) {
+
+  ABORT_ON_ERROR( thread_init( NUM_THREADS, USR_STACK_WORDS, NULL, KERNEL_ONLY, NUM_MUTEXES ) );
+
+  ABORT_ON_ERROR( thread_create( &reader_thread, READER, BUDGET, PERIOD, NULL ) );
+  ABORT_ON_ERROR( thread_create( &checker_thread, CHECKER, BUDGET, PERIOD, NULL ) );
+
+  printf( "Starting scheduler...\n" );
+  ABORT_ON_ERROR( scheduler_start( CLOCK_FREQUENCY ) );
+
+  return 0;
+}